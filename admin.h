@@ -0,0 +1,109 @@
+#pragma once
+
+#include "hot_restart.h"
+#include <cerrno>
+#include <cstdio>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// --- Admin Socket ---
+// Operators talk to a running server over a local Unix socket
+// (--admin-socket PATH, mode 0600, so only the server's user can connect).
+// Each connection carries one command line, answered with plain text before
+// the server closes it:
+//   echo "profile start 199" | nc -U /run/fhe-admin.sock
+// The commands are dispatched by the server (see server.cpp).
+
+// Splits a command line into words.
+inline std::vector<std::string> split_command(const std::string& line) {
+    std::istringstream in(line);
+    std::vector<std::string> words;
+    for (std::string word; in >> word;) words.push_back(word);
+    return words;
+}
+
+class AdminSocket {
+public:
+    using Handler = std::function<std::string(const std::vector<std::string>& command)>;
+
+    // Throws std::runtime_error if the socket cannot be created.
+    AdminSocket(std::string path, Handler handler) : path_(std::move(path)), handler_(std::move(handler)) {
+        listen_fd_ = listen_for_handoff(path_);
+        if (listen_fd_ < 0) throw std::runtime_error("admin socket: cannot listen on " + path_);
+        chmod(path_.c_str(), 0600);
+        if (pipe(stop_pipe_) != 0) {
+            close(listen_fd_);
+            throw std::runtime_error("admin socket: cannot create pipe");
+        }
+        thread_ = std::thread([this]() { serve(); });
+    }
+
+    ~AdminSocket() {
+        char stop = 1;
+        if (write(stop_pipe_[1], &stop, 1) != 1) perror("write");
+        thread_.join();
+        close(listen_fd_);
+        close(stop_pipe_[0]);
+        close(stop_pipe_[1]);
+        unlink(path_.c_str());
+    }
+
+    AdminSocket(const AdminSocket&) = delete;
+    AdminSocket& operator=(const AdminSocket&) = delete;
+
+private:
+    void serve() {
+        while (true) {
+            struct pollfd fds[2] = { { listen_fd_, POLLIN, 0 }, { stop_pipe_[0], POLLIN, 0 } };
+            if (poll(fds, 2, -1) < 0) continue;
+            if (fds[1].revents) return;
+            if (!(fds[0].revents & POLLIN)) continue;
+            int connection = accept(listen_fd_, nullptr, nullptr);
+            if (connection < 0) continue;
+            answer(connection);
+            close(connection);
+        }
+    }
+
+    // One command per connection, up to the first newline (or 4 KiB)
+    void answer(int connection) {
+        struct timeval timeout = { 5, 0 };
+        setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        std::string line;
+        char buffer[512];
+        while (line.find('\n') == std::string::npos && line.size() < 4096) {
+            ssize_t received = recv(connection, buffer, sizeof(buffer), 0);
+            if (received < 0 && errno == EINTR) continue;
+            if (received <= 0) break;
+            line.append(buffer, static_cast<size_t>(received));
+        }
+        line = line.substr(0, line.find('\n'));
+        std::string reply;
+        try {
+            reply = handler_(split_command(line));
+        } catch (const std::exception& e) {
+            reply = std::string("error: ") + e.what() + "\n";
+        }
+        for (size_t sent = 0; sent < reply.size();) {
+            ssize_t n = send(connection, reply.data() + sent, reply.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            sent += static_cast<size_t>(n);
+        }
+    }
+
+    const std::string path_;
+    const Handler handler_;
+    int listen_fd_ = -1;
+    int stop_pipe_[2] = { -1, -1 };
+    std::thread thread_;
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "coalescer.h"
+#include "key_registry.h"
+#include "result_cache.h"
+#include "session_memory.h"
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// --- Admin Status ---
+// The admin socket's status command (see admin.h) answers what is going on in
+// the server right now, without a metrics pipeline:
+//   echo "status" | nc -U /run/fhe-admin.sock
+// "status sessions", "status caches" and "status queues" show one section.
+// Sessions list their key group (fingerprint prefix, N and coefficient modulus
+// bits), bytes in and out, requests answered, memory reserved by the requests
+// in flight and time connected. Caches show how often a session found its keys
+// already loaded, and the result cache. Queues show the batches waiting per
+// key holder, the requests still in their coalescing window, how busy the
+// workers have been, and how far each running batch is against its estimate.
+// Every value is read under the owner's own lock, one owner at a time, so the
+// sections are each consistent but not a single snapshot of the server.
+
+struct AdminStatus {
+    std::vector<SessionMemoryStats> sessions;
+    KeyRegistryStats keys;
+    ResultCacheStats results;
+    CoalescerStats coalescer;
+    std::vector<TenantQueue> queues;
+    std::map<std::string, size_t> coalescing; // fingerprint -> requests in the window
+    std::vector<RunningJob> running;
+};
+
+namespace admin_status_detail {
+    inline std::string percent(double part, double whole) {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(1) << (whole > 0 ? 100.0 * part / whole : 0.0) << "%";
+        return out.str();
+    }
+
+    inline std::string short_fingerprint(const std::string& fingerprint) {
+        return fingerprint.empty() ? "-" : fingerprint.substr(0, 16);
+    }
+
+    inline void format_sessions(std::ostringstream& out, const AdminStatus& status) {
+        out << "sessions: " << status.sessions.size() << "\n";
+        for (const auto& s : status.sessions) {
+            out << "  session " << s.session_id << ": keys " << short_fingerprint(s.fingerprint);
+            if (s.poly_modulus_degree) out << " (N=" << s.poly_modulus_degree << ", " << s.coeff_modulus_bits << " bits)";
+            out << ", " << s.bytes_received / 1024 << " KiB in, " << s.bytes_sent / 1024 << " KiB out, " << s.requests
+                << " requests, " << s.responses << " responses, " << s.in_flight_bytes / 1024 << " KiB in flight, "
+                << static_cast<long long>(s.connected_seconds) << " s connected\n";
+        }
+    }
+
+    inline void format_caches(std::ostringstream& out, const AdminStatus& status) {
+        const KeyRegistryStats& keys = status.keys;
+        out << "key groups: " << keys.live << " live (" << keys.hibernated << " hibernated, " << keys.key_pool_bytes / 1024
+            << " KiB of keys loaded), " << keys.adopted << " awaiting a session, " << keys.moved << " moved; lookups "
+            << keys.lookups << ", hit rate " << percent(keys.hits, keys.lookups) << "\n";
+        const ResultCacheStats& results = status.results;
+        out << "result cache: " << results.entries << " responses (" << results.bytes / 1024 << " KiB), " << results.pending
+            << " pending, " << results.hits << " hits, " << results.evictions << " evictions\n";
+    }
+
+    inline void format_queues(std::ostringstream& out, const AdminStatus& status) {
+        const SchedulerStats& scheduler = status.coalescer.scheduler;
+        out << "workers: " << scheduler.running_jobs << "/" << scheduler.workers << " busy, utilization "
+            << percent(scheduler.busy_microseconds, scheduler.uptime_microseconds * scheduler.workers) << " since start; "
+            << scheduler.completed_jobs << " batches done, " << scheduler.refused_jobs << " refused\n";
+        out << "queued: " << scheduler.queued_jobs << " batches, " << scheduler.queued_microseconds / 1000.0 << " ms estimated\n";
+        for (const auto& queue : status.queues) {
+            out << "  " << short_fingerprint(queue.tenant) << ": " << queue.jobs << " batches, " << queue.microseconds / 1000.0
+                << " ms estimated\n";
+        }
+        size_t coalescing = 0;
+        for (const auto& entry : status.coalescing) coalescing += entry.second;
+        out << "coalescing: " << coalescing << " requests in the window\n";
+        for (const auto& entry : status.coalescing) {
+            out << "  " << short_fingerprint(entry.first) << ": " << entry.second << " requests\n";
+        }
+        out << "running: " << status.running.size() << " batches\n";
+        for (const auto& job : status.running) {
+            out << "  " << short_fingerprint(job.tenant) << ": " << job.elapsed_microseconds / 1000.0 << " of "
+                << job.cost_microseconds / 1000.0 << " ms estimated ("
+                << percent(job.elapsed_microseconds, job.cost_microseconds) << ")\n";
+        }
+    }
+}
+
+// section is "" for everything, or "sessions", "caches" or "queues". Throws
+// std::invalid_argument for anything else.
+inline std::string format_admin_status(const AdminStatus& status, const std::string& section = "") {
+    std::ostringstream out;
+    if (section != "" && section != "sessions" && section != "caches" && section != "queues") {
+        throw std::invalid_argument("unknown status section: " + section);
+    }
+    if (section == "" || section == "sessions") admin_status_detail::format_sessions(out, status);
+    if (section == "" || section == "caches") admin_status_detail::format_caches(out, status);
+    if (section == "" || section == "queues") admin_status_detail::format_queues(out, status);
+    return out.str();
+}
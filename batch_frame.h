@@ -0,0 +1,448 @@
+#pragma once
+
+#include "seal/seal.h"
+#include "seal/util/rns.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// --- Batch Frames ---
+// Every object saved with SEAL's save() carries its own header (magic, version,
+// sizes) and its own parms_id, and used to travel in its own frame. A batch
+// frame carries N ciphertexts/plaintexts behind one shared header:
+//
+//   magic u32 | version u16 | flags u16 | parms_id 4 x u64 | count u32
+//   count x { kind u8 | offset u64 | size u64 }     (offsets into the body area)
+//   bodies
+//
+// A ciphertext body is its size (u32) followed by every RNS component packed at
+// the bit width of its prime; a plaintext body is its coefficient count (u64)
+// followed by the coefficients packed at the bit width of the plain modulus.
+// Each object is independent of the others, so a receiver can unpack them in
+// parallel straight from the offset table. Integers are in host byte order, like
+// the frame size prefix.
+//
+// A bit-dropped ciphertext (size 2 only) is stored as two u16 drop counts
+// followed by c0 and c1 with every coefficient CRT-composed modulo q, shifted
+// right by that poly's drop count and packed at bits(q) - drop bits. The
+// receiver shifts the zeros back in and decomposes into RNS again. The rounding
+// error is at most 2^drop per coefficient, so the sender chooses the drop
+// counts from the noise budget it can spend (see response_pack.h).
+
+const uint32_t BATCH_FRAME_MAGIC = 0x42454846; // "FHEB"
+const uint16_t BATCH_FRAME_VERSION = 1;
+
+enum class BatchObjectKind : uint8_t {
+    ciphertext = 1,
+    plaintext = 2,
+    ciphertext_bit_dropped = 3
+};
+
+namespace batch_frame_detail {
+    template <class T>
+    void put(std::string& out, T value) {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <class T>
+    T get(const std::string& in, size_t& pos) {
+        if (in.size() < sizeof(T) || pos > in.size() - sizeof(T)) throw std::invalid_argument("batch frame: truncated");
+        T value;
+        std::memcpy(&value, in.data() + pos, sizeof(T));
+        pos += sizeof(T);
+        return value;
+    }
+
+    inline size_t packed_size(size_t count, int bits) {
+        return (count * static_cast<size_t>(bits) + 7) / 8;
+    }
+
+    // Writes values of up to 64 bits each into a pre-sized buffer, least
+    // significant bit first, with no padding between values.
+    class BitWriter {
+    public:
+        explicit BitWriter(char* dest) : dest_(reinterpret_cast<unsigned char*>(dest)) {}
+
+        void write(uint64_t value, int bits) {
+            acc_ |= static_cast<unsigned __int128>(value) << filled_;
+            filled_ += bits;
+            while (filled_ >= 8) {
+                *dest_++ = static_cast<unsigned char>(acc_);
+                acc_ >>= 8;
+                filled_ -= 8;
+            }
+        }
+
+        // Multi-precision value of words 64-bit words, bits wide in total.
+        void write_words(const uint64_t* value, size_t words, int bits) {
+            for (size_t j = 0; j < words && bits > 0; j++, bits -= 64) write(value[j], bits < 64 ? bits : 64);
+        }
+
+        void flush() {
+            if (filled_ > 0) *dest_ = static_cast<unsigned char>(acc_);
+            acc_ = 0;
+            filled_ = 0;
+        }
+
+    private:
+        unsigned char* dest_;
+        unsigned __int128 acc_ = 0;
+        int filled_ = 0;
+    };
+
+    class BitReader {
+    public:
+        explicit BitReader(const char* src) : src_(reinterpret_cast<const unsigned char*>(src)) {}
+
+        uint64_t read(int bits) {
+            while (filled_ < bits) {
+                acc_ |= static_cast<unsigned __int128>(*src_++) << filled_;
+                filled_ += 8;
+            }
+            uint64_t value = static_cast<uint64_t>(acc_) & (bits == 64 ? ~uint64_t(0) : (uint64_t(1) << bits) - 1);
+            acc_ >>= bits;
+            filled_ -= bits;
+            return value;
+        }
+
+        void read_words(uint64_t* value, size_t words, int bits) {
+            for (size_t j = 0; j < words; j++, bits -= 64) value[j] = bits > 0 ? read(bits < 64 ? bits : 64) : 0;
+        }
+
+    private:
+        const unsigned char* src_;
+        unsigned __int128 acc_ = 0;
+        int filled_ = 0;
+    };
+
+    // Appends count values of at most bits bits each.
+    inline void pack_bits(const uint64_t* in, size_t count, int bits, std::string& out) {
+        size_t start = out.size();
+        out.resize(start + packed_size(count, bits));
+        BitWriter writer(&out[start]);
+        for (size_t i = 0; i < count; i++) writer.write(in[i], bits);
+        writer.flush();
+    }
+
+    inline void unpack_bits(const char* in, size_t count, int bits, uint64_t* out) {
+        BitReader reader(in);
+        for (size_t i = 0; i < count; i++) out[i] = reader.read(bits);
+    }
+
+    // --- Multi-precision helpers for bit dropping (little-endian words) ---
+    inline void shift_right_words(const uint64_t* in, size_t words, int shift, uint64_t* out) {
+        size_t word_shift = static_cast<size_t>(shift) / 64;
+        int bit_shift = shift % 64;
+        for (size_t j = 0; j < words; j++) {
+            uint64_t low = j + word_shift < words ? in[j + word_shift] : 0;
+            uint64_t high = j + word_shift + 1 < words ? in[j + word_shift + 1] : 0;
+            out[j] = bit_shift ? (low >> bit_shift) | (high << (64 - bit_shift)) : low;
+        }
+    }
+
+    inline void shift_left_words(uint64_t* value, size_t words, int shift) {
+        size_t word_shift = static_cast<size_t>(shift) / 64;
+        int bit_shift = shift % 64;
+        for (size_t j = words; j-- > 0;) {
+            uint64_t high = j >= word_shift ? value[j - word_shift] : 0;
+            uint64_t low = j >= word_shift + 1 ? value[j - word_shift - 1] : 0;
+            value[j] = bit_shift ? (high << bit_shift) | (low >> (64 - bit_shift)) : high;
+        }
+    }
+
+    inline bool test_bit(const uint64_t* value, int bit) {
+        return (value[bit / 64] >> (bit % 64)) & 1;
+    }
+
+    // value -= modulus if value >= modulus
+    inline void reduce_once_words(uint64_t* value, const uint64_t* modulus, size_t words) {
+        for (size_t j = words; j-- > 0;) {
+            if (value[j] != modulus[j]) {
+                if (value[j] < modulus[j]) return;
+                break;
+            }
+        }
+        unsigned char borrow = 0;
+        for (size_t j = 0; j < words; j++) {
+            uint64_t diff = value[j] - modulus[j];
+            unsigned char next = (value[j] < modulus[j]) || (diff < borrow);
+            value[j] = diff - borrow;
+            borrow = next;
+        }
+    }
+} // namespace batch_frame_detail
+
+// Builds a batch frame. All ciphertexts must be at the writer's parms_id.
+class BatchFrameWriter {
+public:
+    BatchFrameWriter(const seal::SEALContext& context, seal::parms_id_type parms_id) : context_(context), parms_id_(parms_id) {
+        context_data_ = context_.get_context_data(parms_id_);
+        if (!context_data_) throw std::invalid_argument("BatchFrameWriter: parms_id is not valid for the context");
+    }
+
+    void add(const seal::Ciphertext& encrypted) {
+        if (encrypted.parms_id() != parms_id_) throw std::invalid_argument("BatchFrameWriter: ciphertext is at a different level");
+        if (encrypted.is_ntt_form()) throw std::invalid_argument("BatchFrameWriter: NTT-form ciphertexts are not supported");
+        const auto& coeff_modulus = context_data_->parms().coeff_modulus();
+        size_t n = encrypted.poly_modulus_degree();
+        std::string body;
+        batch_frame_detail::put<uint32_t>(body, static_cast<uint32_t>(encrypted.size()));
+        for (size_t k = 0; k < encrypted.size(); k++) {
+            for (size_t i = 0; i < coeff_modulus.size(); i++) {
+                batch_frame_detail::pack_bits(encrypted.data(k) + i * n, n, coeff_modulus[i].bit_count(), body);
+            }
+        }
+        push(BatchObjectKind::ciphertext, std::move(body));
+    }
+
+    // Adds a size-2 ciphertext with the low drop_c0 / drop_c1 bits of its c0 / c1
+    // coefficients (as integers modulo q) dropped.
+    void add_bit_dropped(const seal::Ciphertext& encrypted, int drop_c0, int drop_c1,
+                         seal::MemoryPoolHandle pool = seal::MemoryManager::GetPool()) {
+        if (encrypted.parms_id() != parms_id_) throw std::invalid_argument("BatchFrameWriter: ciphertext is at a different level");
+        if (encrypted.is_ntt_form() || encrypted.size() != 2) {
+            throw std::invalid_argument("BatchFrameWriter: bit dropping needs a size-2 ciphertext in coefficient form");
+        }
+        const seal::util::RNSBase* base_q = context_data_->rns_tool()->base_q();
+        const int q_bits = context_data_->total_coeff_modulus_bit_count();
+        if (drop_c0 < 0 || drop_c1 < 0 || drop_c0 >= q_bits || drop_c1 >= q_bits) {
+            throw std::invalid_argument("BatchFrameWriter: invalid drop bit count");
+        }
+        const size_t words = base_q->size();
+        const size_t n = encrypted.poly_modulus_degree();
+        const int drops[2] = { drop_c0, drop_c1 };
+
+        std::string body;
+        batch_frame_detail::put<uint32_t>(body, 2);
+        batch_frame_detail::put<uint16_t>(body, static_cast<uint16_t>(drop_c0));
+        batch_frame_detail::put<uint16_t>(body, static_cast<uint16_t>(drop_c1));
+        std::vector<uint64_t> composed(words * n);
+        std::vector<uint64_t> kept_value(words);
+        std::vector<uint64_t> rounded(words);
+        for (size_t k = 0; k < 2; k++) {
+            std::copy(encrypted.data(k), encrypted.data(k) + words * n, composed.begin());
+            base_q->compose_array(composed.data(), n, pool);
+
+            int drop = drops[k];
+            int kept = q_bits - drop;
+            size_t start = body.size();
+            body.resize(start + batch_frame_detail::packed_size(n, kept));
+            batch_frame_detail::BitWriter writer(&body[start]);
+            for (size_t c = 0; c < n; c++) {
+                const uint64_t* value = composed.data() + c * words;
+                batch_frame_detail::shift_right_words(value, words, drop, kept_value.data());
+                // Round to nearest unless that carries out of the kept width
+                if (drop > 0 && batch_frame_detail::test_bit(value, drop - 1)) {
+                    rounded = kept_value;
+                    for (size_t j = 0; j < words && ++rounded[j] == 0; j++) {}
+                    if (!batch_frame_detail::test_bit(rounded.data(), kept)) kept_value.swap(rounded);
+                }
+                writer.write_words(kept_value.data(), words, kept);
+            }
+            writer.flush();
+        }
+        push(BatchObjectKind::ciphertext_bit_dropped, std::move(body));
+    }
+
+    void add(const seal::Plaintext& plain) {
+        if (plain.is_ntt_form()) throw std::invalid_argument("BatchFrameWriter: NTT-form plaintexts are not supported");
+        std::string body;
+        batch_frame_detail::put<uint64_t>(body, plain.coeff_count());
+        batch_frame_detail::pack_bits(plain.data(), plain.coeff_count(), context_data_->parms().plain_modulus().bit_count(), body);
+        push(BatchObjectKind::plaintext, std::move(body));
+    }
+
+    size_t size() const { return kinds_.size(); }
+
+    // Serializes the header, offset table and bodies into one frame payload.
+    std::string finish() const {
+        std::string out;
+        batch_frame_detail::put<uint32_t>(out, BATCH_FRAME_MAGIC);
+        batch_frame_detail::put<uint16_t>(out, BATCH_FRAME_VERSION);
+        batch_frame_detail::put<uint16_t>(out, 0);
+        for (uint64_t word : parms_id_) batch_frame_detail::put<uint64_t>(out, word);
+        batch_frame_detail::put<uint32_t>(out, static_cast<uint32_t>(kinds_.size()));
+        uint64_t offset = 0;
+        for (size_t i = 0; i < kinds_.size(); i++) {
+            batch_frame_detail::put<uint8_t>(out, static_cast<uint8_t>(kinds_[i]));
+            batch_frame_detail::put<uint64_t>(out, offset);
+            batch_frame_detail::put<uint64_t>(out, bodies_[i].size());
+            offset += bodies_[i].size();
+        }
+        for (const auto& body : bodies_) out += body;
+        return out;
+    }
+
+private:
+    void push(BatchObjectKind kind, std::string body) {
+        kinds_.push_back(kind);
+        bodies_.push_back(std::move(body));
+    }
+
+    const seal::SEALContext& context_;
+    seal::parms_id_type parms_id_;
+    std::shared_ptr<const seal::SEALContext::ContextData> context_data_;
+    std::vector<BatchObjectKind> kinds_;
+    std::vector<std::string> bodies_;
+};
+
+// Parses a batch frame's header and offset table up front (throwing
+// std::invalid_argument on anything malformed); load() then unpacks single
+// objects and is safe to call concurrently for different indices.
+class BatchFrameReader {
+public:
+    BatchFrameReader(const seal::SEALContext& context, std::string frame) : context_(context), frame_(std::move(frame)) {
+        size_t pos = 0;
+        if (batch_frame_detail::get<uint32_t>(frame_, pos) != BATCH_FRAME_MAGIC) {
+            throw std::invalid_argument("batch frame: bad magic");
+        }
+        if (batch_frame_detail::get<uint16_t>(frame_, pos) != BATCH_FRAME_VERSION) {
+            throw std::invalid_argument("batch frame: unsupported version");
+        }
+        if (batch_frame_detail::get<uint16_t>(frame_, pos) != 0) throw std::invalid_argument("batch frame: unknown flags");
+        for (auto& word : parms_id_) word = batch_frame_detail::get<uint64_t>(frame_, pos);
+        context_data_ = context_.get_context_data(parms_id_);
+        if (!context_data_) throw std::invalid_argument("batch frame: parms_id is not valid for the context");
+
+        uint32_t count = batch_frame_detail::get<uint32_t>(frame_, pos);
+        const size_t entry_size = sizeof(uint8_t) + 2 * sizeof(uint64_t);
+        if (count > (frame_.size() - pos) / entry_size) throw std::invalid_argument("batch frame: truncated offset table");
+        entries_.resize(count);
+        for (auto& entry : entries_) {
+            entry.kind = static_cast<BatchObjectKind>(batch_frame_detail::get<uint8_t>(frame_, pos));
+            entry.offset = batch_frame_detail::get<uint64_t>(frame_, pos);
+            entry.size = batch_frame_detail::get<uint64_t>(frame_, pos);
+        }
+        size_t body_size = frame_.size() - pos;
+        for (auto& entry : entries_) {
+            if (entry.kind != BatchObjectKind::ciphertext && entry.kind != BatchObjectKind::plaintext &&
+                entry.kind != BatchObjectKind::ciphertext_bit_dropped) {
+                throw std::invalid_argument("batch frame: unknown object kind");
+            }
+            if (entry.offset > body_size || entry.size > body_size - entry.offset) {
+                throw std::invalid_argument("batch frame: object outside the frame");
+            }
+            entry.offset += pos;
+        }
+    }
+
+    size_t size() const { return entries_.size(); }
+    BatchObjectKind kind(size_t index) const { return entries_.at(index).kind; }
+    const seal::parms_id_type& parms_id() const { return parms_id_; }
+
+    // Loads a ciphertext stored either way; bit-dropped ones come back with the
+    // dropped bits as zeros. Objects are allocated from destination's memory
+    // pool, so inputs loaded into a session's objects land in its pool.
+    void load(size_t index, seal::Ciphertext& destination) const {
+        if (entries_.at(index).kind == BatchObjectKind::ciphertext_bit_dropped) {
+            load_bit_dropped(entries_[index], destination);
+            return;
+        }
+        const Entry& entry = checked(index, BatchObjectKind::ciphertext);
+        const auto& coeff_modulus = context_data_->parms().coeff_modulus();
+        size_t n = context_data_->parms().poly_modulus_degree();
+        size_t pos = entry.offset;
+        uint32_t size = batch_frame_detail::get<uint32_t>(frame_, pos);
+        if (size < SEAL_CIPHERTEXT_SIZE_MIN || size > SEAL_CIPHERTEXT_SIZE_MAX) {
+            throw std::invalid_argument("batch frame: invalid ciphertext size");
+        }
+        size_t expected = sizeof(uint32_t);
+        for (const auto& modulus : coeff_modulus) expected += size * batch_frame_detail::packed_size(n, modulus.bit_count());
+        if (entry.size != expected) throw std::invalid_argument("batch frame: ciphertext body has the wrong length");
+
+        seal::Ciphertext loaded(destination.pool());
+        loaded.resize(context_, parms_id_, size);
+        loaded.is_ntt_form() = false;
+        loaded.scale() = 1.0;
+        loaded.correction_factor() = 1;
+        for (size_t k = 0; k < size; k++) {
+            for (size_t i = 0; i < coeff_modulus.size(); i++) {
+                int bits = coeff_modulus[i].bit_count();
+                batch_frame_detail::unpack_bits(frame_.data() + pos, n, bits, loaded.data(k) + i * n);
+                pos += batch_frame_detail::packed_size(n, bits);
+            }
+        }
+        if (!seal::is_valid_for(loaded, context_)) throw std::invalid_argument("batch frame: ciphertext is not valid for the context");
+        destination = std::move(loaded);
+    }
+
+    void load(size_t index, seal::Plaintext& destination) const {
+        const Entry& entry = checked(index, BatchObjectKind::plaintext);
+        size_t pos = entry.offset;
+        uint64_t coeff_count = batch_frame_detail::get<uint64_t>(frame_, pos);
+        if (coeff_count > context_data_->parms().poly_modulus_degree()) {
+            throw std::invalid_argument("batch frame: plaintext has too many coefficients");
+        }
+        int bits = context_data_->parms().plain_modulus().bit_count();
+        if (entry.size != sizeof(uint64_t) + batch_frame_detail::packed_size(coeff_count, bits)) {
+            throw std::invalid_argument("batch frame: plaintext body has the wrong length");
+        }
+
+        seal::Plaintext loaded(coeff_count, destination.pool());
+        batch_frame_detail::unpack_bits(frame_.data() + pos, coeff_count, bits, loaded.data());
+        if (!seal::is_valid_for(loaded, context_)) throw std::invalid_argument("batch frame: plaintext is not valid for the context");
+        destination = std::move(loaded);
+    }
+
+private:
+    struct Entry {
+        BatchObjectKind kind;
+        size_t offset;
+        size_t size;
+    };
+
+    void load_bit_dropped(const Entry& entry, seal::Ciphertext& destination) const {
+        const seal::util::RNSBase* base_q = context_data_->rns_tool()->base_q();
+        const int q_bits = context_data_->total_coeff_modulus_bit_count();
+        const size_t words = base_q->size();
+        const size_t n = context_data_->parms().poly_modulus_degree();
+        size_t pos = entry.offset;
+        if (batch_frame_detail::get<uint32_t>(frame_, pos) != 2) throw std::invalid_argument("batch frame: invalid ciphertext size");
+        int drops[2];
+        drops[0] = batch_frame_detail::get<uint16_t>(frame_, pos);
+        drops[1] = batch_frame_detail::get<uint16_t>(frame_, pos);
+        if (drops[0] >= q_bits || drops[1] >= q_bits) throw std::invalid_argument("batch frame: invalid drop bit count");
+        size_t expected = sizeof(uint32_t) + 2 * sizeof(uint16_t) + batch_frame_detail::packed_size(n, q_bits - drops[0]) +
+                          batch_frame_detail::packed_size(n, q_bits - drops[1]);
+        if (entry.size != expected) throw std::invalid_argument("batch frame: ciphertext body has the wrong length");
+
+        seal::Ciphertext loaded(destination.pool());
+        loaded.resize(context_, parms_id_, 2);
+        loaded.is_ntt_form() = false;
+        loaded.scale() = 1.0;
+        loaded.correction_factor() = 1;
+        std::vector<uint64_t> composed(words * n);
+        const uint64_t* q = base_q->base_prod();
+        for (size_t k = 0; k < 2; k++) {
+            int kept = q_bits - drops[k];
+            batch_frame_detail::BitReader reader(frame_.data() + pos);
+            for (size_t c = 0; c < n; c++) {
+                uint64_t* value = composed.data() + c * words;
+                reader.read_words(value, words, kept);
+                batch_frame_detail::shift_left_words(value, words, drops[k]);
+                // Rounding up can land in [q, 2^bits(q)) < 2q
+                batch_frame_detail::reduce_once_words(value, q, words);
+            }
+            pos += batch_frame_detail::packed_size(n, kept);
+            base_q->decompose_array(composed.data(), n, seal::MemoryManager::GetPool());
+            std::copy(composed.begin(), composed.end(), loaded.data(k));
+        }
+        destination = std::move(loaded);
+    }
+
+    const Entry& checked(size_t index, BatchObjectKind kind) const {
+        const Entry& entry = entries_.at(index);
+        if (entry.kind != kind) throw std::invalid_argument("batch frame: object has a different kind");
+        return entry;
+    }
+
+    const seal::SEALContext& context_;
+    std::string frame_;
+    seal::parms_id_type parms_id_;
+    std::shared_ptr<const seal::SEALContext::ContextData> context_data_;
+    std::vector<Entry> entries_;
+};
@@ -0,0 +1,864 @@
+#include "seal/seal.h"
+#include "kernels.h"
+#include "fixed_point.h"
+#include "eval_plan.h"
+#include "hoisted_rotation.h"
+#include "galois_keygen.h"
+#include "batch_frame.h"
+#include "response_pack.h"
+#include "budget_plan.h"
+#include "key_registry.h"
+#include "coalescer.h"
+#include "cost_model.h"
+#include "deterministic_rng.h"
+#include <iostream>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <chrono>
+#include <functional>
+#include <cstdlib>
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+using namespace std;
+using namespace seal;
+
+// --- Benchmark Helpers ---
+// Runs fn `iterations` times and returns the mean wall time in microseconds.
+double time_us(size_t iterations, const function<void()>& fn) {
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        fn();
+    }
+    auto end = chrono::steady_clock::now();
+    return chrono::duration<double, micro>(end - start).count() / static_cast<double>(iterations);
+}
+
+struct BenchmarkOptions {
+    size_t poly_modulus_degree = 8192;
+    size_t iterations = 20;
+    size_t workload_requests = 0; // > 0 runs the end-to-end budget workload instead
+    size_t verify_cases = 0;      // > 0 runs the differential correctness check instead
+    uint64_t seed = 0;            // for --verify; 0 picks one
+    uint64_t deterministic_seed = 0; // > 0 seeds keygen and encryption (FHE_DETERMINISTIC_RNG builds)
+    string golden_path;           // with a seed: write, or compare against, a golden request/response
+    bool csv = false;
+};
+
+void print_usage() {
+    cout << "Usage: ./benchmark [--degree N] [--iterations K] [--workload R] [--verify C [--seed S]] [--csv]" << endl;
+    cout << "  --degree N      Poly modulus degree (4096, 8192, 16384, 32768). Default 8192." << endl;
+    cout << "  --iterations K  Repetitions per operation. Default 20." << endl;
+    cout << "  --workload R    Run R end-to-end budget requests (the PGO training workload)." << endl;
+    cout << "  --verify C      Check C random budgets (plus edge cases) against the plaintext formulas." << endl;
+    cout << "  --seed S        Seed for --verify, to reproduce a failing run." << endl;
+    cout << "  --deterministic S  Seed keygen and encryption (builds with FHE_DETERMINISTIC_RNG only)." << endl;
+    cout << "  --golden FILE   With --deterministic: write FILE, or compare against it if it exists." << endl;
+    cout << "  --csv           Print results as CSV (used by scripts/compare_kernels.sh)." << endl;
+}
+
+bool parse_options(int argc, char* argv[], BenchmarkOptions& options) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--degree" && i + 1 < argc) {
+            options.poly_modulus_degree = stoul(argv[++i]);
+        } else if (arg == "--iterations" && i + 1 < argc) {
+            options.iterations = stoul(argv[++i]);
+        } else if (arg == "--workload" && i + 1 < argc) {
+            options.workload_requests = stoul(argv[++i]);
+        } else if (arg == "--verify" && i + 1 < argc) {
+            options.verify_cases = stoul(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            options.seed = stoull(argv[++i]);
+        } else if (arg == "--deterministic" && i + 1 < argc) {
+            options.deterministic_seed = stoull(argv[++i]);
+        } else if (arg == "--golden" && i + 1 < argc) {
+            options.golden_path = argv[++i];
+        } else if (arg == "--csv") {
+            options.csv = true;
+        } else {
+            print_usage();
+            return false;
+        }
+    }
+#if !defined(FHE_DETERMINISTIC_RNG)
+    if (options.deterministic_seed != 0) {
+        cerr << "Error: --deterministic needs a build configured with -DFHE_DETERMINISTIC_RNG=ON." << endl;
+        return false;
+    }
+#endif
+    if (!options.golden_path.empty() && options.deterministic_seed == 0) {
+        cerr << "Error: --golden needs --deterministic SEED." << endl;
+        return false;
+    }
+    return options.iterations > 0;
+}
+
+// Sum of monthly balance x rate products, rotated once to line the total up with
+// the next month. Written the way an eager author would: relinearize after
+// every multiply.
+EvalPlan make_interest_projection_plan(size_t months) {
+    EvalPlan plan;
+    int total = -1;
+    for (size_t m = 0; m < months; m++) {
+        int balance = plan.input("balance_" + to_string(m));
+        int rate = plan.input("rate_" + to_string(m));
+        int interest = plan.relinearize(plan.multiply(balance, rate));
+        total = total < 0 ? interest : plan.add(total, interest);
+    }
+    plan.output(plan.rotate_rows(total, 1), "projected_interest");
+    return plan;
+}
+
+// --- End-to-End Budget Workload ---
+// Replays the client/server request in-process: the client encrypts income,
+// essential and non-essential totals and encodes the savings goal, the server
+// loads them, computes total expenses, net income and goal difference, and the
+// client decrypts the three results from one packed, mod-switched, bit-dropped
+// response.
+// Both directions use batch frames, as the applications do. Amounts vary per
+// request so the profile sees a realistic mix rather than one constant input.
+// Returns false if any request decrypted to a wrong result, or bit dropping
+// ate into the noise budget margin.
+bool run_budget_workload(const SEALContext& context, const PublicKey& public_key, const SecretKey& secret_key,
+                         size_t requests) {
+    Encryptor encryptor(context, public_key);
+    Decryptor decryptor(context, secret_key);
+    Evaluator evaluator(context);
+    BatchEncoder batch_encoder(context);
+    size_t slot_count = batch_encoder.slot_count();
+    const double SCALE_FACTOR = 100.0;
+
+    auto encrypt_amount = [&](double amount) {
+        Plaintext plain;
+        batch_encoder.encode(vector<int64_t>(slot_count, static_cast<int64_t>(round(amount * SCALE_FACTOR))), plain);
+        Ciphertext encrypted;
+        encryptor.encrypt(plain, encrypted);
+        return encrypted;
+    };
+
+    ResponsePacker packer(context, batch_encoder, 3);
+    const int BIT_DROP_MARGIN = 4; // server_app's default
+    size_t mismatches = 0;
+    bool margin_kept = true;
+    size_t response_bytes = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t r = 0; r < requests; r++) {
+        double income = 1500.75 + 37.0 * static_cast<double>(r % 50);
+        double essential = 800.25 + 11.5 * static_cast<double>(r % 13);
+        double non_essential = 120.10 + 3.25 * static_cast<double>(r % 29);
+        double goal = 250.0 + 5.0 * static_cast<double>(r % 7);
+
+        // Client -> server, as one batch frame
+        Plaintext goal_plain;
+        batch_encoder.encode(vector<int64_t>(slot_count, static_cast<int64_t>(round(goal * SCALE_FACTOR))), goal_plain);
+        BatchFrameWriter request(context, context.first_parms_id());
+        request.add(encrypt_amount(income));
+        request.add(goal_plain);
+        request.add(encrypt_amount(essential));
+        request.add(encrypt_amount(non_essential));
+        string request_str = request.finish();
+
+        // Server
+        Ciphertext enc_income, enc_essential, enc_non_essential;
+        Plaintext goal_loaded;
+        BatchFrameReader request_frame(context, move(request_str));
+        request_frame.load(0, enc_income);
+        request_frame.load(1, goal_loaded);
+        request_frame.load(2, enc_essential);
+        request_frame.load(3, enc_non_essential);
+
+        Ciphertext enc_total_expenses, enc_net_income, enc_goal_difference;
+        evaluator.add(enc_essential, enc_non_essential, enc_total_expenses);
+        evaluator.sub(enc_income, enc_total_expenses, enc_net_income);
+        evaluator.sub_plain(enc_net_income, goal_loaded, enc_goal_difference);
+
+        Ciphertext enc_response;
+        int response_budget = packer.pack(evaluator, { &enc_total_expenses, &enc_net_income, &enc_goal_difference },
+                                          fresh_noise_budget_estimate(context) - 3, enc_response);
+        response_budget = mod_switch_within_budget(context, evaluator, enc_response, response_budget, 20);
+        BitDrop drop = bit_drop_for_budget(*context.get_context_data(enc_response.parms_id()), response_budget, BIT_DROP_MARGIN);
+        BatchFrameWriter response(context, enc_response.parms_id());
+        response.add_bit_dropped(enc_response, drop.c0, drop.c1);
+        string response_str = response.finish();
+        response_bytes += response_str.size();
+
+        // Server -> client
+        BatchFrameReader response_frame(context, move(response_str));
+        Ciphertext result;
+        response_frame.load(0, result);
+        Plaintext plain;
+        if (r == 0) {
+            // The server-side budget model must never promise more than is there,
+            // and bit dropping must leave at least its margin
+            int measured = decryptor.invariant_noise_budget(result);
+            cout << "Packed response: estimated noise budget " << response_budget << " bits before dropping "
+                 << drop.c0 << "/" << drop.c1 << " low bits, measured " << measured << " bits after" << endl;
+            if (measured < BIT_DROP_MARGIN) {
+                cerr << "Error: bit dropping left less than the noise budget margin." << endl;
+                margin_kept = false;
+            }
+        }
+        decryptor.decrypt(result, plain);
+        vector<int64_t> decoded;
+        batch_encoder.decode(plain, decoded);
+        int64_t income_scaled = static_cast<int64_t>(round(income * SCALE_FACTOR));
+        int64_t expenses_scaled = static_cast<int64_t>(round(essential * SCALE_FACTOR)) + static_cast<int64_t>(round(non_essential * SCALE_FACTOR));
+        int64_t expected[] = { expenses_scaled, income_scaled - expenses_scaled,
+                               income_scaled - expenses_scaled - static_cast<int64_t>(round(goal * SCALE_FACTOR)) };
+        for (size_t i = 0; i < 3; i++) {
+            if (decoded[packer.layout().offset(i)] != expected[i]) {
+                mismatches++;
+                break;
+            }
+        }
+    }
+    auto end = chrono::steady_clock::now();
+    double total_ms = chrono::duration<double, milli>(end - start).count();
+
+    cout << "Budget workload: " << requests << " requests in " << total_ms << " ms ("
+         << total_ms / static_cast<double>(requests) << " ms/request), " << response_bytes / requests
+         << " response bytes/request" << endl;
+    if (mismatches > 0) {
+        cerr << "Error: " << mismatches << " requests decrypted to wrong results." << endl;
+    }
+    return mismatches == 0 && margin_kept;
+}
+
+// --- Differential Correctness Check ---
+// Every optimization on the evaluation path (coalescing, range masking, packing,
+// mod switching, bit dropping, the relinearization pass) must leave the
+// decrypted budget exactly equal to the plaintext formulas the client uses
+// locally. Random budgets, plus inputs at the edge of the plain modulus, are
+// evaluated in each mode through evaluate_requests (the server's path) and
+// compared slot by slot with the unreduced formulas. Budgets whose results
+// would wrap around t are the ones budget_within_limit rejects, so the client
+// never sends them; they are counted and left out.
+struct BudgetCase {
+    int64_t income = 0;
+    int64_t goal = 0;
+    int64_t essential = 0;
+    int64_t non_essential = 0;
+};
+
+// The server's outputs in response order, computed in plain integers.
+vector<int64_t> budget_formulas(const BudgetCase& c) {
+    int64_t total_expenses = c.essential + c.non_essential;
+    int64_t net_income = c.income - total_expenses;
+    return { total_expenses, net_income, net_income - c.goal, c.essential, c.non_essential };
+}
+
+vector<BudgetCase> make_budget_cases(size_t count, int64_t limit, mt19937_64& rng) {
+    // Inputs at and around the limit, so sums and differences reach it or
+    // go past it
+    const int64_t L = limit;
+    vector<BudgetCase> cases = {
+        { 0, 0, 0, 0 },          { L, 0, 0, 0 },           { -L, 0, 0, 0 },          { 0, 0, L, L },
+        { 0, 0, -L, -L },        { -L, 0, L, 0 },          { L, -L, 0, 0 },          { L, L, -L, -L },
+        { 0, 0, L - 1, 1 },      { 0, 0, L, 1 },           { -L, 1, 0, 0 },          { L - 1, -1, 0, 0 },
+        { L, L, L, L },          { -L, -L, -L, -L },       { 1, -1, L, -L },         { L / 2, -L / 2, -L / 2, -L / 2 },
+        { 0, L, 0, 0 },          { 0, -L, 0, 0 },          { L, L, 0, 0 },           { -L, -L, 0, 0 },
+    };
+    // Typical budgets in cents (no result can wrap), then amounts anywhere in range
+    uniform_int_distribution<int64_t> cents(0, L / 4);
+    uniform_int_distribution<int64_t> anywhere(-L, L);
+    for (size_t i = 0; i < count; i++) {
+        auto& draw = i % 4 == 3 ? anywhere : cents;
+        cases.push_back({ draw(rng), draw(rng), draw(rng), draw(rng) });
+    }
+    return cases;
+}
+
+size_t run_differential_check(const SEALContext& context, const SecretKey& secret_key, size_t random_cases, uint64_t seed) {
+    KeyGroup group(context, "verify");
+    KeyGenerator keygen(context, secret_key);
+    keygen.create_public_key(group.public_key);
+    keygen.create_relin_keys(group.relin_keys);
+    vector<string> outputs = { "total_expenses", "net_income", "goal_difference", "essential_expenses", "non_essential_expenses" };
+    const ResponseLayout& layout = group.packer(outputs.size()).layout();
+    vector<int> steps;
+    for (size_t i = 1; i < layout.count; i++) steps.push_back(-static_cast<int>(layout.offset(i)));
+    keygen.create_galois_keys(steps, group.galois_keys);
+    Encryptor encryptor(context, group.public_key);
+    Decryptor decryptor(context, secret_key);
+    const size_t slot_count = group.batch_encoder.slot_count();
+
+    mt19937_64 rng(seed);
+    const int64_t limit = fixed_point_limit(context.first_context_data()->parms().plain_modulus());
+    vector<BudgetCase> cases;
+    size_t rejected = 0;
+    for (const BudgetCase& c : make_budget_cases(random_cases, limit, rng)) {
+        if (budget_within_limit(c.income, c.goal, c.essential, c.non_essential, limit)) {
+            cases.push_back(c);
+        } else {
+            rejected++;
+        }
+    }
+
+    // A request for case c: its amounts in every slot (replicated) or in slot
+    // offset only
+    auto make_request = [&](const BudgetCase& c, bool replicated, size_t offset, uint64_t session_id) {
+        PlanRequest request;
+        request.session_id = session_id;
+        request.layout.slot_offset = static_cast<uint32_t>(replicated ? 0 : offset);
+        request.layout.slot_width = static_cast<uint32_t>(replicated ? slot_count : 1);
+        const pair<const char*, int64_t> amounts[] = {
+            { "total_income", c.income }, { "monthly_savings_goal", c.goal },
+            { "essential_expenses", c.essential }, { "non_essential_expenses", c.non_essential }
+        };
+        for (const auto& amount : amounts) {
+            vector<int64_t> slots(slot_count, replicated ? amount.second : 0);
+            slots[offset] = amount.second;
+            Plaintext encoded;
+            group.batch_encoder.encode(slots, encoded);
+            if (string(amount.first) == "monthly_savings_goal") {
+                request.plaintexts[amount.first] = encoded;
+            } else {
+                encryptor.encrypt(encoded, request.ciphertexts[amount.first]);
+            }
+        }
+        return request;
+    };
+
+    struct Mode {
+        string name;
+        bool replicated;
+        bool mixed_sessions;
+        bool lazy;
+        bool bit_drop;
+    };
+    vector<Mode> modes;
+    for (int shape = 0; shape < 3; shape++) {
+        for (int lazy = 0; lazy < 2; lazy++) {
+            for (int bit_drop = 0; bit_drop < 2; bit_drop++) {
+                string name = shape == 0 ? "replicated" : shape == 1 ? "coalesced" : "coalesced_mixed";
+                name += lazy ? "/lazy_relin" : "/eager";
+                name += bit_drop ? "/bit_drop" : "/whole";
+                modes.push_back({ name, shape == 0, shape == 2, lazy == 1, bit_drop == 1 });
+            }
+        }
+    }
+
+    const EvalPlan eager_plan = make_budget_plan();
+    const EvalPlan lazy_plan = lazy_relinearize(eager_plan);
+    size_t total_mismatches = 0;
+    cout << "Differential check: " << cases.size() << " budgets (seed " << seed << "), " << rejected
+         << " more left out because their results would wrap around the plain modulus" << endl;
+    for (const Mode& mode : modes) {
+        EvaluationOptions options;
+        options.bit_drop = mode.bit_drop;
+        const EvalPlan& plan = mode.lazy ? lazy_plan : eager_plan;
+        size_t batch_size = mode.replicated ? 1 : layout.width;
+        size_t mismatches = 0;
+        for (size_t first = 0; first < cases.size(); first += batch_size) {
+            size_t count = min(batch_size, cases.size() - first);
+            vector<PlanRequest> requests;
+            for (size_t r = 0; r < count; r++) {
+                requests.push_back(make_request(cases[first + r], mode.replicated, r, mode.mixed_sessions ? r : 0));
+            }
+            vector<const PlanRequest*> batch;
+            for (const PlanRequest& request : requests) batch.push_back(&request);
+            PlanResponse response = evaluate_requests(group, plan, outputs, batch, options);
+
+            BatchFrameReader reader(context, *response.frame);
+            Ciphertext encrypted;
+            reader.load(0, encrypted);
+            Plaintext plain;
+            decryptor.decrypt(encrypted, plain);
+            vector<int64_t> slots;
+            group.batch_encoder.decode(plain, slots);
+            for (size_t r = 0; r < count; r++) {
+                vector<int64_t> expected = budget_formulas(cases[first + r]);
+                for (size_t i = 0; i < expected.size(); i++) {
+                    // A replicated result fills its whole range; check both ends
+                    size_t slot = i * response.header.result_stride + r;
+                    bool equal = slots[slot] == expected[i];
+                    if (mode.replicated) equal &= slots[slot + response.header.result_stride - 1] == slots[slot];
+                    if (!equal) {
+                        if (mismatches == 0) {
+                            const BudgetCase& c = cases[first + r];
+                            cerr << "Error: " << mode.name << ": " << outputs[i] << " is " << slots[slot] << ", expected "
+                                 << expected[i] << " (income " << c.income << ", goal " << c.goal
+                                 << ", essential " << c.essential << ", non-essential " << c.non_essential << ")" << endl;
+                        }
+                        mismatches++;
+                        break;
+                    }
+                }
+            }
+        }
+        cout << "  " << mode.name << string(38 - min<size_t>(38, mode.name.size()), ' ')
+             << (mismatches == 0 ? "ok" : to_string(mismatches) + " mismatched budgets") << endl;
+        total_mismatches += mismatches;
+    }
+    return total_mismatches;
+}
+
+// --- Golden Request/Response ---
+// With seeded randomness the budget request a client sends for fixed amounts,
+// and the server's response to it, are the same bytes on every run. The first
+// run writes them to path (u64 length and bytes of each batch frame); later
+// runs compare against it. Against a file kept from a known-good build with
+// the same SEAL version, any change to the wire format or the evaluation path
+// that alters the bytes shows up; the ctest fixture writes a fresh file each
+// time, so it only checks that two runs agree. Returns false on a mismatch.
+bool check_golden(const SEALContext& context, const PublicKey& public_key, KeyGenerator& keygen, const string& path) {
+    KeyGroup group(context, "golden");
+    group.public_key = public_key;
+    keygen.create_relin_keys(group.relin_keys);
+    Encryptor encryptor(context, public_key);
+    size_t slot_count = group.batch_encoder.slot_count();
+
+    // $2,500.00 income, $500.00 goal, $1,200.00 and $300.00 expenses in cents
+    const int64_t amounts[] = { 250000, 50000, 120000, 30000 };
+    BatchFrameWriter request(context, context.first_parms_id());
+    for (size_t i = 0; i < 4; i++) {
+        Plaintext encoded;
+        group.batch_encoder.encode(vector<int64_t>(slot_count, amounts[i]), encoded);
+        if (i == 1) {
+            request.add(encoded);
+        } else {
+            Ciphertext encrypted;
+            encryptor.encrypt(encoded, encrypted);
+            request.add(encrypted);
+        }
+    }
+    string request_frame = request.finish();
+
+    PlanRequest loaded;
+    loaded.layout.slot_width = static_cast<uint32_t>(slot_count);
+    BatchFrameReader reader(context, request_frame);
+    reader.load(0, loaded.ciphertexts["total_income"]);
+    reader.load(1, loaded.plaintexts["monthly_savings_goal"]);
+    reader.load(2, loaded.ciphertexts["essential_expenses"]);
+    reader.load(3, loaded.ciphertexts["non_essential_expenses"]);
+    vector<string> outputs = { "total_expenses", "net_income", "goal_difference", "essential_expenses", "non_essential_expenses" };
+    PlanResponse response = evaluate_requests(group, lazy_relinearize(make_budget_plan()), outputs, { &loaded }, EvaluationOptions());
+
+    stringstream bundle;
+    for (const string* frame : { static_cast<const string*>(&request_frame), response.frame.get() }) {
+        uint64_t size = frame->size();
+        bundle.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        bundle.write(frame->data(), static_cast<streamsize>(frame->size()));
+    }
+    ifstream existing(path, ios::binary);
+    if (!existing) {
+        ofstream out(path, ios::binary | ios::trunc);
+        out << bundle.str();
+        cout << "Golden request/response written to " << path << " (" << bundle.str().size() << " bytes)" << endl;
+        return static_cast<bool>(out);
+    }
+    stringstream stored;
+    stored << existing.rdbuf();
+    if (stored.str() != bundle.str()) {
+        cerr << "Error: request/response differ from the golden file " << path << " (" << bundle.str().size()
+             << " bytes now, " << stored.str().size() << " stored)." << endl;
+        return false;
+    }
+    cout << "Request/response match the golden file " << path << endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    BenchmarkOptions options;
+    if (!parse_options(argc, argv, options)) return 1;
+
+    // --- FHE Setup (same parameters as client.cpp) ---
+    EncryptionParameters parms(scheme_type::bfv);
+    size_t poly_modulus_degree = options.poly_modulus_degree;
+    parms.set_poly_modulus_degree(poly_modulus_degree);
+    parms.set_coeff_modulus(CoeffModulus::BFVDefault(poly_modulus_degree));
+    parms.set_plain_modulus(PlainModulus::Batching(poly_modulus_degree, 30));
+#if defined(FHE_DETERMINISTIC_RNG)
+    if (options.deterministic_seed != 0) use_deterministic_rng(parms, options.deterministic_seed);
+#endif
+    SEALContext context(parms);
+    if (!context.parameters_set()) {
+        cerr << "Error: invalid parameters: " << context.parameter_error_message() << endl;
+        return 1;
+    }
+
+    KernelReport kernels = detect_kernels(max_coeff_modulus_bits(parms));
+    string kernel_label = kernels.seal_built_with_hexl ? "hexl" : "portable";
+    if (!options.csv) {
+        print_kernel_report(cout, kernels);
+        cout << "Poly Modulus Degree: " << poly_modulus_degree << ", iterations: " << options.iterations << endl;
+        if (options.deterministic_seed != 0) {
+            cout << "Deterministic randomness, seed " << options.deterministic_seed << " (keys are not secret)" << endl;
+        }
+        cout << endl;
+    }
+
+    KeyGenerator keygen(context);
+    SecretKey secret_key = keygen.secret_key();
+    PublicKey public_key;
+    keygen.create_public_key(public_key);
+
+    if (options.workload_requests > 0) {
+        return run_budget_workload(context, public_key, secret_key, options.workload_requests) ? 0 : 1;
+    }
+    if (!options.golden_path.empty()) {
+        return check_golden(context, public_key, keygen, options.golden_path) ? 0 : 1;
+    }
+    if (options.verify_cases > 0) {
+        uint64_t seed = options.seed != 0 ? options.seed : random_device()();
+        return run_differential_check(context, secret_key, options.verify_cases, seed) == 0 ? 0 : 1;
+    }
+
+    RelinKeys relin_keys;
+    keygen.create_relin_keys(relin_keys);
+    GaloisKeys galois_keys;
+    keygen.create_galois_keys(galois_keys);
+
+    Encryptor encryptor(context, public_key);
+    Decryptor decryptor(context, secret_key);
+    Evaluator evaluator(context);
+    BatchEncoder batch_encoder(context);
+    size_t slot_count = batch_encoder.slot_count();
+
+    vector<int64_t> values(slot_count, 150075);
+    Plaintext plain;
+    batch_encoder.encode(values, plain);
+    Ciphertext a, b;
+    encryptor.encrypt(plain, a);
+    encryptor.encrypt(plain, b);
+
+    // --- Operation Benchmarks ---
+    vector<pair<string, double>> results;
+    size_t iterations = options.iterations;
+
+    results.emplace_back("keygen_galois", time_us(1, [&]() {
+        GaloisKeys keys;
+        keygen.create_galois_keys(keys);
+    }));
+    results.emplace_back("keygen_galois_parallel", time_us(1, [&]() {
+        GaloisKeys keys;
+        create_galois_keys_parallel(context, secret_key, keys);
+    }));
+    vector<double> amounts(slot_count);
+    for (size_t i = 0; i < slot_count; i++) {
+        amounts[i] = 12.34 + static_cast<double>(i) * 0.01;
+    }
+    vector<int64_t> scaled_amounts;
+    int64_t amount_limit = fixed_point_limit(parms.plain_modulus());
+    results.emplace_back("to_fixed_point", time_us(iterations, [&]() {
+        to_fixed_point_slots(amounts, slot_count, 100.0, amount_limit, scaled_amounts);
+    }));
+    results.emplace_back("from_fixed_point", time_us(iterations, [&]() {
+        from_fixed_point_slots(scaled_amounts, 100.0);
+    }));
+    results.emplace_back("encode", time_us(iterations, [&]() {
+        Plaintext p;
+        batch_encoder.encode(values, p);
+    }));
+    results.emplace_back("encrypt", time_us(iterations, [&]() {
+        Ciphertext c;
+        encryptor.encrypt(plain, c);
+    }));
+    results.emplace_back("decrypt", time_us(iterations, [&]() {
+        Plaintext p;
+        decryptor.decrypt(a, p);
+    }));
+    results.emplace_back("add", time_us(iterations, [&]() {
+        Ciphertext c;
+        evaluator.add(a, b, c);
+    }));
+    results.emplace_back("sub", time_us(iterations, [&]() {
+        Ciphertext c;
+        evaluator.sub(a, b, c);
+    }));
+    results.emplace_back("add_plain", time_us(iterations, [&]() {
+        Ciphertext c;
+        evaluator.add_plain(a, plain, c);
+    }));
+    results.emplace_back("sub_plain", time_us(iterations, [&]() {
+        Ciphertext c;
+        evaluator.sub_plain(a, plain, c);
+    }));
+    results.emplace_back("multiply_plain", time_us(iterations, [&]() {
+        Ciphertext c;
+        evaluator.multiply_plain(a, plain, c);
+    }));
+    results.emplace_back("multiply", time_us(iterations, [&]() {
+        Ciphertext c;
+        evaluator.multiply(a, b, c);
+    }));
+    Ciphertext product;
+    evaluator.multiply(a, b, product);
+    results.emplace_back("relinearize", time_us(iterations, [&]() {
+        Ciphertext c;
+        evaluator.relinearize(product, relin_keys, c);
+    }));
+    results.emplace_back("rotate_rows", time_us(iterations, [&]() {
+        Ciphertext c;
+        evaluator.rotate_rows(a, 1, galois_keys, c);
+    }));
+
+    // Rotating one ciphertext by every power-of-two step (the keys the client
+    // generates): repeated rotate_rows vs one hoisted decomposition
+    vector<int> rotation_steps;
+    for (int step = 1; step < static_cast<int>(slot_count / 2); step *= 2) {
+        rotation_steps.push_back(step);
+    }
+    results.emplace_back("rotate_repeated", time_us(iterations, [&]() {
+        Ciphertext c;
+        for (int step : rotation_steps) {
+            evaluator.rotate_rows(a, step, galois_keys, c);
+        }
+    }));
+    results.emplace_back("rotate_hoisted", time_us(iterations, [&]() {
+        HoistedRotator rotator(context, a);
+        Ciphertext c;
+        for (int step : rotation_steps) {
+            rotator.rotate_rows(step, galois_keys, c);
+        }
+    }));
+    {
+        // Both paths must decrypt to the same rotated slots
+        vector<int64_t> ramp(slot_count);
+        for (size_t i = 0; i < slot_count; i++) {
+            ramp[i] = static_cast<int64_t>(i);
+        }
+        Plaintext ramp_plain;
+        batch_encoder.encode(ramp, ramp_plain);
+        Ciphertext ramp_encrypted;
+        encryptor.encrypt(ramp_plain, ramp_encrypted);
+        HoistedRotator rotator(context, ramp_encrypted);
+        size_t mismatched_steps = 0;
+        for (int step : rotation_steps) {
+            Ciphertext expected, hoisted;
+            evaluator.rotate_rows(ramp_encrypted, step, galois_keys, expected);
+            rotator.rotate_rows(step, galois_keys, hoisted);
+            Plaintext expected_plain, hoisted_plain;
+            decryptor.decrypt(expected, expected_plain);
+            decryptor.decrypt(hoisted, hoisted_plain);
+            vector<int64_t> expected_slots, hoisted_slots;
+            batch_encoder.decode(expected_plain, expected_slots);
+            batch_encoder.decode(hoisted_plain, hoisted_slots);
+            if (expected_slots != hoisted_slots) mismatched_steps++;
+        }
+        if (mismatched_steps > 0) {
+            cerr << "Error: hoisted rotation disagrees with rotate_rows for " << mismatched_steps << " steps." << endl;
+        } else if (!options.csv) {
+            cout << "Hoisted rotations (" << rotation_steps.size() << " steps) match rotate_rows." << endl;
+        }
+    }
+
+    results.emplace_back("mod_switch", time_us(iterations, [&]() {
+        Ciphertext c;
+        evaluator.mod_switch_to_next(a, c);
+    }));
+
+    // Eager vs lazily relinearized evaluation plan over 12 monthly products
+    const size_t months = 12;
+    EvalPlan eager_plan = make_interest_projection_plan(months);
+    EvalPlan lazy_plan = lazy_relinearize(eager_plan);
+    PlanInputs plan_inputs;
+    for (size_t m = 0; m < months; m++) {
+        plan_inputs.ciphertexts["balance_" + to_string(m)] = &a;
+        plan_inputs.ciphertexts["rate_" + to_string(m)] = &b;
+    }
+    PlanStats eager_stats, lazy_stats;
+    results.emplace_back("plan_eager_relin", time_us(iterations, [&]() {
+        execute_plan(eager_plan, evaluator, &relin_keys, &galois_keys, plan_inputs, &eager_stats);
+    }));
+    results.emplace_back("plan_lazy_relin", time_us(iterations, [&]() {
+        execute_plan(lazy_plan, evaluator, &relin_keys, &galois_keys, plan_inputs, &lazy_stats);
+    }));
+    if (!options.csv) {
+        cout << "Interest projection plan (" << months << " products): " << eager_stats.key_switches()
+             << " key switches eager, " << lazy_stats.key_switches() << " lazy" << endl;
+    }
+
+    results.emplace_back("save_ciphertext", time_us(iterations, [&]() {
+        stringstream ss;
+        a.save(ss);
+    }));
+    stringstream saved_ct;
+    a.save(saved_ct);
+    string saved_ct_str = saved_ct.str();
+    results.emplace_back("load_ciphertext", time_us(iterations, [&]() {
+        stringstream ss(saved_ct_str);
+        Ciphertext c;
+        c.load(context, ss);
+    }));
+
+    // One request's worth of objects: per-object SEAL frames vs one batch frame
+    Plaintext frame_plain;
+    batch_encoder.encode(vector<int64_t>(slot_count, 25000), frame_plain);
+    size_t seal_frame_bytes = 0;
+    results.emplace_back("save_request_seal", time_us(iterations, [&]() {
+        seal_frame_bytes = 0;
+        for (const Ciphertext* c : { &a, &b, &a }) {
+            stringstream ss;
+            c->save(ss);
+            seal_frame_bytes += ss.str().size();
+        }
+        stringstream ss;
+        frame_plain.save(ss);
+        seal_frame_bytes += ss.str().size();
+    }));
+    string batch_frame_str;
+    results.emplace_back("save_request_batch", time_us(iterations, [&]() {
+        BatchFrameWriter writer(context, a.parms_id());
+        writer.add(a);
+        writer.add(frame_plain);
+        writer.add(b);
+        writer.add(a);
+        batch_frame_str = writer.finish();
+    }));
+    results.emplace_back("load_request_batch", time_us(iterations, [&]() {
+        BatchFrameReader reader(context, batch_frame_str);
+        Ciphertext c;
+        Plaintext p;
+        reader.load(0, c);
+        reader.load(1, p);
+        reader.load(2, c);
+        reader.load(3, c);
+    }));
+    if (!options.csv) {
+        cout << "Request size: " << seal_frame_bytes << " bytes as SEAL frames, " << batch_frame_str.size()
+             << " bytes as one batch frame" << endl;
+    }
+
+    // Result serialization after mod switching: whole vs bit-dropped
+    Ciphertext result_ct = a;
+    mod_switch_within_budget(context, evaluator, result_ct, decryptor.invariant_noise_budget(a), 20);
+    int result_budget = decryptor.invariant_noise_budget(result_ct);
+    BitDrop result_drop = bit_drop_for_budget(*context.get_context_data(result_ct.parms_id()), result_budget, 4);
+    string whole_result, dropped_result;
+    results.emplace_back("save_result_whole", time_us(iterations, [&]() {
+        BatchFrameWriter writer(context, result_ct.parms_id());
+        writer.add(result_ct);
+        whole_result = writer.finish();
+    }));
+    results.emplace_back("save_result_bit_dropped", time_us(iterations, [&]() {
+        BatchFrameWriter writer(context, result_ct.parms_id());
+        writer.add_bit_dropped(result_ct, result_drop.c0, result_drop.c1);
+        dropped_result = writer.finish();
+    }));
+    Ciphertext restored;
+    results.emplace_back("load_result_bit_dropped", time_us(iterations, [&]() {
+        BatchFrameReader reader(context, dropped_result);
+        reader.load(0, restored);
+    }));
+    {
+        Plaintext expected_plain, restored_plain;
+        decryptor.decrypt(result_ct, expected_plain);
+        decryptor.decrypt(restored, restored_plain);
+        vector<int64_t> expected_slots, restored_slots;
+        batch_encoder.decode(expected_plain, expected_slots);
+        batch_encoder.decode(restored_plain, restored_slots);
+        if (expected_slots != restored_slots) {
+            cerr << "Error: bit-dropped result decrypts differently." << endl;
+        } else if (!options.csv) {
+            cout << "Result at " << context.get_context_data(result_ct.parms_id())->parms().coeff_modulus().size()
+                 << " primes: " << whole_result.size() << " bytes whole, " << dropped_result.size() << " bytes with "
+                 << result_drop.c0 << "/" << result_drop.c1 << " low bits dropped (noise budget " << result_budget
+                 << " -> " << decryptor.invariant_noise_budget(restored) << " bits)" << endl;
+        }
+    }
+
+    // Narrow budget requests under one key: one evaluation each vs coalesced
+    {
+        const size_t request_count = 16;
+        KeyGroup group(parms, "benchmark");
+        group.public_key = public_key;
+        group.relin_keys = relin_keys;
+        group.galois_keys = galois_keys;
+        EvalPlan budget_plan = lazy_relinearize(make_budget_plan());
+        vector<string> outputs = { "total_expenses", "net_income", "goal_difference" };
+        EvaluationOptions evaluation_options;
+        vector<PlanRequest> requests(request_count);
+        for (size_t r = 0; r < request_count; r++) {
+            requests[r].session_id = 1;
+            requests[r].layout = { 0, 0, static_cast<uint32_t>(r), 1 };
+            vector<int64_t> slots(slot_count, 0);
+            int64_t amounts[] = { 250000 + 1000 * static_cast<int64_t>(r), 50000, 120000, 30000 + 500 * static_cast<int64_t>(r) };
+            const char* names[] = { "total_income", "monthly_savings_goal", "essential_expenses", "non_essential_expenses" };
+            for (size_t j = 0; j < 4; j++) {
+                slots[r] = amounts[j];
+                Plaintext encoded;
+                batch_encoder.encode(slots, encoded);
+                if (j == 1) {
+                    requests[r].plaintexts[names[j]] = encoded;
+                } else {
+                    encryptor.encrypt(encoded, requests[r].ciphertexts[names[j]]);
+                }
+            }
+        }
+        results.emplace_back("budget_requests_separate", time_us(iterations, [&]() {
+            for (const PlanRequest& request : requests) {
+                evaluate_requests(group, budget_plan, outputs, { &request }, evaluation_options);
+            }
+        }));
+        vector<const PlanRequest*> batch;
+        for (const PlanRequest& request : requests) batch.push_back(&request);
+        PlanResponse coalesced;
+        results.emplace_back("budget_requests_coalesced", time_us(iterations, [&]() {
+            coalesced = evaluate_requests(group, budget_plan, outputs, batch, evaluation_options);
+        }));
+
+        // Every request must find its own results in the shared response
+        BatchFrameReader reader(context, *coalesced.frame);
+        Ciphertext response_ct;
+        reader.load(0, response_ct);
+        Plaintext response_plain;
+        decryptor.decrypt(response_ct, response_plain);
+        vector<int64_t> response_slots;
+        batch_encoder.decode(response_plain, response_slots);
+        size_t mismatched_requests = 0;
+        for (size_t r = 0; r < request_count; r++) {
+            int64_t income = 250000 + 1000 * static_cast<int64_t>(r);
+            int64_t expenses = 120000 + 30000 + 500 * static_cast<int64_t>(r);
+            int64_t expected[] = { expenses, income - expenses, income - expenses - 50000 };
+            for (size_t i = 0; i < 3; i++) {
+                if (response_slots[i * coalesced.header.result_stride + r] != expected[i]) {
+                    mismatched_requests++;
+                    break;
+                }
+            }
+        }
+        if (mismatched_requests > 0) {
+            cerr << "Error: " << mismatched_requests << " coalesced requests decrypted to wrong results." << endl;
+        } else if (!options.csv) {
+            cout << request_count << " coalesced budget requests decrypt correctly from one "
+                 << coalesced.frame->size() << "-byte response" << endl;
+        }
+    }
+
+    // The cost model, calibrated from this run, must predict the plan timings
+    // it did not see; the server loads the same rows with --cost-model
+    if (!options.csv) {
+        CostModel model;
+        size_t primes = context.first_context_data()->parms().coeff_modulus().size();
+        for (const auto& result : results) {
+            if (model.prices(result.first)) model.set(result.first, poly_modulus_degree, primes, result.second);
+        }
+        double measured = 0;
+        for (const auto& result : results) {
+            if (result.first == "plan_lazy_relin") measured = result.second;
+        }
+        CostEstimate estimate = estimate_plan_cost(lazy_plan, model, *context.first_context_data());
+        cout << "Cost model: interest projection plan estimated " << estimate.microseconds << " us ("
+             << estimate.peak_bytes / 1024 << " KiB peak), measured " << measured << " us" << endl;
+    }
+
+    // --- Report ---
+    if (options.csv) {
+        cout << "operation,degree,kernels,microseconds" << endl;
+        for (const auto& result : results) {
+            cout << result.first << "," << poly_modulus_degree << "," << kernel_label << "," << result.second << endl;
+        }
+    } else {
+        cout << "Operation                 Mean time (us)" << endl;
+        for (const auto& result : results) {
+            cout << "  " << result.first << string(24 - min<size_t>(24, result.first.size()), ' ') << result.second << endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "eval_plan.h"
+#include <cstdint>
+#include <initializer_list>
+
+// --- Budget Evaluation Plan ---
+// The computation the server runs for every client request:
+//   total_expenses  = essential_expenses + non_essential_expenses
+//   net_income      = total_income - total_expenses
+//   goal_difference = net_income - monthly_savings_goal (plaintext)
+// The category totals are echoed back so the client can show the breakdown.
+
+inline EvalPlan make_budget_plan() {
+    EvalPlan plan;
+    int total_income = plan.input("total_income");
+    int monthly_savings_goal = plan.plain_input("monthly_savings_goal");
+    int essential_expenses = plan.input("essential_expenses");
+    int non_essential_expenses = plan.input("non_essential_expenses");
+
+    int total_expenses = plan.add(essential_expenses, non_essential_expenses);
+    int net_income = plan.sub(total_income, total_expenses);
+    int goal_difference = plan.sub_plain(net_income, monthly_savings_goal);
+
+    plan.output(total_expenses, "total_expenses");
+    plan.output(net_income, "net_income");
+    plan.output(goal_difference, "goal_difference");
+    plan.output(essential_expenses, "essential_expenses");
+    plan.output(non_essential_expenses, "non_essential_expenses");
+    return plan;
+}
+
+// Whether every output of the plan stays within limit (fixed_point_limit) for
+// these scaled inputs. Each input being within it is not enough: a sum or
+// difference past it wraps modulo the plain modulus and decrypts to a
+// different amount. The inputs must each be within limit, which keeps these
+// sums far from overflowing int64.
+inline bool budget_within_limit(int64_t total_income, int64_t monthly_savings_goal, int64_t essential_expenses,
+                                int64_t non_essential_expenses, int64_t limit) {
+    int64_t total_expenses = essential_expenses + non_essential_expenses;
+    int64_t net_income = total_income - total_expenses;
+    int64_t goal_difference = net_income - monthly_savings_goal;
+    for (int64_t output : { total_expenses, net_income, goal_difference }) {
+        if (output > limit || output < -limit) return false;
+    }
+    return true;
+}
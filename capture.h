@@ -0,0 +1,123 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// --- Traffic Capture ---
+// server_app --capture FILE records every frame it receives, with the time it
+// arrived and the connection it arrived on, so replay_app can send the same
+// traffic again: same key sizes, same request mix, same pacing. Frames are the
+// size-prefixed payloads of the wire protocol, so a capture holds encrypted
+// data and public keys only.
+//
+// Layout: magic u32, version u16, then records of
+//   microseconds since the capture started u64, connection id u64,
+//   kind u8 (open, frame, close), payload length u64 and payload bytes.
+
+const uint32_t CAPTURE_MAGIC = 0x43454846; // "FHEC"
+const uint16_t CAPTURE_VERSION = 1;
+
+enum class CaptureKind : uint8_t { open = 0, frame = 1, close = 2 };
+
+struct CaptureRecord {
+    uint64_t microseconds = 0;
+    uint64_t connection = 0;
+    CaptureKind kind = CaptureKind::frame;
+    std::string payload;
+};
+
+// Thread-safe recorder. Connections are registered by socket, so the code that
+// reads frames only needs the socket it read from.
+class FrameCapture {
+public:
+    explicit FrameCapture(const std::string& path)
+        : out_(path, std::ios::binary | std::ios::trunc), start_(std::chrono::steady_clock::now()) {
+        if (!out_) throw std::runtime_error("capture: cannot create " + path);
+        write_raw(CAPTURE_MAGIC);
+        write_raw(CAPTURE_VERSION);
+    }
+
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    void open(int sock, uint64_t connection) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connections_[sock] = connection;
+        write_record(connection, CaptureKind::open, "");
+    }
+
+    void frame(int sock, const std::string& payload) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = connections_.find(sock);
+        if (found != connections_.end()) write_record(found->second, CaptureKind::frame, payload);
+    }
+
+    void close(int sock) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = connections_.find(sock);
+        if (found == connections_.end()) return;
+        write_record(found->second, CaptureKind::close, "");
+        connections_.erase(found);
+        out_.flush();
+    }
+
+    size_t records() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return records_;
+    }
+
+private:
+    template <class T>
+    void write_raw(T value) {
+        out_.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    // Called with mutex_ held
+    void write_record(uint64_t connection, CaptureKind kind, const std::string& payload) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_);
+        write_raw<uint64_t>(static_cast<uint64_t>(elapsed.count()));
+        write_raw<uint64_t>(connection);
+        write_raw<uint8_t>(static_cast<uint8_t>(kind));
+        write_raw<uint64_t>(payload.size());
+        out_.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+        records_++;
+    }
+
+    std::mutex mutex_;
+    std::ofstream out_;
+    const std::chrono::steady_clock::time_point start_;
+    std::map<int, uint64_t> connections_;
+    size_t records_ = 0;
+};
+
+// Reads a whole capture. Throws std::invalid_argument if it is malformed; a
+// capture cut short (the server was killed) ends at its last whole record.
+inline std::vector<CaptureRecord> read_capture(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::invalid_argument("capture: cannot open " + path);
+    auto read_raw = [&](auto& value) { return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(value))); };
+    uint32_t magic = 0;
+    uint16_t version = 0;
+    if (!read_raw(magic) || magic != CAPTURE_MAGIC) throw std::invalid_argument("capture: bad magic");
+    if (!read_raw(version) || version != CAPTURE_VERSION) throw std::invalid_argument("capture: unsupported version");
+    std::vector<CaptureRecord> records;
+    while (true) {
+        CaptureRecord record;
+        uint8_t kind = 0;
+        uint64_t size = 0;
+        if (!read_raw(record.microseconds) || !read_raw(record.connection) || !read_raw(kind) || !read_raw(size)) break;
+        if (kind > static_cast<uint8_t>(CaptureKind::close)) throw std::invalid_argument("capture: bad record kind");
+        record.kind = static_cast<CaptureKind>(kind);
+        record.payload.resize(size);
+        if (size > 0 && !in.read(&record.payload[0], static_cast<std::streamsize>(size))) break;
+        records.push_back(std::move(record));
+    }
+    return records;
+}
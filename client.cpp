@@ -1,4 +1,14 @@
 #include "seal/seal.h" //For Microsoft SEAL library
+#include "kernels.h" // Reports which NTT/modular arithmetic kernels are active
+#include "fixed_point.h" // Vectorized amount <-> scaled int64 conversion
+#include "galois_keygen.h" // Parallel Galois key generation
+#include "batch_frame.h" // Multi-object frames with one shared header
+#include "response_pack.h" // Slot layout of the packed response
+#include "protocol.h" // Request and response headers
+#include "budget_plan.h" // Range check of the totals the server computes
+#include "thread_pool.h" // Parallel encryption of batch records
+#include "frame_stream.h" // recv_exact and send_exact
+#include "deterministic_rng.h" // Fails the build if seeded randomness was enabled
 #include <iostream>
 #include <vector> 
 #include <numeric> // For std::accumulate
@@ -7,6 +17,14 @@
 #include <limits> // For numeric_limits
 #include <map>    // For storing category sums
 #include <algorithm> // For std::sort
+#include <future> // Background key generation and encryption
+#include <memory>
+#include <fstream> // Batch mode input
+#include <chrono>
+#include <random> // Request ids
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 // Headers for socket programming
 #include <sys/socket.h> //core socket functions
@@ -21,27 +39,17 @@ using namespace seal;
 // Function to send data over a socket with a size prefix
 bool send_data(int sock, const string& data) {
     size_t data_size = data.size();
-    if (send(sock, &data_size, sizeof(data_size), 0) == -1) {
-        return false;
-    }
-    if (send(sock, data.c_str(), data_size, 0) == -1) {
-        return false;
-    }
-    return true;
+    return send_exact(sock, &data_size, sizeof(data_size)) && send_exact(sock, data.data(), data_size);
 }
 
-// Function to receive data over a socket with a size prefix
+// Function to receive data over a socket with a size prefix. Returns an empty
+// string once the connection is closed or fails.
 string receive_data(int sock) {
     size_t data_size;
-    if (recv(sock, &data_size, sizeof(data_size), MSG_WAITALL) == -1) {
-        return "";
-    }
-
-    vector<char> buffer(data_size);
-    if (recv(sock, buffer.data(), data_size, MSG_WAITALL) == -1) {
-        return "";
-    }
-    return string(buffer.begin(), buffer.end());
+    if (!recv_exact(sock, &data_size, sizeof(data_size))) return "";
+    string data(data_size, '\0');
+    if (data_size > 0 && !recv_exact(sock, &data[0], data_size)) return "";
+    return data;
 }
 
 // Helper function to get multiple double inputs from user
@@ -84,13 +92,54 @@ double get_single_double_input(const string& prompt_name) {
     return value;
 }
 
-int main() {
-    // --- Network Setup (Client) ---
+// Converts one amount to its scaled fixed-point value and replicates it across
+// every slot. Rejects amounts the plain modulus cannot represent.
+bool amount_slots(double amount, size_t slot_count, double scale, int64_t limit, vector<int64_t>& slots) {
+    int64_t scaled;
+    if (to_fixed_point(&amount, 1, scale, limit, &scaled) != 1) {
+        cerr << "Error: amount " << amount << " is out of range (limit " << static_cast<double>(limit) / scale << ")." << endl;
+        return false;
+    }
+    slots.assign(slot_count, scaled);
+    return true;
+}
+
+// Like get_single_double_input, but asks again until the amount is in range
+double get_amount_input(const string& prompt_name, size_t slot_count, double scale, int64_t limit, vector<int64_t>& slots) {
+    while (true) {
+        double value = get_single_double_input(prompt_name);
+        if (amount_slots(value, slot_count, scale, limit, slots)) return value;
+    }
+}
+
+// Decrypts a result ciphertext and converts its decoded slots back to amounts
+vector<double> decrypt_amounts(Decryptor& decryptor, const BatchEncoder& batch_encoder, const Ciphertext& encrypted, double scale) {
+    Plaintext plain;
+    decryptor.decrypt(encrypted, plain);
+    vector<int64_t> decoded_scaled;
+    batch_encoder.decode(plain, decoded_scaled);
+    return from_fixed_point_slots(decoded_scaled, scale);
+}
+
+// --- Connection ---
+// The server can send the client on to another one (see protocol.h)
+int PORT = 8080; // Must match server's port
+string SERVER_IP = "127.0.0.1"; // Server IP: localhost by default
+
+// Switches to the server at "ip:port". Returns false if address is not one.
+bool use_server_address(const string& address) {
+    string host;
+    int port = 0;
+    if (!split_address(address, host, port)) return false;
+    SERVER_IP = host;
+    PORT = port;
+    return true;
+}
+
+// Returns a connected socket, or -1
+int connect_to_server() {
     int sock = 0;
     struct sockaddr_in serv_addr;
-    const int PORT = 8080; // Must match server's port
-    const char* SERVER_IP = "127.0.0.1"; // Server IP: localhost for now
-
     if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
         cerr << "Socket creation error" << endl;
         return -1;
@@ -99,13 +148,309 @@ int main() {
     serv_addr.sin_family = AF_INET;
     serv_addr.sin_port = htons(PORT);
 
-    if (inet_pton(AF_INET, SERVER_IP, &serv_addr.sin_addr) <= 0) {
+    if (inet_pton(AF_INET, SERVER_IP.c_str(), &serv_addr.sin_addr) <= 0) {
         cerr << "Invalid address/ Address not supported" << endl;
+        close(sock);
         return -1;
     }
+    if (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// Random nonzero request id; ids only need to be unique per key
+uint64_t new_request_id() {
+    random_device device;
+    uint64_t id = 0;
+    while (id == 0) id = (static_cast<uint64_t>(device()) << 32) | device();
+    return id;
+}
+
+// Sends payloads on a separate thread while their responses are read, so
+// responses come back while requests still go out. At most MAX_IN_FLIGHT
+// requests are outstanding, which keeps the session under the server's
+// per-session memory limit. Fills responses in order and returns how many
+// arrived: fewer than payloads.size() means the connection dropped.
+const size_t MAX_IN_FLIGHT = 256;
+
+size_t exchange_pipelined(int sock, const vector<string>& payloads, vector<string>& responses) {
+    responses.assign(payloads.size(), string());
+    mutex window_mutex;
+    condition_variable window_cv;
+    size_t received = 0;
+    bool receiving_done = false;
+    future<void> sending = async(launch::async, [&]() {
+        for (size_t k = 0; k < payloads.size(); k++) {
+            {
+                unique_lock<mutex> lock(window_mutex);
+                window_cv.wait(lock, [&]() { return receiving_done || k - received < MAX_IN_FLIGHT; });
+                if (receiving_done) return;
+            }
+            if (!send_data(sock, payloads[k])) return;
+        }
+    });
+    while (received < payloads.size()) {
+        string payload = receive_data(sock);
+        if (payload.empty()) break;
+        lock_guard<mutex> lock(window_mutex);
+        responses[received++] = move(payload);
+        window_cv.notify_one();
+    }
+    {
+        lock_guard<mutex> lock(window_mutex);
+        receiving_done = true;
+    }
+    window_cv.notify_one();
+    sending.get();
+    return received;
+}
+
+// Sends payloads over a new connection that resumes under the keys uploaded
+// before (no new upload) and returns the responses, in order. A hello reply
+// that names another server is followed. Returns an empty vector if no
+// server answers them all.
+//
+// After a lost connection the unanswered requests are sent again whole, not
+// fetched by id: the server answers an id it has seen with the stored (or
+// still running) evaluation and evaluates one it never read.
+vector<string> exchange_on_new_connection(const string& fingerprint, const vector<string>& payloads) {
+    const int ATTEMPTS = 3;
+    for (int attempt = 1; attempt <= ATTEMPTS; attempt++) {
+        this_thread::sleep_for(chrono::seconds(attempt));
+        cerr << "Reconnecting to " << SERVER_IP << ":" << PORT << " for " << payloads.size() << " request(s) (attempt " << attempt
+             << " of " << ATTEMPTS << ")..." << endl;
+        int sock = connect_to_server();
+        if (sock < 0) continue;
+        vector<string> responses;
+        try {
+            if (!send_data(sock, encode_session_hello(fingerprint))) throw runtime_error("send failed");
+            SessionReply reply = decode_session_reply(receive_data(sock));
+            if (!reply.moved_to.empty()) {
+                close(sock);
+                if (!use_server_address(reply.moved_to)) return {};
+                cerr << "The keys moved to " << reply.moved_to << "." << endl;
+                continue;
+            }
+            if (exchange_pipelined(sock, payloads, responses) < payloads.size()) responses.clear();
+        } catch (const exception&) {
+            responses.clear();
+        }
+        close(sock);
+        if (responses.size() == payloads.size()) return responses;
+    }
+    return {};
+}
+
+// Requests answered with status moved are sent again to the server named in
+// the response, which already holds the keys. Returns false if that fails.
+bool resend_moved(const string& fingerprint, const vector<string>& requests, vector<string>& responses) {
+    const int MAX_REDIRECTS = 3;
+    for (int redirect = 0; redirect < MAX_REDIRECTS; redirect++) {
+        vector<size_t> moved;
+        string address;
+        for (size_t k = 0; k < responses.size(); k++) {
+            string frame;
+            try {
+                if (decode_response(responses[k], frame).status != ResponseStatus::moved) continue;
+            } catch (const exception&) {
+                continue;
+            }
+            moved.push_back(k);
+            address = frame;
+        }
+        if (moved.empty()) return true;
+        if (!use_server_address(address)) return false;
+        cerr << "The server moved these keys to " << address << "; resending " << moved.size() << " request(s)." << endl;
+        vector<string> payloads;
+        for (size_t k : moved) payloads.push_back(requests[k]);
+        vector<string> resent = exchange_on_new_connection(fingerprint, payloads);
+        if (resent.empty()) return false;
+        for (size_t i = 0; i < moved.size(); i++) responses[moved[i]] = move(resent[i]);
+    }
+    return false;
+}
+
+// --- Batch Mode ---
+// Evaluates many budgets in one session, one request per record. Record k sits
+// alone in slot k % capacity (zeros elsewhere), so consecutive records occupy
+// disjoint slots and the server can evaluate up to capacity of them together.
+struct BatchRecord {
+    double income;
+    double essential_expenses;
+    double non_essential_expenses;
+    double monthly_savings_goal;
+};
+
+// Reads "income,essential,non_essential,goal" lines. Blank lines, lines
+// starting with '#' and a non-numeric first line (a header) are skipped.
+bool read_batch_records(const string& path, vector<BatchRecord>& records) {
+    ifstream in(path);
+    if (!in) {
+        cerr << "Error: cannot open " << path << endl;
+        return false;
+    }
+    string line;
+    size_t line_number = 0;
+    while (getline(in, line)) {
+        line_number++;
+        if (line.empty() || line[0] == '#') continue;
+        stringstream fields(line);
+        BatchRecord record;
+        char c1, c2, c3;
+        if (!(fields >> record.income >> c1 >> record.essential_expenses >> c2 >> record.non_essential_expenses >> c3
+                     >> record.monthly_savings_goal) || c1 != ',' || c2 != ',' || c3 != ',') {
+            if (line_number == 1) continue;
+            cerr << "Error: " << path << ":" << line_number << ": expected income,essential,non_essential,goal" << endl;
+            return false;
+        }
+        records.push_back(record);
+    }
+    return true;
+}
+
+int run_batch(int sock, const vector<BatchRecord>& records, const SEALContext& context, const PublicKey& public_key,
+              const SecretKey& secret_key, const string& fingerprint, double scale, int64_t limit) {
+    BatchEncoder batch_encoder(context);
+    Encryptor encryptor(context, public_key);
+    Decryptor decryptor(context, secret_key);
+    size_t slot_count = batch_encoder.slot_count();
+    size_t capacity = make_response_layout(slot_count, 5).width;
+
+    // Scale everything up front so a bad amount stops the batch before any work.
+    // Each column is converted in one call to the fixed-point kernel, in request
+    // order: income, savings goal, essential, non-essential.
+    vector<vector<double>> columns(4, vector<double>(records.size()));
+    for (size_t k = 0; k < records.size(); k++) {
+        columns[0][k] = records[k].income;
+        columns[1][k] = records[k].monthly_savings_goal;
+        columns[2][k] = records[k].essential_expenses;
+        columns[3][k] = records[k].non_essential_expenses;
+    }
+    vector<vector<int64_t>> scaled(4);
+    for (size_t j = 0; j < 4; j++) {
+        size_t converted = to_fixed_point_slots(columns[j], records.size(), scale, limit, scaled[j]);
+        if (converted != records.size()) {
+            cerr << "Error: record " << converted + 1 << " is out of range (limit " << static_cast<double>(limit) / scale
+                 << ")." << endl;
+            return 1;
+        }
+    }
+    for (size_t k = 0; k < records.size(); k++) {
+        if (!budget_within_limit(scaled[0][k], scaled[1][k], scaled[2][k], scaled[3][k], limit)) {
+            cerr << "Error: record " << k + 1 << ": its totals are out of range (limit " << static_cast<double>(limit) / scale
+                 << ")." << endl;
+            return 1;
+        }
+    }
+
+    auto start = chrono::steady_clock::now();
+    vector<string> requests(records.size());
+    vector<uint64_t> request_ids(records.size());
+    for (auto& id : request_ids) id = new_request_id();
+    parallel_for(records.size(), 0, [&](size_t k) {
+        size_t offset = k % capacity;
+        vector<int64_t> slots(slot_count, 0);
+        Plaintext encoded;
+        Ciphertext encrypted;
+        BatchFrameWriter frame(context, context.first_parms_id());
+        for (size_t j = 0; j < 4; j++) {
+            slots[offset] = scaled[j][k];
+            batch_encoder.encode(slots, encoded);
+            if (j == 1) {
+                frame.add(encoded); // the savings goal stays a plaintext
+            } else {
+                encryptor.encrypt(encoded, encrypted);
+                frame.add(encrypted);
+            }
+        }
+        requests[k] = encode_request({ request_ids[k], 0, static_cast<uint32_t>(offset), 1 }, frame.finish());
+    });
+
+    // If the connection drops, the requests not yet answered are sent again over
+    // a new connection
+    vector<string> responses;
+    size_t received = exchange_pipelined(sock, requests, responses);
+    if (received < records.size()) {
+        cerr << "Connection to the server lost after " << received << " of " << records.size() << " responses." << endl;
+        vector<string> unanswered(requests.begin() + static_cast<ptrdiff_t>(received), requests.end());
+        vector<string> resent = exchange_on_new_connection(fingerprint, unanswered);
+        if (resent.empty()) {
+            cerr << "Error: could not reach the server again." << endl;
+            return 1;
+        }
+        for (auto& payload : resent) responses[received++] = move(payload);
+    }
+    if (!resend_moved(fingerprint, requests, responses)) {
+        cerr << "Error: could not reach the server the keys moved to." << endl;
+        return 1;
+    }
 
+    cout << "record,total_expenses,net_income,goal_difference,essential_expenses,non_essential_expenses" << endl;
+    string last_frame;
+    vector<double> decoded;
+    size_t failed = 0;
+    for (size_t k = 0; k < records.size(); k++) {
+        string frame;
+        ResponseHeader header;
+        try {
+            header = decode_response(responses[k], frame);
+            if (header.status != ResponseStatus::ok) {
+                cerr << "Error: record " << k + 1 << " failed on the server (" << response_status_name(header.status) << ")." << endl;
+                failed++;
+                continue;
+            }
+            if (header.request_id != request_ids[k] || header.result_count != 5 ||
+                header.slot_offset + 4 * static_cast<size_t>(header.result_stride) >= slot_count) {
+                throw invalid_argument("unexpected response header");
+            }
+            // Records evaluated together share one response; decrypt it once
+            if (frame != last_frame) {
+                BatchFrameReader results(context, frame);
+                if (results.size() != 1) throw invalid_argument("expected one packed response");
+                Ciphertext encrypted_response;
+                results.load(0, encrypted_response);
+                decoded = decrypt_amounts(decryptor, batch_encoder, encrypted_response, scale);
+                last_frame = move(frame);
+            }
+        } catch (const exception& e) {
+            cerr << "Error: invalid response for record " << k + 1 << ": " << e.what() << endl;
+            return 1;
+        }
+        cout << k + 1;
+        for (uint32_t i = 0; i < 5; i++) cout << "," << decoded[i * header.result_stride + header.slot_offset];
+        cout << endl;
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cerr << records.size() << " records evaluated in " << seconds << " s" << (failed ? ", " + to_string(failed) + " failed" : "") << "." << endl;
+    return failed ? 1 : 0;
+}
+
+int main(int argc, char* argv[]) {
+    // --- Options ---
+    // --batch FILE.csv: evaluate every record of the file instead of prompting
+    // --server IP:PORT: server to connect to (default 127.0.0.1:8080)
+    string batch_path;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--batch" && i + 1 < argc) {
+            batch_path = argv[++i];
+        } else if (arg == "--server" && i + 1 < argc && use_server_address(argv[i + 1])) {
+            i++;
+        } else {
+            cerr << "Usage: " << argv[0] << " [--batch FILE.csv] [--server IP:PORT]" << endl;
+            return 1;
+        }
+    }
+    vector<BatchRecord> batch_records;
+    if (!batch_path.empty() && !read_batch_records(batch_path, batch_records)) return 1;
+
+    // --- Network Setup (Client) ---
     cout << "Attempting to connect to server at " << SERVER_IP << ":" << PORT << "..." << endl;
-    if (connect(sock, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
+    int sock = connect_to_server();
+    if (sock < 0) {
         cerr << "Connection Failed. Ensure server_app is running first.\n";
         return -1;
     }
@@ -119,47 +464,102 @@ int main() {
     parms.set_plain_modulus(PlainModulus::Batching(poly_modulus_degree, 30));
 
     SEALContext context(parms);
-
-    // 2. Key Generation (Client-side)
-    KeyGenerator keygen(context);
-    SecretKey secret_key = keygen.secret_key();
+    print_kernel_report(cout, detect_kernels(max_coeff_modulus_bits(parms)));
+
+    // 2. Key Generation and Upload (Client-side, in the background)
+    // Keygen and the key upload run on their own thread while the user types.
+    // The public key is published as soon as it exists so that each amount can be
+    // encrypted the moment it is entered; the relinearization and Galois keys
+    // follow on the same thread, so the socket still sees parms, pk, rlk, glk in
+    // order. Nothing here prints, to keep the prompts below readable.
+    SecretKey secret_key;
     PublicKey public_key;
-    keygen.create_public_key(public_key);
-    RelinKeys relin_keys;
-    keygen.create_relin_keys(relin_keys);
-    GaloisKeys galois_keys;
-    keygen.create_galois_keys(galois_keys);
+    string fingerprint; // identifies the uploaded keys when fetching results again
+    promise<void> public_key_promise;
+    shared_future<void> public_key_ready = public_key_promise.get_future().share();
+    future<bool> key_upload = async(launch::async, [&]() {
+        KeyGenerator keygen(context);
+        try {
+            secret_key = keygen.secret_key();
+            keygen.create_public_key(public_key);
+            public_key_promise.set_value();
+        } catch (...) {
+            public_key_promise.set_exception(current_exception());
+            throw;
+        }
 
-    // --- Send Keys and Parameters to Server ---
-    stringstream parms_ss;
-    parms.save(parms_ss);
-    if (!send_data(sock, parms_ss.str())) return 1;
+        // --- Send Keys and Parameters to Server ---
+        if (!send_data(sock, encode_session_hello(""))) return false;
 
-    stringstream pk_ss;
-    public_key.save(pk_ss);
-    if (!send_data(sock, pk_ss.str())) return 1;
+        stringstream parms_ss;
+        parms.save(parms_ss);
+        if (!send_data(sock, parms_ss.str())) return false;
 
-    stringstream rlk_ss;
-    relin_keys.save(rlk_ss);
-    if (!send_data(sock, rlk_ss.str())) return 1;
+        stringstream pk_ss;
+        public_key.save(pk_ss);
+        if (!send_data(sock, pk_ss.str())) return false;
+        fingerprint = key_fingerprint(parms_ss.str(), pk_ss.str());
 
-    stringstream glk_ss;
-    galois_keys.save(glk_ss);
-    if (!send_data(sock, glk_ss.str())) return 1;
+        RelinKeys relin_keys;
+        keygen.create_relin_keys(relin_keys);
+        stringstream rlk_ss;
+        relin_keys.save(rlk_ss);
+        if (!send_data(sock, rlk_ss.str())) return false;
+
+        GaloisKeys galois_keys;
+        create_galois_keys_parallel(context, secret_key, galois_keys); // one thread per core
+        stringstream glk_ss;
+        galois_keys.save(glk_ss);
+        return send_data(sock, glk_ss.str());
+    });
 
-    Encryptor encryptor(context, public_key);
-    Decryptor decryptor(context, secret_key);
     BatchEncoder batch_encoder(context);
 
     size_t slot_count = batch_encoder.slot_count();
 
     const double SCALE_FACTOR = 100.0;
+    const int64_t AMOUNT_LIMIT = fixed_point_limit(parms.plain_modulus());
+
+    if (!batch_path.empty()) {
+        int status = 1;
+        try {
+            if (key_upload.get()) {
+                status = run_batch(sock, batch_records, context, public_key, secret_key, fingerprint, SCALE_FACTOR, AMOUNT_LIMIT);
+            } else {
+                cerr << "Error: failed to send keys to the server." << endl;
+            }
+        } catch (const exception& e) {
+            cerr << "Error during key generation or encryption: " << e.what() << endl;
+        }
+        close(sock);
+        return status;
+    }
+
+    // Amounts are encrypted on a single worker thread, in the order they are
+    // entered. The first task waits for the public key.
+    unique_ptr<Encryptor> encryptor; // only touched by the worker (declared first so it outlives it)
+    ThreadPool encryption_worker(1);
+    auto encrypt_amount = [&](vector<int64_t> slots) {
+        return encryption_worker.submit([&, slots = move(slots)]() {
+            public_key_ready.get();
+            if (!encryptor) encryptor = make_unique<Encryptor>(context, public_key);
+            Plaintext encoded;
+            batch_encoder.encode(slots, encoded);
+            Ciphertext encrypted;
+            encryptor->encrypt(encoded, encrypted);
+            return encrypted;
+        });
+    };
 
     // --- 3. Prepare and Encrypt Financial Data (Client-side - User Input) ---
     cout << "\n--- Enter your financial data (Monthly) ---" << endl;
 
     // --- Income Input ---
+    // Each income source is encrypted as soon as it is entered; the ciphertexts
+    // are summed once input is finished.
     vector<double> income_sources_raw;
+    vector<future<Ciphertext>> encrypted_income_sources;
+    int64_t total_income_scaled = 0;
     double income_value;
     string input_line;
     cout << "Enter monthly income (e.g., 1500.75, 250.00). Type 'done' when finished:" << endl;
@@ -172,12 +572,23 @@ int main() {
         }
         try {
             income_value = stod(input_line);
-            income_sources_raw.push_back(income_value);
         } catch (const std::invalid_argument& e) {
             cerr << "Invalid input. Please enter a number or 'done'." << endl;
             cin.clear();
             cin.ignore(numeric_limits<streamsize>::max(), '\n');
+            continue;
         }
+        vector<int64_t> income_slots;
+        if (!amount_slots(income_value, slot_count, SCALE_FACTOR, AMOUNT_LIMIT, income_slots)) continue;
+        int64_t income_scaled = income_slots[0];
+        // Both terms are within AMOUNT_LIMIT, so this sum cannot overflow int64
+        if (total_income_scaled + income_scaled > AMOUNT_LIMIT || total_income_scaled + income_scaled < -AMOUNT_LIMIT) {
+            cerr << "Error: total income would be out of range; amount ignored." << endl;
+            continue;
+        }
+        total_income_scaled += income_scaled;
+        income_sources_raw.push_back(income_value);
+        encrypted_income_sources.push_back(encrypt_amount(move(income_slots)));
     }
 
     double total_income_plaintext_sum = std::accumulate(income_sources_raw.begin(), income_sources_raw.end(), 0.0);
@@ -185,151 +596,165 @@ int main() {
 
     if (income_sources_raw.empty()) {
         total_income_plaintext_sum = 0.0;
+        encrypted_income_sources.push_back(encrypt_amount(vector<int64_t>(slot_count, 0)));
     }
 
-    // Scale and encode total income (filling all slots)
-    int64_t total_income_scaled = static_cast<int64_t>(round(total_income_plaintext_sum * SCALE_FACTOR));
-    Plaintext encoded_total_income;
-    batch_encoder.encode(vector<int64_t>(slot_count, total_income_scaled), encoded_total_income);
-    
-    // Encrypt total income
-    Ciphertext encrypted_total_income;
-    encryptor.encrypt(encoded_total_income, encrypted_total_income);
-
     // --- Categorized Expense Input (Direct Totals) ---
     cout << "\n--- Enter your monthly expenses ---" << endl;
     
     // Get total Essential Expenses directly
-    double essential_expenses_sum_plaintext = get_single_double_input("Total ESSENTIAL Expenses (e.g., Housing, Food, Utilities, Transportation)");
+    vector<int64_t> essential_expenses_slots;
+    double essential_expenses_sum_plaintext = get_amount_input("Total ESSENTIAL Expenses (e.g., Housing, Food, Utilities, Transportation)",
+                                                               slot_count, SCALE_FACTOR, AMOUNT_LIMIT, essential_expenses_slots);
     cout << "Total ESSENTIAL Expenses: " << essential_expenses_sum_plaintext << endl;
+    int64_t essential_expenses_scaled = essential_expenses_slots[0];
 
-    // Get total Non-Essential Expenses directly
-    double non_essential_expenses_sum_plaintext = get_single_double_input("Total NON-ESSENTIAL Expenses (e.g., Dining Out, Entertainment, Shopping)");
+    // Start encrypting essential expenses total
+    future<Ciphertext> encrypting_essential_expenses = encrypt_amount(move(essential_expenses_slots));
+
+    // Get total Non-Essential Expenses directly. The totals computed from the
+    // amounts must be in range as well, or they would wrap on the server.
+    vector<int64_t> non_essential_expenses_slots;
+    double non_essential_expenses_sum_plaintext;
+    while (true) {
+        non_essential_expenses_sum_plaintext = get_amount_input("Total NON-ESSENTIAL Expenses (e.g., Dining Out, Entertainment, Shopping)",
+                                                                slot_count, SCALE_FACTOR, AMOUNT_LIMIT, non_essential_expenses_slots);
+        if (budget_within_limit(total_income_scaled, 0, essential_expenses_scaled, non_essential_expenses_slots[0], AMOUNT_LIMIT)) break;
+        cerr << "Error: total expenses or net income would be out of range; please enter a different amount." << endl;
+    }
+    int64_t non_essential_expenses_scaled = non_essential_expenses_slots[0];
     cout << "Total NON-ESSENTIAL Expenses: " << non_essential_expenses_sum_plaintext << endl;
+
+    // Start encrypting non-essential expenses total
+    future<Ciphertext> encrypting_non_essential_expenses = encrypt_amount(move(non_essential_expenses_slots));
     
     // Store plaintext sums for client-side verification
     map<string, double> client_local_category_sums;
     client_local_category_sums["Essentials"] = essential_expenses_sum_plaintext;
     client_local_category_sums["Non-Essentials"] = non_essential_expenses_sum_plaintext;
 
-    // Scale and encode essential expenses total
-    int64_t essential_expenses_scaled = static_cast<int64_t>(round(essential_expenses_sum_plaintext * SCALE_FACTOR));
-    Plaintext encoded_essential_expenses;
-    batch_encoder.encode(vector<int64_t>(slot_count, essential_expenses_scaled), encoded_essential_expenses);
-
-    // Encrypt essential expenses total
-    Ciphertext encrypted_essential_expenses;
-    encryptor.encrypt(encoded_essential_expenses, encrypted_essential_expenses);
-
-    // Scale and encode non-essential expenses total
-    int64_t non_essential_expenses_scaled = static_cast<int64_t>(round(non_essential_expenses_sum_plaintext * SCALE_FACTOR));
-    Plaintext encoded_non_essential_expenses;
-    batch_encoder.encode(vector<int64_t>(slot_count, non_essential_expenses_scaled), encoded_non_essential_expenses);
-
-    // Encrypt non-essential expenses total
-    Ciphertext encrypted_non_essential_expenses;
-    encryptor.encrypt(encoded_non_essential_expenses, encrypted_non_essential_expenses);
-
     // --- Monthly Savings Goal Input ---
-    double monthly_savings_goal_double;
+    vector<int64_t> monthly_savings_goal_slots;
     cout << "\n--- Enter your monthly savings goal ---" << endl;
-    monthly_savings_goal_double = get_single_double_input("Enter your target monthly savings (e.g., 500.00)");
+    double monthly_savings_goal_double;
+    while (true) {
+        monthly_savings_goal_double = get_amount_input("Enter your target monthly savings (e.g., 500.00)", slot_count,
+                                                       SCALE_FACTOR, AMOUNT_LIMIT, monthly_savings_goal_slots);
+        if (budget_within_limit(total_income_scaled, monthly_savings_goal_slots[0], essential_expenses_scaled,
+                                non_essential_expenses_scaled, AMOUNT_LIMIT)) {
+            break;
+        }
+        cerr << "Error: the difference from your goal would be out of range; please enter a different amount." << endl;
+    }
     cout << "Monthly Savings Goal: " << monthly_savings_goal_double << endl;
 
-    // Scale and encode monthly savings goal
-    int64_t monthly_savings_goal_scaled = static_cast<int64_t>(round(monthly_savings_goal_double * SCALE_FACTOR));
+    // Encode monthly savings goal
     Plaintext encoded_monthly_savings_goal;
-    batch_encoder.encode(vector<int64_t>(slot_count, monthly_savings_goal_scaled), encoded_monthly_savings_goal);
+    batch_encoder.encode(monthly_savings_goal_slots, encoded_monthly_savings_goal);
 
-    // --- Send Encrypted Data to Server ---
-    // Send encrypted total income
-    stringstream enc_total_income_ss;
-    encrypted_total_income.save(enc_total_income_ss);
-    if (!send_data(sock, enc_total_income_ss.str())) return 1;
-
-    // Send encoded monthly savings goal
-    stringstream enc_monthly_savings_goal_ss;
-    encoded_monthly_savings_goal.save(enc_monthly_savings_goal_ss);
-    if (!send_data(sock, enc_monthly_savings_goal_ss.str())) return 1;
-    
-    // Send encrypted essential expenses sum
-    stringstream enc_essential_ss;
-    encrypted_essential_expenses.save(enc_essential_ss);
-    if (!send_data(sock, enc_essential_ss.str())) return 1;
+    // --- Wait for the Background Work ---
+    // The keys must be on the wire before the inputs, so the upload is joined
+    // first; the encryptions have usually finished long before.
+    Ciphertext encrypted_total_income;
+    Ciphertext encrypted_essential_expenses;
+    Ciphertext encrypted_non_essential_expenses;
+    try {
+        if (!key_upload.get()) {
+            cerr << "Error: failed to send keys to the server." << endl;
+            return 1;
+        }
+        vector<Ciphertext> income_ciphertexts;
+        for (auto& encrypting : encrypted_income_sources) {
+            income_ciphertexts.push_back(encrypting.get());
+        }
+        Evaluator client_evaluator(context);
+        client_evaluator.add_many(income_ciphertexts, encrypted_total_income);
+        encrypted_essential_expenses = encrypting_essential_expenses.get();
+        encrypted_non_essential_expenses = encrypting_non_essential_expenses.get();
+    } catch (const exception& e) {
+        cerr << "Error during key generation or encryption: " << e.what() << endl;
+        return 1;
+    }
 
-    // Send encrypted non-essential expenses sum
-    stringstream enc_non_essential_ss;
-    encrypted_non_essential_expenses.save(enc_non_essential_ss);
-    if (!send_data(sock, enc_non_essential_ss.str())) return 1;
+    Decryptor decryptor(context, secret_key);
+
+    // --- Send Encrypted Data to Server ---
+    // All inputs travel in one batch frame sharing a single parameter header
+    BatchFrameWriter inputs_frame(context, encrypted_total_income.parms_id());
+    inputs_frame.add(encrypted_total_income);
+    inputs_frame.add(encoded_monthly_savings_goal);
+    inputs_frame.add(encrypted_essential_expenses);
+    inputs_frame.add(encrypted_non_essential_expenses);
+    // The amounts are replicated across every slot: the request spans them all.
+    // The request id lets it be sent again if the connection drops without
+    // being evaluated twice.
+    uint64_t request_id = new_request_id();
+    vector<string> request = { encode_request({ request_id, 0, 0, static_cast<uint32_t>(slot_count) }, inputs_frame.finish()) };
+    send_data(sock, request[0]); // a failed send shows up as a lost connection below
 
     cout << "\nClient-side data transfer complete. Waiting for results..." << endl;
 
     // --- Receive Encrypted Results from Server ---
-    Ciphertext encrypted_total_expenses_from_server;
-    string enc_total_expenses_str = receive_data(sock);
-    if (enc_total_expenses_str.empty()) return 1;
-    stringstream enc_total_expenses_ss(enc_total_expenses_str);
-    encrypted_total_expenses_from_server.load(context, enc_total_expenses_ss);
-
-    Ciphertext encrypted_net_income_from_server;
-    string enc_net_income_str = receive_data(sock);
-    if (enc_net_income_str.empty()) return 1;
-    stringstream enc_net_income_ss(enc_net_income_str);
-    encrypted_net_income_from_server.load(context, enc_net_income_ss);
-
-    Ciphertext encrypted_goal_difference_from_server;
-    string enc_goal_difference_str = receive_data(sock);
-    if (enc_goal_difference_str.empty()) return 1;
-    stringstream enc_goal_difference_ss(enc_goal_difference_str);
-    encrypted_goal_difference_from_server.load(context, enc_goal_difference_ss);
-
-    // Receive and decrypt individual encrypted category sums (sent back by server)
-    Ciphertext encrypted_essential_expenses_from_server_recd;
-    string enc_essential_recd_str = receive_data(sock);
-    if (enc_essential_recd_str.empty()) return 1;
-    stringstream enc_essential_recd_ss(enc_essential_recd_str);
-    encrypted_essential_expenses_from_server_recd.load(context, enc_essential_recd_ss);
-
-    Ciphertext encrypted_non_essential_expenses_from_server_recd;
-    string enc_non_essential_recd_str = receive_data(sock);
-    if (enc_non_essential_recd_str.empty()) return 1;
-    stringstream enc_non_essential_recd_ss(enc_non_essential_recd_str);
-    encrypted_non_essential_expenses_from_server_recd.load(context, enc_non_essential_recd_ss);
+    // One packed ciphertext: total expenses, net income, goal difference, and the
+    // essential and non-essential sums sent back for the breakdown. The response
+    // header says where: result i is at slot i * result_stride + slot_offset.
+    ResponseHeader response_header;
+    Ciphertext encrypted_response_from_server;
+    string results_str = receive_data(sock);
+    if (results_str.empty()) {
+        cerr << "Connection to the server lost while waiting for results." << endl;
+        vector<string> resent = exchange_on_new_connection(fingerprint, request);
+        if (resent.empty()) {
+            cerr << "Error: could not reach the server again." << endl;
+            return 1;
+        }
+        results_str = move(resent[0]);
+    }
+    vector<string> responses = { move(results_str) };
+    if (!resend_moved(fingerprint, request, responses)) {
+        cerr << "Error: could not reach the server the keys moved to." << endl;
+        return 1;
+    }
+    results_str = move(responses[0]);
+    try {
+        string results_frame;
+        response_header = decode_response(results_str, results_frame);
+        if (response_header.status == ResponseStatus::keys_required) {
+            cerr << "Error: the server no longer holds the keys; please run the client again." << endl;
+            return 1;
+        }
+        if (response_header.status != ResponseStatus::ok) {
+            cerr << "Error: the server could not evaluate the request (" << response_status_name(response_header.status) << ")." << endl;
+            return 1;
+        }
+        if (response_header.request_id != request_id || response_header.result_count != 5 || response_header.slot_offset + 4 * static_cast<size_t>(response_header.result_stride) >= slot_count) {
+            throw invalid_argument("unexpected response header");
+        }
+        BatchFrameReader results(context, move(results_frame));
+        if (results.size() != 1) throw invalid_argument("expected one packed response");
+        results.load(0, encrypted_response_from_server);
+    } catch (const exception& e) {
+        cerr << "Error: invalid results from server: " << e.what() << endl;
+        return 1;
+    }
+    auto result_slot = [&](size_t i) { return i * response_header.result_stride + response_header.slot_offset; };
 
     // --- 5. Decrypt and Decode Results (Client-side) ---
-    Plaintext decrypted_total_expenses;
-    decryptor.decrypt(encrypted_total_expenses_from_server, decrypted_total_expenses);
-    vector<int64_t> decoded_total_expenses_scaled;
-    batch_encoder.decode(decrypted_total_expenses, decoded_total_expenses_scaled);
-    double decoded_total_expenses_double = static_cast<double>(decoded_total_expenses_scaled[0]) / SCALE_FACTOR;
+    vector<double> decoded_response = decrypt_amounts(decryptor, batch_encoder, encrypted_response_from_server, SCALE_FACTOR);
+
+    double decoded_total_expenses_double = decoded_response[result_slot(0)];
     cout << "\nDecrypted Total Expenses: " << decoded_total_expenses_double << endl;
 
-    Plaintext decrypted_net_income;
-    decryptor.decrypt(encrypted_net_income_from_server, decrypted_net_income);
-    vector<int64_t> decoded_net_income_scaled;
-    batch_encoder.decode(decrypted_net_income, decoded_net_income_scaled);
-    double decoded_net_income_double = static_cast<double>(decoded_net_income_scaled[0]) / SCALE_FACTOR;
+    double decoded_net_income_double = decoded_response[result_slot(1)];
     cout << "Decrypted Net Income: " << decoded_net_income_double << endl;
 
-    Plaintext decrypted_goal_difference;
-    decryptor.decrypt(encrypted_goal_difference_from_server, decrypted_goal_difference);
-    vector<int64_t> decoded_goal_difference_scaled;
-    batch_encoder.decode(decrypted_goal_difference, decoded_goal_difference_scaled);
-    double decoded_goal_difference_double = static_cast<double>(decoded_goal_difference_scaled[0]) / SCALE_FACTOR;
+    double decoded_goal_difference_double = decoded_response[result_slot(2)];
     cout << "Decrypted Difference from Monthly Savings Goal: " << decoded_goal_difference_double << endl;
 
-    // Decrypt and decode individual category sums for display
-    Plaintext decrypted_essential_expenses;
-    decryptor.decrypt(encrypted_essential_expenses_from_server_recd, decrypted_essential_expenses);
-    vector<int64_t> decoded_essential_expenses_scaled;
-    batch_encoder.decode(decrypted_essential_expenses, decoded_essential_expenses_scaled);
-    double decoded_essential_expenses_double = static_cast<double>(decoded_essential_expenses_scaled[0]) / SCALE_FACTOR;
-
-    Plaintext decrypted_non_essential_expenses;
-    decryptor.decrypt(encrypted_non_essential_expenses_from_server_recd, decrypted_non_essential_expenses);
-    vector<int64_t> decoded_non_essential_expenses_scaled;
-    batch_encoder.decode(decrypted_non_essential_expenses, decoded_non_essential_expenses_scaled);
-    double decoded_non_essential_expenses_double = static_cast<double>(decoded_non_essential_expenses_scaled[0]) / SCALE_FACTOR;
+    // Individual category sums for display
+    double decoded_essential_expenses_double = decoded_response[result_slot(3)];
+
+    double decoded_non_essential_expenses_double = decoded_response[result_slot(4)];
 
     cout << "\n--- Decrypted Expense Breakdown ---" << endl;
     cout << "Total ESSENTIAL Expenses: " << decoded_essential_expenses_double << endl;
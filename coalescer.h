@@ -0,0 +1,446 @@
+#pragma once
+
+#include "seal/seal.h"
+#include "batch_frame.h"
+#include "cost_model.h"
+#include "eval_plan.h"
+#include "fair_scheduler.h"
+#include "key_registry.h"
+#include "profiler.h"
+#include "protocol.h"
+#include "response_pack.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// --- Request Coalescing ---
+// A key holder that sends many small requests (an aggregator, an accounting
+// firm) does not need one full-slot evaluation per request. A request whose
+// layout is narrow (its amounts in slot_width slots at slot_offset, zero
+// elsewhere) is held for a short window. Later requests under the same key
+// whose slot ranges do not overlap it join the same batch. The batch's
+// ciphertext inputs are summed, the plan runs once, and the packed response is
+// built and serialized once. Every request then gets that response with its
+// own slot offset in the header, so each client reads only its own results.
+//
+// Requests from different sessions are multiplied by a mask of their declared
+// range before summing, so a session cannot write into another session's
+// slots by ignoring its own layout. Plaintext inputs are cut to their ranges
+// directly. Replicated requests, with the amount in every slot, are evaluated
+// alone and immediately, as before.
+//
+// Every batch is priced with the cost model before it runs. A request whose
+// evaluation alone would exceed the per-request limit (parameters far larger
+// than the budget computation needs) is rejected up front; batches are queued
+// per key holder on a FairScheduler, which refuses them once too much work is
+// waiting.
+
+struct PlanRequest {
+    uint64_t session_id = 0;
+    seal::MemoryPoolHandle pool; // the session's pool; unset for the global one
+    RequestHeader layout;
+    std::map<std::string, seal::Ciphertext> ciphertexts;
+    std::map<std::string, seal::Plaintext> plaintexts;
+};
+
+struct PlanResponse {
+    ResponseHeader header;
+    std::shared_ptr<const std::string> frame; // batch frame, shared by every request of a batch
+    size_t batch_size = 0;                    // requests evaluated together
+};
+
+struct EvaluationOptions {
+    int min_response_budget = 20; // keep at least this much estimated budget when mod switching
+    bool bit_drop = true;
+    int bit_drop_margin = 4;      // see bit_drop_for_budget
+};
+
+struct AdmissionOptions {
+    double max_request_microseconds = 2e6;   // one request evaluated alone
+    double max_queued_microseconds = 30e6;   // all batches waiting for a worker
+    double quantum_microseconds = 5e3;       // fair-queuing credit per round
+};
+
+inline PlanResponse error_response(ResponseStatus status) {
+    PlanResponse response;
+    response.header.status = status;
+    response.frame = std::make_shared<const std::string>();
+    return response;
+}
+
+inline void encode_slot_range(const seal::BatchEncoder& batch_encoder, size_t offset, size_t width, seal::Plaintext& destination) {
+    std::vector<uint64_t> mask(batch_encoder.slot_count(), 0);
+    for (size_t s = offset; s < offset + width; s++) mask[s] = 1;
+    batch_encoder.encode(mask, destination);
+}
+
+// Evaluates plan once over requests that share group and have disjoint slot
+// layouts (or over a single replicated request) and builds the packed response:
+// outputs in order, each in its own range of result_stride slots, mod-switched
+// and optionally bit-dropped. The header's slot_offset is left for the caller.
+inline PlanResponse evaluate_requests(KeyGroup& group, const EvalPlan& plan, const std::vector<std::string>& outputs,
+                                      const std::vector<const PlanRequest*>& requests, const EvaluationOptions& options,
+                                      seal::MemoryPoolHandle pool = seal::MemoryManager::GetPool()) {
+    ProfilePhaseScope phase(ProfilePhase::evaluate);
+    const size_t slot_count = group.batch_encoder.slot_count();
+    const ResponsePacker& packer = group.packer(outputs.size());
+    bool replicated = requests.size() == 1 && requests[0]->layout.slot_width == slot_count;
+    bool mixed_sessions = false;
+    for (const PlanRequest* request : requests) mixed_sessions |= request->session_id != requests[0]->session_id;
+
+    int budget = fresh_noise_budget_estimate(group.context);
+    if (mixed_sessions) budget -= multiply_plain_noise_cost(group.context);
+    budget -= static_cast<int>(std::ceil(std::log2(static_cast<double>(requests.size()))));
+
+    std::vector<seal::Plaintext> range_masks;
+    if (mixed_sessions) {
+        range_masks.resize(requests.size());
+        for (size_t r = 0; r < requests.size(); r++) {
+            encode_slot_range(group.batch_encoder, requests[r]->layout.slot_offset, requests[r]->layout.slot_width, range_masks[r]);
+        }
+    }
+
+    std::map<std::string, seal::Ciphertext> combined;
+    std::map<std::string, seal::Plaintext> combined_plain;
+    PlanInputs inputs;
+    for (const auto& node : plan.nodes()) {
+        if (node.op == PlanOp::input) {
+            seal::Ciphertext& sum = combined.emplace(node.name, seal::Ciphertext(pool)).first->second;
+            seal::Ciphertext masked(pool);
+            for (size_t r = 0; r < requests.size(); r++) {
+                const seal::Ciphertext* term = &requests[r]->ciphertexts.at(node.name);
+                if (mixed_sessions) {
+                    group.evaluator.multiply_plain(*term, range_masks[r], masked, pool);
+                    term = &masked;
+                }
+                if (r == 0) {
+                    sum = *term;
+                } else {
+                    group.evaluator.add_inplace(sum, *term);
+                }
+            }
+            inputs.ciphertexts[node.name] = &sum;
+        } else if (node.op == PlanOp::plain_input) {
+            seal::Plaintext& plain = combined_plain[node.name];
+            if (replicated) {
+                plain = requests[0]->plaintexts.at(node.name);
+            } else {
+                std::vector<uint64_t> slots(slot_count, 0);
+                std::vector<uint64_t> decoded;
+                for (const PlanRequest* request : requests) {
+                    group.batch_encoder.decode(request->plaintexts.at(node.name), decoded, pool);
+                    for (size_t s = request->layout.slot_offset; s < request->layout.slot_offset + request->layout.slot_width; s++) {
+                        slots[s] = decoded[s];
+                    }
+                }
+                group.batch_encoder.encode(slots, plain);
+            }
+            inputs.plaintexts[node.name] = &plain;
+        }
+    }
+
+    PlanStats stats;
+    std::map<std::string, seal::Ciphertext> results =
+        execute_plan(plan, group.evaluator, &group.relin_keys, &group.galois_keys, inputs, &stats, pool);
+    budget -= static_cast<int>(stats.operations);
+
+    std::vector<const seal::Ciphertext*> ordered;
+    for (const auto& name : outputs) ordered.push_back(&results.at(name));
+    seal::Ciphertext packed(pool);
+    budget = packer.pack(group.evaluator, ordered, budget, packed, replicated, &group.galois_keys, pool);
+    budget = mod_switch_within_budget(group.context, group.evaluator, packed, budget, options.min_response_budget, pool);
+
+    ProfilePhaseScope saving(ProfilePhase::save);
+    BatchFrameWriter writer(group.context, packed.parms_id());
+    if (options.bit_drop) {
+        BitDrop drop = bit_drop_for_budget(*group.context.get_context_data(packed.parms_id()), budget, options.bit_drop_margin);
+        writer.add_bit_dropped(packed, drop.c0, drop.c1, pool);
+    } else {
+        writer.add(packed);
+    }
+
+    PlanResponse response;
+    response.header.status = ResponseStatus::ok;
+    response.header.result_count = static_cast<uint32_t>(outputs.size());
+    response.header.result_stride = static_cast<uint32_t>(packer.layout().width);
+    response.frame = std::make_shared<const std::string>(writer.finish());
+    response.batch_size = requests.size();
+    return response;
+}
+
+// Upper bound on what evaluate_requests costs for request_count requests: the
+// input masking and sums, the plan, packing, every modulus switch the chain
+// allows and the serialization. Peak memory covers the inputs and the plan's
+// intermediates.
+inline CostEstimate estimate_evaluation_cost(const seal::SEALContext& context, const CostModel& model, const EvalPlan& plan,
+                                             size_t output_count, size_t request_count, bool replicated, bool mixed_sessions) {
+    auto input_level = context.first_context_data();
+    size_t degree = input_level->parms().poly_modulus_degree();
+    size_t primes = input_level->parms().coeff_modulus().size();
+    size_t ciphertext_inputs = 0, plaintext_inputs = 0;
+    for (const auto& node : plan.nodes()) {
+        ciphertext_inputs += node.op == PlanOp::input ? 1 : 0;
+        plaintext_inputs += node.op == PlanOp::plain_input ? 1 : 0;
+    }
+    double r = static_cast<double>(request_count);
+    double count = static_cast<double>(output_count);
+
+    CostEstimate estimate = estimate_plan_cost(plan, model, *input_level);
+    double& us = estimate.microseconds;
+    if (mixed_sessions) us += r * static_cast<double>(ciphertext_inputs) * model.microseconds("multiply_plain", degree, primes);
+    us += (r - 1) * static_cast<double>(ciphertext_inputs) * model.microseconds("add", degree, primes);
+    if (!replicated) us += (r + 1) * static_cast<double>(plaintext_inputs) * model.microseconds("encode", degree, primes);
+    us += count * model.microseconds("multiply_plain", degree, primes) + (count - 1) * model.microseconds("add", degree, primes);
+    if (!replicated) us += (count - 1) * model.microseconds("rotate_rows", degree, primes);
+    for (size_t level = primes; level > 1; level--) us += model.microseconds("mod_switch", degree, level);
+    us += model.microseconds("save_result_bit_dropped", degree, primes);
+    estimate.input_bytes = request_count * ciphertext_inputs * ciphertext_bytes(2, degree, primes);
+    estimate.peak_bytes += estimate.input_bytes;
+    return estimate;
+}
+
+struct CoalescerStats {
+    size_t batches = 0;
+    size_t requests = 0;
+    size_t rejected = 0;  // too costly or refused for overload
+    SchedulerStats scheduler;
+};
+
+class RequestCoalescer {
+public:
+    // plan must be slot-wise; outputs names the plan outputs in response order.
+    // A window of zero disables coalescing.
+    RequestCoalescer(EvalPlan plan, std::vector<std::string> outputs, EvaluationOptions options,
+                     std::chrono::milliseconds window, CostModel cost_model = CostModel(),
+                     AdmissionOptions admission = AdmissionOptions(), size_t thread_count = 0)
+        : plan_(std::move(plan)), outputs_(std::move(outputs)), options_(options), window_(window),
+          cost_model_(std::move(cost_model)), admission_(admission),
+          scheduler_(thread_count, admission.quantum_microseconds, admission.max_queued_microseconds) {
+        if (!plan_is_slotwise(plan_)) throw std::invalid_argument("RequestCoalescer: plan must be slot-wise");
+        timer_ = std::thread([this]() { timer_loop(); });
+    }
+
+    ~RequestCoalescer() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        timer_.join();
+    }
+
+    RequestCoalescer(const RequestCoalescer&) = delete;
+    RequestCoalescer& operator=(const RequestCoalescer&) = delete;
+
+    // Queues a request whose inputs are already loaded. The future resolves
+    // once its batch has been evaluated; failures resolve to an error status.
+    std::future<PlanResponse> submit(std::shared_ptr<KeyGroup> group, PlanRequest request) {
+        auto pending = std::make_shared<Pending>();
+        pending->request = std::move(request);
+        std::future<PlanResponse> result = pending->promise.get_future();
+        const RequestHeader& layout = pending->request.layout;
+
+        for (const auto& node : plan_.nodes()) {
+            bool present = node.op == PlanOp::input ? pending->request.ciphertexts.count(node.name) != 0
+                           : node.op == PlanOp::plain_input ? pending->request.plaintexts.count(node.name) != 0
+                                                            : true;
+            if (!present) {
+                pending->promise.set_value(error_response(ResponseStatus::invalid_request));
+                return result;
+            }
+        }
+
+        size_t slot_count = group->batch_encoder.slot_count();
+        size_t capacity = group->packer(outputs_.size()).layout().width;
+        bool replicated = layout.slot_offset == 0 && layout.slot_width == slot_count;
+        if (!replicated && (layout.slot_width == 0 || layout.slot_offset >= capacity || layout.slot_width > capacity - layout.slot_offset)) {
+            pending->promise.set_value(error_response(ResponseStatus::invalid_request));
+            return result;
+        }
+
+        CostEstimate alone = estimate_cost(*group, 1, replicated, false);
+        if (alone.microseconds > admission_.max_request_microseconds) {
+            rejected_++;
+            pending->promise.set_value(error_response(ResponseStatus::too_costly));
+            return result;
+        }
+
+        auto batch = std::make_shared<Batch>();
+        batch->group = group;
+        if (replicated || window_.count() == 0) {
+            batch->pending.push_back(pending);
+            dispatch(batch);
+            return result;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& open : open_) {
+            if (open->group == group && open->fits(layout)) {
+                open->add(pending);
+                if (open->full()) cv_.notify_all();
+                return result;
+            }
+        }
+        batch->occupied.assign(capacity, 0);
+        batch->deadline = std::chrono::steady_clock::now() + window_;
+        batch->add(pending);
+        open_.push_back(batch);
+        cv_.notify_all();
+        return result;
+    }
+
+    // Estimated cost of evaluating request_count requests of group together.
+    CostEstimate estimate_cost(const KeyGroup& group, size_t request_count, bool replicated, bool mixed_sessions) const {
+        return estimate_evaluation_cost(group.context, cost_model_, plan_, outputs_.size(), request_count, replicated,
+                                        mixed_sessions);
+    }
+
+    CoalescerStats stats() const {
+        CoalescerStats stats;
+        stats.batches = batches_.load();
+        stats.requests = requests_.load();
+        stats.rejected = rejected_.load();
+        stats.scheduler = scheduler_.stats();
+        return stats;
+    }
+
+    // Batches waiting for a worker, per key holder (fingerprint).
+    std::vector<TenantQueue> queues() const { return scheduler_.tenant_queues(); }
+
+    // Batches being evaluated, with their estimated and elapsed time.
+    std::vector<RunningJob> running() const { return scheduler_.running_jobs(); }
+
+    // Requests still inside their coalescing window, per key holder.
+    std::map<std::string, size_t> coalescing() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::map<std::string, size_t> waiting;
+        for (const auto& batch : open_) waiting[batch->group->fingerprint] += batch->pending.size();
+        return waiting;
+    }
+
+private:
+    struct Pending {
+        PlanRequest request;
+        std::promise<PlanResponse> promise;
+    };
+
+    struct Batch {
+        std::shared_ptr<KeyGroup> group;
+        std::vector<std::shared_ptr<Pending>> pending;
+        std::vector<char> occupied; // per slot of the packer's range width
+        size_t used = 0;
+        std::chrono::steady_clock::time_point deadline;
+
+        bool fits(const RequestHeader& layout) const {
+            for (size_t s = layout.slot_offset; s < layout.slot_offset + layout.slot_width; s++) {
+                if (occupied[s]) return false;
+            }
+            return true;
+        }
+
+        void add(std::shared_ptr<Pending> request) {
+            const RequestHeader& layout = request->request.layout;
+            for (size_t s = layout.slot_offset; s < layout.slot_offset + layout.slot_width; s++) occupied[s] = 1;
+            used += layout.slot_width;
+            pending.push_back(std::move(request));
+        }
+
+        bool full() const { return used == occupied.size(); }
+    };
+
+    // Dispatches batches once their window has passed or they are full.
+    void timer_loop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            if (open_.empty()) {
+                if (stopping_) return;
+                cv_.wait(lock);
+                continue;
+            }
+            auto now = std::chrono::steady_clock::now();
+            auto earliest = open_.front()->deadline;
+            bool dispatched = false;
+            for (auto it = open_.begin(); it != open_.end(); ++it) {
+                if (stopping_ || (*it)->full() || (*it)->deadline <= now) {
+                    std::shared_ptr<Batch> batch = *it;
+                    open_.erase(it);
+                    dispatch(batch);
+                    dispatched = true;
+                    break;
+                }
+                if ((*it)->deadline < earliest) earliest = (*it)->deadline;
+            }
+            if (!dispatched) cv_.wait_until(lock, earliest);
+        }
+    }
+
+    // Queues a batch on the scheduler under its key holder, priced by the cost
+    // model; if the scheduler is full, every request of the batch is refused.
+    void dispatch(std::shared_ptr<Batch> batch) {
+        bool replicated = batch->pending.size() == 1 &&
+                          batch->pending[0]->request.layout.slot_width == batch->group->batch_encoder.slot_count();
+        bool mixed_sessions = false;
+        for (const auto& pending : batch->pending) {
+            mixed_sessions |= pending->request.session_id != batch->pending[0]->request.session_id;
+        }
+        double cost = estimate_cost(*batch->group, batch->pending.size(), replicated, mixed_sessions).microseconds;
+        if (!scheduler_.submit(batch->group->fingerprint, cost, [this, batch]() { run(*batch); })) {
+            rejected_ += batch->pending.size();
+            for (const auto& pending : batch->pending) {
+                PlanResponse refused = error_response(ResponseStatus::overloaded);
+                refused.header.slot_offset = pending->request.layout.slot_offset;
+                pending->promise.set_value(std::move(refused));
+            }
+        }
+    }
+
+    void run(Batch& batch) {
+        std::vector<const PlanRequest*> requests;
+        for (const auto& pending : batch.pending) requests.push_back(&pending->request);
+        // The batch runs in the pool of its first request's session
+        seal::MemoryPoolHandle pool = requests[0]->pool ? requests[0]->pool : seal::MemoryManager::GetPool();
+        PlanResponse response;
+        try {
+            KeyGroup::KeysInUse keys(*batch.group);
+            response = evaluate_requests(*batch.group, plan_, outputs_, requests, options_, pool);
+        } catch (const std::exception& e) {
+            // The client only sees server_error; the reason goes to the log
+            std::cerr << "Error: evaluation for key group " << batch.group->fingerprint.substr(0, 16) << " failed: " << e.what()
+                      << std::endl;
+            response = error_response(ResponseStatus::server_error);
+        }
+        batches_++;
+        requests_ += requests.size();
+        for (const auto& pending : batch.pending) {
+            PlanResponse own = response;
+            own.header.slot_offset = pending->request.layout.slot_offset;
+            pending->promise.set_value(std::move(own));
+        }
+    }
+
+    const EvalPlan plan_;
+    const std::vector<std::string> outputs_;
+    const EvaluationOptions options_;
+    const std::chrono::milliseconds window_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::shared_ptr<Batch>> open_;
+    bool stopping_ = false;
+    std::atomic<size_t> batches_{ 0 };
+    std::atomic<size_t> requests_{ 0 };
+    std::atomic<size_t> rejected_{ 0 };
+    const CostModel cost_model_;
+    const AdmissionOptions admission_;
+    FairScheduler scheduler_;
+    std::thread timer_;
+};
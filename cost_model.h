@@ -0,0 +1,213 @@
+#pragma once
+
+#include "seal/seal.h"
+#include "eval_plan.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// --- Cost Model ---
+// Expected CPU time and memory of homomorphic operations, so the server can
+// price a computation before it runs one. Each operation has a reference time
+// measured at some poly modulus degree N0 with k0 coefficient modulus primes
+// (benchmark --csv prints exactly these rows). Times at other parameter sets are
+// scaled by how the operation's work grows:
+//   elementwise (add, sub, add_plain, sub_plain):   N * k
+//   NTT-bound (multiply_plain, multiply, mod_switch,
+//              encode, serialization):              N * log2(N) * k
+//   key switching (relinearize, rotate_rows):       N * log2(N) * k * (k + 1)
+// A ciphertext of size s at k primes occupies s * N * k * 8 bytes.
+
+enum class CostScaling { elementwise, ntt, key_switch };
+
+inline CostScaling cost_scaling(const std::string& operation) {
+    if (operation == "add" || operation == "sub" || operation == "add_plain" || operation == "sub_plain") {
+        return CostScaling::elementwise;
+    }
+    if (operation == "relinearize" || operation == "rotate_rows") return CostScaling::key_switch;
+    return CostScaling::ntt;
+}
+
+inline const char* plan_op_name(PlanOp op) {
+    switch (op) {
+    case PlanOp::add: return "add";
+    case PlanOp::sub: return "sub";
+    case PlanOp::add_plain: return "add_plain";
+    case PlanOp::sub_plain: return "sub_plain";
+    case PlanOp::multiply: return "multiply";
+    case PlanOp::multiply_plain: return "multiply_plain";
+    case PlanOp::relinearize: return "relinearize";
+    case PlanOp::rotate_rows: return "rotate_rows";
+    case PlanOp::mod_switch: return "mod_switch";
+    default: return "";
+    }
+}
+
+inline size_t ciphertext_bytes(size_t size, size_t degree, size_t primes) {
+    return size * degree * primes * sizeof(uint64_t);
+}
+
+class CostModel {
+public:
+    // Rough figures for a portable SEAL build on a current x86-64 core at
+    // N = 8192 with 4 data primes. Calibrate with set() or from_benchmark_csv()
+    // for real use.
+    CostModel() {
+        const size_t degree = 8192, primes = 4;
+        set("add", degree, primes, 15);
+        set("sub", degree, primes, 15);
+        set("add_plain", degree, primes, 30);
+        set("sub_plain", degree, primes, 30);
+        set("multiply_plain", degree, primes, 350);
+        set("multiply", degree, primes, 2500);
+        set("relinearize", degree, primes, 900);
+        set("rotate_rows", degree, primes, 900);
+        set("mod_switch", degree, primes, 200);
+        set("encode", degree, primes, 60);
+        set("save_result_bit_dropped", degree, primes, 400);
+    }
+
+    // Reads benchmark --csv output ("operation,degree,kernels,microseconds").
+    // The benchmark runs at CoeffModulus::BFVDefault(degree), i.e. with all of
+    // its primes but the special one. Rows for operations the model does not
+    // price are ignored; operations without a row keep their defaults.
+    static CostModel from_benchmark_csv(std::istream& in) {
+        CostModel model;
+        std::string line;
+        size_t used = 0;
+        while (std::getline(in, line)) {
+            std::vector<std::string> fields;
+            std::stringstream row(line);
+            for (std::string field; std::getline(row, field, ',');) fields.push_back(field);
+            if (fields.size() != 4 || fields[0] == "operation" || !model.prices(fields[0])) continue;
+            try {
+                size_t degree = std::stoul(fields[1]);
+                size_t primes = seal::CoeffModulus::BFVDefault(degree).size() - 1;
+                model.set(fields[0], degree, primes, std::stod(fields[3]));
+                used++;
+            } catch (const std::exception&) {
+                throw std::invalid_argument("CostModel: malformed benchmark row: " + line);
+            }
+        }
+        if (used == 0) throw std::invalid_argument("CostModel: no usable benchmark rows");
+        return model;
+    }
+
+    void set(const std::string& operation, size_t degree, size_t primes, double microseconds) {
+        references_[operation] = Reference{ degree, primes, microseconds };
+    }
+
+    bool prices(const std::string& operation) const { return references_.count(operation) != 0; }
+
+    // Expected time of one operation on ciphertexts with primes primes at degree.
+    double microseconds(const std::string& operation, size_t degree, size_t primes) const {
+        auto found = references_.find(operation);
+        if (found == references_.end()) throw std::invalid_argument("CostModel: no cost for " + operation);
+        const Reference& ref = found->second;
+        return ref.microseconds * work(cost_scaling(operation), degree, primes) /
+               work(cost_scaling(operation), ref.degree, ref.primes);
+    }
+
+private:
+    struct Reference {
+        size_t degree;
+        size_t primes;
+        double microseconds;
+    };
+
+    static double work(CostScaling scaling, size_t degree, size_t primes) {
+        double n = static_cast<double>(degree);
+        double k = static_cast<double>(primes);
+        switch (scaling) {
+        case CostScaling::elementwise: return n * k;
+        case CostScaling::ntt: return n * std::log2(n) * k;
+        case CostScaling::key_switch: return n * std::log2(n) * k * (k + 1);
+        }
+        return n * k;
+    }
+
+    std::map<std::string, Reference> references_;
+};
+
+struct CostEstimate {
+    double microseconds = 0;
+    size_t peak_bytes = 0; // largest amount of intermediate ciphertext data alive at once
+    size_t input_bytes = 0; // encrypted inputs, when the estimate includes them
+    size_t key_switches = 0;
+
+    CostEstimate& operator+=(const CostEstimate& other) {
+        microseconds += other.microseconds;
+        peak_bytes = std::max(peak_bytes, other.peak_bytes);
+        input_bytes += other.input_bytes;
+        key_switches += other.key_switches;
+        return *this;
+    }
+};
+
+// Walks plan the way execute_plan runs it, with encrypted inputs at
+// input_level, tracking each ciphertext's size and prime count. Intermediates
+// are freed after their last consumer, as in execute_plan; inputs are not
+// counted since the caller owns them.
+inline CostEstimate estimate_plan_cost(const EvalPlan& plan, const CostModel& model,
+                                       const seal::SEALContext::ContextData& input_level) {
+    const auto& nodes = plan.nodes();
+    size_t degree = input_level.parms().poly_modulus_degree();
+    std::vector<size_t> last_use(nodes.size(), 0);
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i].lhs >= 0) last_use[static_cast<size_t>(nodes[i].lhs)] = i;
+        if (nodes[i].rhs >= 0) last_use[static_cast<size_t>(nodes[i].rhs)] = i;
+    }
+
+    std::vector<size_t> sizes(nodes.size(), 2);
+    std::vector<size_t> primes(nodes.size(), input_level.parms().coeff_modulus().size());
+    std::vector<size_t> owned_bytes(nodes.size(), 0);
+    size_t live_bytes = 0;
+    CostEstimate estimate;
+    for (size_t i = 0; i < nodes.size(); i++) {
+        const PlanNode& node = nodes[i];
+        if (node.op == PlanOp::input || node.op == PlanOp::plain_input) continue;
+        size_t lhs = static_cast<size_t>(node.lhs);
+        sizes[i] = sizes[lhs];
+        primes[i] = primes[lhs];
+        switch (node.op) {
+        case PlanOp::add:
+        case PlanOp::sub:
+            sizes[i] = std::max(sizes[lhs], sizes[static_cast<size_t>(node.rhs)]);
+            break;
+        case PlanOp::multiply:
+            sizes[i] = sizes[lhs] + sizes[static_cast<size_t>(node.rhs)] - 1;
+            break;
+        case PlanOp::relinearize:
+            sizes[i] = 2;
+            estimate.key_switches++;
+            break;
+        case PlanOp::rotate_rows:
+            estimate.key_switches++;
+            break;
+        case PlanOp::mod_switch:
+            primes[i] = primes[lhs] - 1;
+            break;
+        default:
+            break;
+        }
+        if (node.op != PlanOp::output) {
+            estimate.microseconds += model.microseconds(plan_op_name(node.op), degree, primes[lhs]);
+        }
+        owned_bytes[i] = ciphertext_bytes(sizes[i], degree, primes[i]);
+        live_bytes += owned_bytes[i];
+        estimate.peak_bytes = std::max(estimate.peak_bytes, live_bytes);
+        for (int operand : { node.lhs, node.rhs }) {
+            if (operand >= 0 && last_use[static_cast<size_t>(operand)] == i) {
+                live_bytes -= owned_bytes[static_cast<size_t>(operand)];
+                owned_bytes[static_cast<size_t>(operand)] = 0;
+            }
+        }
+    }
+    return estimate;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "seal/seal.h"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+// --- Deterministic Randomness ---
+// Keys and ciphertexts normally draw fresh randomness, so compressed sizes and
+// some timings differ from run to run. Test and benchmark builds configured
+// with -DFHE_DETERMINISTIC_RNG=ON can install a seeded generator factory on the
+// encryption parameters instead: with the same seed and the same sequence of
+// keygen and encryption calls, every object comes out byte for byte the same,
+// which makes golden files and stable benchmark comparisons possible.
+//
+// Seeded randomness is not secret, so this must never reach a server or client
+// that handles real data. CMake defines FHE_PRODUCTION_BUILD for the
+// applications and FHE_DETERMINISTIC_RNG for the benchmark only; the
+// applications include this header, and the build fails if both are set.
+
+#if defined(FHE_DETERMINISTIC_RNG) && defined(FHE_PRODUCTION_BUILD)
+#error "FHE_DETERMINISTIC_RNG must not be enabled in production builds (server_app, client_app, replay_app)"
+#endif
+
+#if defined(FHE_DETERMINISTIC_RNG)
+// Each generator gets the seed (seed, n) for the n-th generator created, so
+// successive keys and encryptions use different but reproducible streams.
+// Reproducible only while generators are created in the same order, i.e. not
+// across the threads of create_galois_keys_parallel.
+class SeededGeneratorFactory : public seal::UniformRandomGeneratorFactory {
+public:
+    explicit SeededGeneratorFactory(uint64_t seed) : seed_(seed) {}
+
+protected:
+    std::shared_ptr<seal::UniformRandomGenerator> create_impl(seal::prng_seed_type) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        seal::prng_seed_type seed = {};
+        seed[0] = seed_;
+        seed[1] = ++created_;
+        return std::make_shared<seal::Blake2xbPRNG>(seed);
+    }
+
+private:
+    const uint64_t seed_;
+    uint64_t created_ = 0;
+    std::mutex mutex_;
+};
+
+// Makes every context built from parms afterwards draw its randomness from seed.
+inline void use_deterministic_rng(seal::EncryptionParameters& parms, uint64_t seed) {
+    parms.set_random_generator(std::make_shared<SeededGeneratorFactory>(seed));
+}
+#endif
@@ -0,0 +1,279 @@
+#pragma once
+
+#include "seal/seal.h"
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// --- Evaluation Plans ---
+// The server's homomorphic computation is described as a small graph of
+// operations (an EvalPlan) and executed by execute_plan(). Keeping the graph
+// explicit lets optimization passes such as lazy_relinearize() rewrite it before
+// any ciphertext is touched.
+
+enum class PlanOp {
+    input,          // encrypted input, looked up by name
+    plain_input,    // plaintext input, looked up by name
+    add,
+    sub,
+    add_plain,
+    sub_plain,
+    multiply,
+    multiply_plain,
+    relinearize,
+    rotate_rows,
+    mod_switch,     // mod_switch_to_next
+    output          // result sent back to the client, by name
+};
+
+struct PlanNode {
+    PlanOp op;
+    int lhs = -1;       // first operand (node index)
+    int rhs = -1;       // second operand: ciphertext node, or plain_input node for *_plain
+    int steps = 0;      // rotate_rows step count
+    std::string name;   // input/output name
+};
+
+class EvalPlan {
+public:
+    int input(const std::string& name) { return push({ PlanOp::input, -1, -1, 0, name }); }
+    int plain_input(const std::string& name) { return push({ PlanOp::plain_input, -1, -1, 0, name }); }
+    int add(int a, int b) { return push({ PlanOp::add, a, b, 0, "" }); }
+    int sub(int a, int b) { return push({ PlanOp::sub, a, b, 0, "" }); }
+    int add_plain(int a, int plain) { return push({ PlanOp::add_plain, a, plain, 0, "" }); }
+    int sub_plain(int a, int plain) { return push({ PlanOp::sub_plain, a, plain, 0, "" }); }
+    int multiply(int a, int b) { return push({ PlanOp::multiply, a, b, 0, "" }); }
+    int multiply_plain(int a, int plain) { return push({ PlanOp::multiply_plain, a, plain, 0, "" }); }
+    int relinearize(int a) { return push({ PlanOp::relinearize, a, -1, 0, "" }); }
+    int rotate_rows(int a, int steps) { return push({ PlanOp::rotate_rows, a, -1, steps, "" }); }
+    int mod_switch(int a) { return push({ PlanOp::mod_switch, a, -1, 0, "" }); }
+    void output(int a, const std::string& name) { push({ PlanOp::output, a, -1, 0, name }); }
+
+    const std::vector<PlanNode>& nodes() const { return nodes_; }
+
+    // Key switches the plan performs: one per relinearize and per rotation.
+    size_t key_switch_count() const {
+        size_t count = 0;
+        for (const auto& node : nodes_) {
+            if (node.op == PlanOp::relinearize || node.op == PlanOp::rotate_rows) count++;
+        }
+        return count;
+    }
+
+private:
+    int push(PlanNode node) {
+        int index = static_cast<int>(nodes_.size());
+        bool unary = node.op == PlanOp::relinearize || node.op == PlanOp::rotate_rows || node.op == PlanOp::mod_switch ||
+                     node.op == PlanOp::output;
+        bool binary = node.op != PlanOp::input && node.op != PlanOp::plain_input && !unary;
+        if ((unary || binary) && (node.lhs < 0 || node.lhs >= index)) {
+            throw std::invalid_argument("EvalPlan: operand must refer to an earlier node");
+        }
+        if (binary && (node.rhs < 0 || node.rhs >= index)) {
+            throw std::invalid_argument("EvalPlan: operand must refer to an earlier node");
+        }
+        nodes_.push_back(node);
+        return index;
+    }
+
+    std::vector<PlanNode> nodes_;
+};
+
+// True if every operation works slot by slot (no rotations), so the plan gives
+// the same per-slot results when unrelated inputs occupy the other slots.
+inline bool plan_is_slotwise(const EvalPlan& plan) {
+    for (const auto& node : plan.nodes()) {
+        if (node.op == PlanOp::rotate_rows) return false;
+    }
+    return true;
+}
+
+// --- Lazy Relinearization Pass ---
+// Drops the relinearize after each multiply and re-inserts one only where a
+// size-3 ciphertext has to become size 2 again: before it is rotated, multiplied
+// again or serialized as an output. Sums and differences of products stay
+// unrelinearized, so a sum of k products costs one key switch instead of k.
+// Modulus switching does not force a relinearize, so it lands below the switch
+// and runs over fewer primes.
+inline EvalPlan lazy_relinearize(const EvalPlan& plan) {
+    EvalPlan optimized;
+    const auto& nodes = plan.nodes();
+    std::vector<int> remap(nodes.size(), -1);
+    std::vector<bool> extended;          // per optimized node: ciphertext has size > 2
+    std::map<int, int> relinearized;     // optimized node -> its relinearized copy
+
+    auto track = [&](int index, bool is_extended) {
+        extended.resize(static_cast<size_t>(index) + 1, false);
+        extended[static_cast<size_t>(index)] = is_extended;
+        return index;
+    };
+    // Returns a size-2 version of an optimized node, sharing one relinearize
+    // between all consumers that need it.
+    auto linear = [&](int index) {
+        if (!extended[static_cast<size_t>(index)]) return index;
+        auto found = relinearized.find(index);
+        if (found != relinearized.end()) return found->second;
+        int relin = track(optimized.relinearize(index), false);
+        relinearized[index] = relin;
+        return relin;
+    };
+
+    for (size_t i = 0; i < nodes.size(); i++) {
+        const PlanNode& node = nodes[i];
+        int lhs = node.lhs >= 0 ? remap[static_cast<size_t>(node.lhs)] : -1;
+        int rhs = node.rhs >= 0 ? remap[static_cast<size_t>(node.rhs)] : -1;
+        switch (node.op) {
+        case PlanOp::input:
+            remap[i] = track(optimized.input(node.name), false);
+            break;
+        case PlanOp::plain_input:
+            remap[i] = track(optimized.plain_input(node.name), false);
+            break;
+        case PlanOp::add:
+            remap[i] = track(optimized.add(lhs, rhs), extended[lhs] || extended[rhs]);
+            break;
+        case PlanOp::sub:
+            remap[i] = track(optimized.sub(lhs, rhs), extended[lhs] || extended[rhs]);
+            break;
+        case PlanOp::add_plain:
+            remap[i] = track(optimized.add_plain(lhs, rhs), extended[lhs]);
+            break;
+        case PlanOp::sub_plain:
+            remap[i] = track(optimized.sub_plain(lhs, rhs), extended[lhs]);
+            break;
+        case PlanOp::multiply_plain:
+            remap[i] = track(optimized.multiply_plain(lhs, rhs), extended[lhs]);
+            break;
+        case PlanOp::multiply:
+            remap[i] = track(optimized.multiply(linear(lhs), linear(rhs)), true);
+            break;
+        case PlanOp::relinearize:
+            remap[i] = lhs; // deferred until a consumer needs size 2
+            break;
+        case PlanOp::rotate_rows:
+            remap[i] = track(optimized.rotate_rows(linear(lhs), node.steps), false);
+            break;
+        case PlanOp::mod_switch:
+            remap[i] = track(optimized.mod_switch(lhs), extended[lhs]);
+            break;
+        case PlanOp::output:
+            optimized.output(linear(lhs), node.name);
+            break;
+        }
+    }
+    return optimized;
+}
+
+// --- Plan Execution ---
+struct PlanInputs {
+    std::map<std::string, const seal::Ciphertext*> ciphertexts;
+    std::map<std::string, const seal::Plaintext*> plaintexts;
+};
+
+struct PlanStats {
+    size_t operations = 0;
+    size_t relinearizations = 0;
+    size_t rotations = 0;
+    size_t key_switches() const { return relinearizations + rotations; }
+};
+
+// Runs a plan and returns its outputs by name. Intermediates are released as soon
+// as their last consumer has run. Throws std::invalid_argument for missing inputs
+// or keys the plan needs.
+inline std::map<std::string, seal::Ciphertext> execute_plan(const EvalPlan& plan, const seal::Evaluator& evaluator,
+                                                            const seal::RelinKeys* relin_keys,
+                                                            const seal::GaloisKeys* galois_keys, const PlanInputs& inputs,
+                                                            PlanStats* stats = nullptr,
+                                                            seal::MemoryPoolHandle pool = seal::MemoryManager::GetPool()) {
+    const auto& nodes = plan.nodes();
+    std::vector<size_t> last_use(nodes.size(), 0);
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i].lhs >= 0) last_use[static_cast<size_t>(nodes[i].lhs)] = i;
+        if (nodes[i].rhs >= 0) last_use[static_cast<size_t>(nodes[i].rhs)] = i;
+    }
+
+    std::vector<seal::Ciphertext> values(nodes.size(), seal::Ciphertext(pool));
+    std::vector<const seal::Ciphertext*> refs(nodes.size(), nullptr);  // inputs are used in place
+    std::vector<const seal::Plaintext*> plains(nodes.size(), nullptr);
+    std::map<std::string, seal::Ciphertext> outputs;
+    PlanStats local_stats;
+
+    for (size_t i = 0; i < nodes.size(); i++) {
+        const PlanNode& node = nodes[i];
+        const seal::Ciphertext* lhs = node.lhs >= 0 ? refs[static_cast<size_t>(node.lhs)] : nullptr;
+        const seal::Ciphertext* rhs = node.rhs >= 0 ? refs[static_cast<size_t>(node.rhs)] : nullptr;
+        const seal::Plaintext* plain = node.rhs >= 0 ? plains[static_cast<size_t>(node.rhs)] : nullptr;
+        seal::Ciphertext& dest = values[i];
+
+        switch (node.op) {
+        case PlanOp::input: {
+            auto found = inputs.ciphertexts.find(node.name);
+            if (found == inputs.ciphertexts.end() || !found->second) {
+                throw std::invalid_argument("execute_plan: missing encrypted input " + node.name);
+            }
+            refs[i] = found->second;
+            continue;
+        }
+        case PlanOp::plain_input: {
+            auto found = inputs.plaintexts.find(node.name);
+            if (found == inputs.plaintexts.end() || !found->second) {
+                throw std::invalid_argument("execute_plan: missing plaintext input " + node.name);
+            }
+            plains[i] = found->second;
+            continue;
+        }
+        case PlanOp::add:
+            evaluator.add(*lhs, *rhs, dest);
+            break;
+        case PlanOp::sub:
+            evaluator.sub(*lhs, *rhs, dest);
+            break;
+        case PlanOp::add_plain:
+            evaluator.add_plain(*lhs, *plain, dest, pool);
+            break;
+        case PlanOp::sub_plain:
+            evaluator.sub_plain(*lhs, *plain, dest, pool);
+            break;
+        case PlanOp::multiply:
+            evaluator.multiply(*lhs, *rhs, dest, pool);
+            break;
+        case PlanOp::multiply_plain:
+            evaluator.multiply_plain(*lhs, *plain, dest, pool);
+            break;
+        case PlanOp::relinearize:
+            if (!relin_keys) throw std::invalid_argument("execute_plan: plan relinearizes but no RelinKeys were given");
+            evaluator.relinearize(*lhs, *relin_keys, dest, pool);
+            local_stats.relinearizations++;
+            break;
+        case PlanOp::rotate_rows:
+            if (!galois_keys) throw std::invalid_argument("execute_plan: plan rotates but no GaloisKeys were given");
+            evaluator.rotate_rows(*lhs, node.steps, *galois_keys, dest, pool);
+            local_stats.rotations++;
+            break;
+        case PlanOp::mod_switch:
+            evaluator.mod_switch_to_next(*lhs, dest, pool);
+            break;
+        case PlanOp::output:
+            if (last_use[static_cast<size_t>(node.lhs)] == i && lhs == &values[static_cast<size_t>(node.lhs)]) {
+                outputs[node.name] = std::move(values[static_cast<size_t>(node.lhs)]);
+            } else {
+                outputs[node.name] = *lhs;
+            }
+            break;
+        }
+        local_stats.operations++;
+        refs[i] = &dest;
+
+        // Free operands whose last consumer was this node (inputs are not owned).
+        for (int operand : { node.lhs, node.rhs }) {
+            if (operand >= 0 && last_use[static_cast<size_t>(operand)] == i) {
+                values[static_cast<size_t>(operand)].release();
+            }
+        }
+    }
+
+    if (stats) *stats = local_stats;
+    return outputs;
+}
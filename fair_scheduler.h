@@ -0,0 +1,224 @@
+#pragma once
+
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// --- Fair Scheduler ---
+// Worker threads that share CPU time between tenants (key holders) by deficit
+// round robin over estimated job costs: each turn a tenant's credit grows by
+// quantum microseconds, and it may start jobs while its credit covers their
+// cost. A tenant that floods the server with jobs therefore gets the same share
+// of the workers as one that sends a few, instead of everything running in
+// arrival order. Admission is bounded by the total estimated cost waiting in
+// the queues; a job that would push it over max_queued is refused.
+
+struct SchedulerStats {
+    size_t queued_jobs = 0;
+    double queued_microseconds = 0;  // estimated cost of the jobs waiting
+    size_t running_jobs = 0;
+    size_t completed_jobs = 0;
+    size_t refused_jobs = 0;
+    size_t workers = 0;
+    double busy_microseconds = 0;    // worker time spent in jobs, including those running
+    double uptime_microseconds = 0;  // since the workers started
+};
+
+// Jobs waiting for one tenant
+struct TenantQueue {
+    std::string tenant;
+    size_t jobs = 0;
+    double microseconds = 0; // estimated cost
+};
+
+// A job a worker is running: its estimated and elapsed time
+struct RunningJob {
+    std::string tenant;
+    double cost_microseconds = 0;
+    double elapsed_microseconds = 0;
+};
+
+class FairScheduler {
+public:
+    FairScheduler(size_t thread_count, double quantum_microseconds, double max_queued_microseconds)
+        : quantum_(quantum_microseconds), max_queued_(max_queued_microseconds), started_(std::chrono::steady_clock::now()) {
+        if (thread_count == 0) thread_count = default_thread_count();
+        running_slots_.resize(thread_count);
+        for (size_t i = 0; i < thread_count; i++) {
+            workers_.emplace_back([this, i]() { worker_loop(i); });
+        }
+    }
+
+    // Runs the jobs still queued, then stops the workers.
+    ~FairScheduler() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    FairScheduler(const FairScheduler&) = delete;
+    FairScheduler& operator=(const FairScheduler&) = delete;
+
+    // Queues job for tenant. Returns false, without queuing it, if the
+    // estimated cost waiting would exceed the admission limit.
+    bool submit(const std::string& tenant, double cost_microseconds, std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (queued_cost_ > 0 && queued_cost_ + cost_microseconds > max_queued_) {
+                refused_++;
+                return false;
+            }
+            Tenant& queue = tenants_[tenant];
+            if (queue.jobs.empty()) active_.push_back(tenant);
+            queue.jobs.push_back({ tenant, cost_microseconds, std::move(job) });
+            queued_cost_ += cost_microseconds;
+            queued_jobs_++;
+        }
+        cv_.notify_one();
+        return true;
+    }
+
+    size_t size() const { return workers_.size(); }
+
+    SchedulerStats stats() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        SchedulerStats stats;
+        stats.queued_jobs = queued_jobs_;
+        stats.queued_microseconds = queued_cost_;
+        stats.running_jobs = running_;
+        stats.completed_jobs = completed_;
+        stats.refused_jobs = refused_;
+        stats.workers = workers_.size();
+        auto now = std::chrono::steady_clock::now();
+        stats.busy_microseconds = busy_microseconds_;
+        for (const auto& slot : running_slots_) {
+            if (slot.active) stats.busy_microseconds += microseconds_between(slot.started, now);
+        }
+        stats.uptime_microseconds = microseconds_between(started_, now);
+        return stats;
+    }
+
+    // Queued jobs per tenant, in round-robin order.
+    std::vector<TenantQueue> tenant_queues() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<TenantQueue> queues;
+        for (const auto& tenant : active_) {
+            const Tenant& queue = tenants_.at(tenant);
+            TenantQueue entry{ tenant, queue.jobs.size(), 0 };
+            for (const auto& job : queue.jobs) entry.microseconds += job.cost;
+            queues.push_back(entry);
+        }
+        return queues;
+    }
+
+    std::vector<RunningJob> running_jobs() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = std::chrono::steady_clock::now();
+        std::vector<RunningJob> jobs;
+        for (const auto& slot : running_slots_) {
+            if (slot.active) jobs.push_back({ slot.tenant, slot.cost, microseconds_between(slot.started, now) });
+        }
+        return jobs;
+    }
+
+private:
+    struct Job {
+        std::string tenant;
+        double cost = 0;
+        std::function<void()> job;
+    };
+
+    struct Tenant {
+        std::deque<Job> jobs;
+        double deficit = 0;
+    };
+
+    // Takes the next job by deficit round robin. Called with the lock held and
+    // at least one job queued.
+    Job next_job() {
+        while (true) {
+            const std::string tenant = active_.front();
+            Tenant& queue = tenants_[tenant];
+            if (queue.deficit < queue.jobs.front().cost) {
+                queue.deficit += quantum_;
+                active_.pop_front();
+                active_.push_back(tenant);
+                continue;
+            }
+            Job job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+            queue.deficit -= job.cost;
+            if (queue.jobs.empty()) {
+                tenants_.erase(tenant);
+                active_.pop_front();
+            }
+            return job;
+        }
+    }
+
+    struct RunningSlot {
+        bool active = false;
+        std::string tenant;
+        double cost = 0;
+        std::chrono::steady_clock::time_point started;
+    };
+
+    static double microseconds_between(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to) {
+        return std::chrono::duration<double, std::micro>(to - from).count();
+    }
+
+    void worker_loop(size_t worker) {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this]() { return stopping_ || queued_jobs_ > 0; });
+                if (queued_jobs_ == 0) return;
+                job = next_job();
+                queued_cost_ = std::max(0.0, queued_cost_ - job.cost);
+                queued_jobs_--;
+                running_++;
+                running_slots_[worker] = { true, job.tenant, job.cost, std::chrono::steady_clock::now() };
+            }
+            job.job(); // jobs report their own failures
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                running_--;
+                completed_++;
+                RunningSlot& slot = running_slots_[worker];
+                busy_microseconds_ += microseconds_between(slot.started, std::chrono::steady_clock::now());
+                slot.active = false;
+            }
+        }
+    }
+
+    const double quantum_;
+    const double max_queued_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::map<std::string, Tenant> tenants_;
+    std::deque<std::string> active_;     // tenants with queued jobs, in round-robin order
+    double queued_cost_ = 0;
+    size_t queued_jobs_ = 0;
+    size_t running_ = 0;
+    size_t completed_ = 0;
+    size_t refused_ = 0;
+    double busy_microseconds_ = 0;  // finished jobs
+    const std::chrono::steady_clock::time_point started_;
+    std::vector<RunningSlot> running_slots_; // per worker
+    bool stopping_ = false;
+    std::vector<std::thread> workers_;
+};
@@ -0,0 +1,184 @@
+#pragma once
+
+#include "seal/seal.h"
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FHE_FIXED_POINT_AVX2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FHE_FIXED_POINT_NEON 1
+#endif
+
+// --- Fixed-Point Conversion Kernels ---
+// Amounts travel as round(amount * SCALE_FACTOR) in int64 slots. These kernels do
+// that conversion (and the reverse after decoding) over whole arrays. On x86-64 an
+// AVX2 path is picked at runtime when the CPU has it; on AArch64 NEON is always
+// available. Every path returns bit-identical results to the scalar loop
+// (std::round half away from zero, then static_cast; decode is a true division).
+
+// Largest magnitude an amount may have once scaled: batching slots hold values
+// in (-t/2, t/2) for plain modulus t.
+inline int64_t fixed_point_limit(const seal::Modulus& plain_modulus) {
+    return static_cast<int64_t>((plain_modulus.value() - 1) / 2);
+}
+
+inline size_t to_fixed_point_scalar(const double* in, size_t count, double scale, int64_t max_abs, int64_t* out) {
+    for (size_t i = 0; i < count; i++) {
+        double scaled = std::round(in[i] * scale);
+        if (!(std::fabs(scaled) <= static_cast<double>(max_abs))) return i; // also rejects NaN and inf
+        out[i] = static_cast<int64_t>(scaled);
+    }
+    return count;
+}
+
+inline void from_fixed_point_scalar(const int64_t* in, size_t count, double scale, double* out) {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = static_cast<double>(in[i]) / scale;
+    }
+}
+
+#if defined(FHE_FIXED_POINT_AVX2)
+// 2^52 + 2^51: adding it to an integral double |x| <= 2^51 leaves x in the low
+// mantissa bits, so double <-> int64 becomes one add/sub on the bit patterns.
+const double FIXED_POINT_MAGIC = 6755399441055744.0;
+const int64_t FIXED_POINT_MAGIC_RANGE = int64_t(1) << 51;
+
+__attribute__((target("avx2")))
+inline size_t to_fixed_point_avx2(const double* in, size_t count, double scale, int64_t max_abs, int64_t* out) {
+    // Callers keep max_abs far below 2^51; clamp so the magic-number trick stays exact.
+    double limit = static_cast<double>(max_abs < FIXED_POINT_MAGIC_RANGE ? max_abs : FIXED_POINT_MAGIC_RANGE);
+    const __m256d scale_v = _mm256_set1_pd(scale);
+    const __m256d limit_v = _mm256_set1_pd(limit);
+    const __m256d sign_mask = _mm256_set1_pd(-0.0);
+    const __m256d almost_half = _mm256_set1_pd(0.49999999999999994);
+    const __m256d magic = _mm256_set1_pd(FIXED_POINT_MAGIC);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256d scaled = _mm256_mul_pd(_mm256_loadu_pd(in + i), scale_v);
+        // round() == trunc(x + copysign(0.5 - ulp, x)) for every double
+        __m256d half = _mm256_or_pd(_mm256_and_pd(scaled, sign_mask), almost_half);
+        __m256d rounded = _mm256_round_pd(_mm256_add_pd(scaled, half), _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC);
+        __m256d in_range = _mm256_cmp_pd(_mm256_andnot_pd(sign_mask, rounded), limit_v, _CMP_LE_OQ);
+        if (_mm256_movemask_pd(in_range) != 0xF) {
+            // Let the scalar loop pinpoint the offending element (or accept
+            // magnitudes between the clamp and max_abs).
+            size_t converted = to_fixed_point_scalar(in + i, 4, scale, max_abs, out + i);
+            if (converted < 4) return i + converted;
+            continue;
+        }
+        __m256i bits = _mm256_sub_epi64(_mm256_castpd_si256(_mm256_add_pd(rounded, magic)), _mm256_castpd_si256(magic));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), bits);
+    }
+    size_t tail = to_fixed_point_scalar(in + i, count - i, scale, max_abs, out + i);
+    return i + tail;
+}
+
+__attribute__((target("avx2")))
+inline void from_fixed_point_avx2(const int64_t* in, size_t count, double scale, double* out) {
+    const __m256d scale_v = _mm256_set1_pd(scale);
+    const __m256d magic = _mm256_set1_pd(FIXED_POINT_MAGIC);
+    const __m256i upper = _mm256_set1_epi64x(FIXED_POINT_MAGIC_RANGE);
+    const __m256i lower = _mm256_set1_epi64x(-FIXED_POINT_MAGIC_RANGE);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        __m256i out_of_range = _mm256_or_si256(_mm256_cmpgt_epi64(values, upper), _mm256_cmpgt_epi64(lower, values));
+        if (!_mm256_testz_si256(out_of_range, out_of_range)) {
+            from_fixed_point_scalar(in + i, 4, scale, out + i);
+            continue;
+        }
+        __m256d as_double = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_add_epi64(values, _mm256_castpd_si256(magic))), magic);
+        _mm256_storeu_pd(out + i, _mm256_div_pd(as_double, scale_v));
+    }
+    from_fixed_point_scalar(in + i, count - i, scale, out + i);
+}
+
+inline bool cpu_has_avx2() {
+    static const bool has_avx2 = []() {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+    }();
+    return has_avx2;
+}
+#endif
+
+#if defined(FHE_FIXED_POINT_NEON)
+inline size_t to_fixed_point_neon(const double* in, size_t count, double scale, int64_t max_abs, int64_t* out) {
+    const float64x2_t scale_v = vdupq_n_f64(scale);
+    const float64x2_t limit_v = vdupq_n_f64(static_cast<double>(max_abs));
+
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        // vrndaq rounds half away from zero, exactly like std::round
+        float64x2_t rounded = vrndaq_f64(vmulq_f64(vld1q_f64(in + i), scale_v));
+        uint64x2_t in_range = vcaleq_f64(rounded, limit_v);
+        if (vminvq_u32(vreinterpretq_u32_u64(in_range)) == 0) {
+            size_t converted = to_fixed_point_scalar(in + i, 2, scale, max_abs, out + i);
+            if (converted < 2) return i + converted;
+            continue;
+        }
+        vst1q_s64(out + i, vcvtq_s64_f64(rounded));
+    }
+    size_t tail = to_fixed_point_scalar(in + i, count - i, scale, max_abs, out + i);
+    return i + tail;
+}
+
+inline void from_fixed_point_neon(const int64_t* in, size_t count, double scale, double* out) {
+    const float64x2_t scale_v = vdupq_n_f64(scale);
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        vst1q_f64(out + i, vdivq_f64(vcvtq_f64_s64(vld1q_s64(in + i)), scale_v));
+    }
+    from_fixed_point_scalar(in + i, count - i, scale, out + i);
+}
+#endif
+
+// Converts count amounts to scaled int64 values. Returns the index of the first
+// amount that is not finite or whose scaled magnitude exceeds max_abs (elements
+// before it are converted), or count when every amount fits.
+inline size_t to_fixed_point(const double* in, size_t count, double scale, int64_t max_abs, int64_t* out) {
+#if defined(FHE_FIXED_POINT_AVX2)
+    if (cpu_has_avx2()) return to_fixed_point_avx2(in, count, scale, max_abs, out);
+#elif defined(FHE_FIXED_POINT_NEON)
+    return to_fixed_point_neon(in, count, scale, max_abs, out);
+#endif
+    return to_fixed_point_scalar(in, count, scale, max_abs, out);
+}
+
+// Converts count decoded int64 values back to amounts.
+inline void from_fixed_point(const int64_t* in, size_t count, double scale, double* out) {
+#if defined(FHE_FIXED_POINT_AVX2)
+    if (cpu_has_avx2()) {
+        from_fixed_point_avx2(in, count, scale, out);
+        return;
+    }
+#elif defined(FHE_FIXED_POINT_NEON)
+    from_fixed_point_neon(in, count, scale, out);
+    return;
+#endif
+    from_fixed_point_scalar(in, count, scale, out);
+}
+
+// Fills a batching slot vector with one scaled amount per slot, zero-padding the
+// rest. Returns amounts.size() on success; a smaller value is the index of the
+// first amount that is out of range or does not fit in slot_count slots.
+inline size_t to_fixed_point_slots(const std::vector<double>& amounts, size_t slot_count, double scale, int64_t max_abs,
+                                   std::vector<int64_t>& slots) {
+    slots.assign(slot_count, 0);
+    size_t count = amounts.size() < slot_count ? amounts.size() : slot_count;
+    return to_fixed_point(amounts.data(), count, scale, max_abs, slots.data());
+}
+
+// Converts a whole decoded slot vector back to amounts.
+inline std::vector<double> from_fixed_point_slots(const std::vector<int64_t>& slots, double scale) {
+    std::vector<double> amounts(slots.size());
+    from_fixed_point(slots.data(), slots.size(), scale, amounts.data());
+    return amounts;
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "seal/seal.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <istream>
+#include <streambuf>
+#include <vector>
+
+#include <sys/socket.h>
+
+// --- Streaming Frame Reader ---
+// receive_data() collects a whole frame into a string and copies it into a
+// stringstream before SEAL parses it, so a large upload such as GaloisKeys is
+// held two or three times over. SocketFrameBuf exposes the body
+// of one size-prefixed frame as a std::streambuf that pulls from the socket
+// through a small fixed buffer, so SEAL's load() parses the bytes as they
+// arrive and peak memory stays near the size of the loaded object.
+
+// Reads exactly size bytes; false on error or if the peer closed the connection.
+// A signal (the server's sampling profiler raises SIGPROF) can end a call early
+// with part of the data or EINTR, so both loop.
+inline bool recv_exact(int sock, void* data, size_t size) {
+    char* out = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t got = recv(sock, out, size, MSG_WAITALL);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        out += got;
+        size -= static_cast<size_t>(got);
+    }
+    return true;
+}
+
+// Writes exactly size bytes; false on error.
+inline bool send_exact(int sock, const void* data, size_t size) {
+    const char* in = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t sent = send(sock, in, size, 0);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return false;
+        in += sent;
+        size -= static_cast<size_t>(sent);
+    }
+    return true;
+}
+
+class SocketFrameBuf : public std::streambuf {
+public:
+    static constexpr size_t default_buffer_size = 64 * 1024;
+
+    SocketFrameBuf(int sock, size_t frame_size, size_t buffer_size = default_buffer_size)
+        : sock_(sock), remaining_(frame_size), buffer_(std::max<size_t>(buffer_size, 1)) {
+        setg(buffer_.data(), buffer_.data(), buffer_.data());
+    }
+
+    SocketFrameBuf(const SocketFrameBuf&) = delete;
+    SocketFrameBuf& operator=(const SocketFrameBuf&) = delete;
+
+    // Reads and discards whatever the parser did not consume, so the next frame
+    // starts at the right place. Returns false if the socket failed.
+    bool drain() {
+        setg(buffer_.data(), buffer_.data(), buffer_.data());
+        while (remaining_ > 0 && !failed_) {
+            size_t chunk = std::min(remaining_, buffer_.size());
+            if (!recv_exact(sock_, buffer_.data(), chunk)) {
+                failed_ = true;
+                break;
+            }
+            remaining_ -= chunk;
+            received_ += chunk;
+        }
+        return !failed_;
+    }
+
+    bool failed() const { return failed_; }
+
+protected:
+    int_type underflow() override {
+        if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+        if (remaining_ == 0 || failed_) return traits_type::eof();
+        size_t chunk = std::min(remaining_, buffer_.size());
+        if (!recv_exact(sock_, buffer_.data(), chunk)) {
+            failed_ = true;
+            return traits_type::eof();
+        }
+        remaining_ -= chunk;
+        received_ += chunk;
+        setg(buffer_.data(), buffer_.data(), buffer_.data() + chunk);
+        return traits_type::to_int_type(*gptr());
+    }
+
+    // SEAL's loader uses tellg() to check header sizes, so report the read
+    // position. Only that query is supported; real seeks fail.
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+        if (off != 0 || dir != std::ios_base::cur || !(which & std::ios_base::in)) return pos_type(off_type(-1));
+        return pos_type(static_cast<off_type>(received_ - static_cast<size_t>(egptr() - gptr())));
+    }
+
+private:
+    int sock_;
+    size_t remaining_;     // frame bytes not yet pulled from the socket
+    size_t received_ = 0;  // frame bytes pulled from the socket so far
+    std::vector<char> buffer_;
+    bool failed_ = false;
+};
+
+// Receives one size-prefixed frame and hands its body to load as a stream.
+// Returns false if the socket fails or load throws; on a parse error the rest
+// of the frame is still consumed so the connection stays in sync. The frame's
+// size (prefix included) is added to *received_bytes if given.
+inline bool receive_stream(int sock, const std::function<void(std::istream&)>& load, size_t* received_bytes = nullptr) {
+    size_t frame_size;
+    if (!recv_exact(sock, &frame_size, sizeof(frame_size))) return false;
+    if (received_bytes) *received_bytes += sizeof(frame_size) + frame_size;
+    SocketFrameBuf frame(sock, frame_size);
+    std::istream in(&frame);
+    bool loaded = true;
+    try {
+        load(in);
+    } catch (const std::exception&) {
+        loaded = false;
+    }
+    return frame.drain() && loaded;
+}
+
+// Receives a SEAL object (keys, ciphertext, plaintext) directly from the socket.
+template <class T>
+bool receive_object(int sock, const seal::SEALContext& context, T& object, size_t* received_bytes = nullptr) {
+    return receive_stream(sock, [&](std::istream& in) { object.load(context, in); }, received_bytes);
+}
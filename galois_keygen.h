@@ -0,0 +1,50 @@
+#pragma once
+
+#include "seal/seal.h"
+#include "thread_pool.h"
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// --- Parallel Galois Key Generation ---
+// KeyGenerator::create_galois_keys generates one key-switching key per Galois
+// element, one after another. The keys are independent, so they are generated
+// in parallel, one task per element, each with its own KeyGenerator built from
+// the same secret key. The keys are then moved into one GaloisKeys laid out
+// exactly as SEAL lays it out: data() sized to the poly modulus degree, each
+// key at GaloisKeys::get_index(elt), parms_id set to the key level. The
+// serialized object therefore has the same structure the server already
+// loads, and the layout does not depend on which thread finished first.
+
+inline void create_galois_keys_parallel(const seal::SEALContext& context, const seal::SecretKey& secret_key,
+                                        const std::vector<uint32_t>& galois_elts, seal::GaloisKeys& destination,
+                                        size_t thread_count = 0) {
+    auto key_context_data = context.key_context_data();
+    size_t coeff_count = key_context_data->parms().poly_modulus_degree();
+
+    std::vector<std::vector<seal::PublicKey>> keys(galois_elts.size());
+    parallel_for(galois_elts.size(), thread_count, [&](size_t i) {
+        // KeyGenerator is not thread-safe, so every element gets its own. Building
+        // one from an existing secret key is cheap next to the key itself.
+        seal::KeyGenerator keygen(context, secret_key);
+        seal::GaloisKeys single;
+        keygen.create_galois_keys(std::vector<uint32_t>{ galois_elts[i] }, single);
+        keys[i] = std::move(single.data()[seal::GaloisKeys::get_index(galois_elts[i])]);
+    });
+
+    seal::GaloisKeys assembled;
+    assembled.data().resize(coeff_count);
+    for (size_t i = 0; i < galois_elts.size(); i++) {
+        assembled.data()[seal::GaloisKeys::get_index(galois_elts[i])] = std::move(keys[i]);
+    }
+    assembled.parms_id() = context.key_parms_id();
+    destination = std::move(assembled);
+}
+
+// Parallel equivalent of KeyGenerator::create_galois_keys(destination): keys for
+// every power-of-two row rotation in both directions plus the column swap.
+inline void create_galois_keys_parallel(const seal::SEALContext& context, const seal::SecretKey& secret_key,
+                                        seal::GaloisKeys& destination, size_t thread_count = 0) {
+    create_galois_keys_parallel(context, secret_key, context.key_context_data()->galois_tool()->get_elts_all(), destination,
+                                thread_count);
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "seal/seal.h"
+#include "seal/util/galois.h"
+#include "seal/util/ntt.h"
+#include "seal/util/rns.h"
+#include "seal/util/uintarithsmallmod.h"
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// --- Hoisted Rotations ---
+// Evaluator::rotate_rows key-switches every rotation from scratch: it splits c1
+// into its RNS digits, reduces each digit modulo every key prime and NTTs it
+// before the inner product with the Galois key. When one ciphertext is rotated
+// by many steps (slot sums, prefix sums over months), that decomposition is the
+// same every time up to a permutation, because the Galois automorphism commutes
+// with the digit split and acts on NTT form as a pure index permutation.
+// HoistedRotator decomposes once and only permutes, multiplies and mod-switches
+// per step. BFV only, size-2 ciphertexts in coefficient form (relinearize first).
+
+class HoistedRotator {
+public:
+    HoistedRotator(const seal::SEALContext& context, const seal::Ciphertext& encrypted,
+                   seal::MemoryPoolHandle pool = seal::MemoryManager::GetPool())
+        : context_(context), evaluator_(context), encrypted_(pool), pool_(std::move(pool)) {
+        encrypted_ = encrypted;
+        context_data_ = context_.get_context_data(encrypted.parms_id());
+        if (!context_data_) throw std::invalid_argument("HoistedRotator: ciphertext is not valid for the context");
+        if (context_data_->parms().scheme() != seal::scheme_type::bfv) {
+            throw std::invalid_argument("HoistedRotator: only BFV ciphertexts are supported");
+        }
+        if (encrypted.size() != 2 || encrypted.is_ntt_form()) {
+            throw std::invalid_argument("HoistedRotator: ciphertext must be size 2 and in coefficient form");
+        }
+        if (!context_.using_keyswitching()) throw std::invalid_argument("HoistedRotator: parameters do not support key switching");
+
+        auto key_context_data = context_.key_context_data();
+        const auto& key_modulus = key_context_data->parms().coeff_modulus();
+        const seal::util::NTTTables* key_ntt_tables = key_context_data->small_ntt_tables();
+        coeff_count_ = context_data_->parms().poly_modulus_degree();
+        decomp_modulus_size_ = context_data_->parms().coeff_modulus().size();
+        key_modulus_size_ = key_modulus.size();
+
+        // digit(J, I): J-th RNS digit of c1, reduced mod the I-th key prime and
+        // NTT-transformed. I == decomp_modulus_size_ stands for the special prime.
+        digits_.resize(decomp_modulus_size_ * (decomp_modulus_size_ + 1) * coeff_count_);
+        const uint64_t* c1 = encrypted.data(1);
+        for (size_t j = 0; j < decomp_modulus_size_; j++) {
+            for (size_t i = 0; i <= decomp_modulus_size_; i++) {
+                size_t key_index = key_prime_index(i);
+                uint64_t* digit = digit_ptr(j, i);
+                for (size_t c = 0; c < coeff_count_; c++) {
+                    digit[c] = seal::util::barrett_reduce_64(c1[j * coeff_count_ + c], key_modulus[key_index]);
+                }
+                seal::util::ntt_negacyclic_harvey(seal::util::CoeffIter(digit), key_ntt_tables[key_index]);
+            }
+        }
+    }
+
+    // Rotates the hoisted ciphertext's rows by steps. Steps without their own
+    // Galois key fall back to Evaluator::rotate_rows (which composes keys).
+    void rotate_rows(int steps, const seal::GaloisKeys& galois_keys, seal::Ciphertext& destination) const {
+        uint32_t galois_elt = context_data_->galois_tool()->get_elt_from_step(steps);
+        if (!galois_keys.has_key(galois_elt)) {
+            evaluator_.rotate_rows(encrypted_, steps, galois_keys, destination, pool_);
+            return;
+        }
+        apply_galois(galois_elt, galois_keys, destination);
+    }
+
+    // Same as rotate_rows, but for a raw Galois element (e.g. column rotation).
+    void apply_galois(uint32_t galois_elt, const seal::GaloisKeys& galois_keys, seal::Ciphertext& destination) const {
+        if (!galois_keys.has_key(galois_elt)) throw std::invalid_argument("HoistedRotator: Galois key not present");
+        const auto& key_vector = galois_keys.data()[seal::GaloisKeys::get_index(galois_elt)];
+        auto key_context_data = context_.key_context_data();
+        const auto& key_modulus = key_context_data->parms().coeff_modulus();
+        const auto& coeff_modulus = context_data_->parms().coeff_modulus();
+        const seal::util::NTTTables* key_ntt_tables = key_context_data->small_ntt_tables();
+        const seal::util::GaloisTool* galois_tool = context_data_->galois_tool();
+        const size_t n = coeff_count_;
+        const size_t rns_size = decomp_modulus_size_ + 1;
+
+        // Inner products with the key: products are < 2^122, so up to 64 digits
+        // accumulate in 128 bits before one Barrett reduction.
+        std::vector<uint64_t> products(2 * rns_size * n);
+        std::vector<uint64_t> permuted(n);
+        std::vector<unsigned __int128> lazy(2 * n);
+        for (size_t i = 0; i < rns_size; i++) {
+            size_t key_index = key_prime_index(i);
+            std::fill(lazy.begin(), lazy.end(), 0);
+            for (size_t j = 0; j < decomp_modulus_size_; j++) {
+                galois_tool->apply_galois_ntt(seal::util::ConstCoeffIter(digit_ptr(j, i)), galois_elt,
+                                              seal::util::CoeffIter(permuted.data()));
+                for (size_t k = 0; k < 2; k++) {
+                    const uint64_t* key_poly = key_vector[j].data().data(k) + key_index * n;
+                    unsigned __int128* acc = lazy.data() + k * n;
+                    for (size_t c = 0; c < n; c++) {
+                        acc[c] += static_cast<unsigned __int128>(permuted[c]) * key_poly[c];
+                    }
+                }
+            }
+            for (size_t k = 0; k < 2; k++) {
+                uint64_t* out = products.data() + (k * rns_size + i) * n;
+                const unsigned __int128* acc = lazy.data() + k * n;
+                for (size_t c = 0; c < n; c++) {
+                    uint64_t wide[2] = { static_cast<uint64_t>(acc[c]), static_cast<uint64_t>(acc[c] >> 64) };
+                    out[c] = seal::util::barrett_reduce_128(wide, key_modulus[key_index]);
+                }
+            }
+        }
+
+        // destination = (sigma(c0), 0) + round(products / special prime)
+        destination = seal::Ciphertext(pool_);
+        destination.resize(context_, encrypted_.parms_id(), 2);
+        for (size_t i = 0; i < decomp_modulus_size_; i++) {
+            galois_tool->apply_galois(seal::util::ConstCoeffIter(encrypted_.data(0) + i * n), galois_elt, coeff_modulus[i],
+                                      seal::util::CoeffIter(destination.data(0) + i * n));
+            std::fill(destination.data(1) + i * n, destination.data(1) + (i + 1) * n, 0);
+        }
+
+        const seal::Modulus& special_prime = key_modulus[key_modulus_size_ - 1];
+        const uint64_t special_half = special_prime.value() >> 1;
+        const seal::util::MultiplyUIntModOperand* inv_special_mod_q = key_context_data->rns_tool()->inv_q_last_mod_q();
+        for (size_t k = 0; k < 2; k++) {
+            uint64_t* last = products.data() + (k * rns_size + decomp_modulus_size_) * n;
+            seal::util::inverse_ntt_negacyclic_harvey(seal::util::CoeffIter(last), key_ntt_tables[key_modulus_size_ - 1]);
+            // Adding p/2 turns the floor in the division by p into rounding.
+            for (size_t c = 0; c < n; c++) {
+                last[c] = seal::util::barrett_reduce_64(last[c] + special_half, special_prime);
+            }
+            for (size_t i = 0; i < decomp_modulus_size_; i++) {
+                const seal::Modulus& qi = key_modulus[i];
+                uint64_t* component = products.data() + (k * rns_size + i) * n;
+                seal::util::inverse_ntt_negacyclic_harvey(seal::util::CoeffIter(component), key_ntt_tables[i]);
+                uint64_t minus_half = qi.value() - seal::util::barrett_reduce_64(special_half, qi);
+                uint64_t* out = destination.data(k) + i * n;
+                for (size_t c = 0; c < n; c++) {
+                    uint64_t last_mod_qi = seal::util::barrett_reduce_64(last[c], qi);
+                    uint64_t rounded = seal::util::barrett_reduce_64(last_mod_qi + minus_half, qi);
+                    uint64_t diff = seal::util::sub_uint_mod(component[c], rounded, qi);
+                    uint64_t scaled = seal::util::multiply_uint_mod(diff, inv_special_mod_q[i], qi);
+                    out[c] = seal::util::add_uint_mod(out[c], scaled, qi);
+                }
+            }
+        }
+    }
+
+private:
+    size_t key_prime_index(size_t i) const { return i == decomp_modulus_size_ ? key_modulus_size_ - 1 : i; }
+    uint64_t* digit_ptr(size_t j, size_t i) { return digits_.data() + (j * (decomp_modulus_size_ + 1) + i) * coeff_count_; }
+    const uint64_t* digit_ptr(size_t j, size_t i) const {
+        return digits_.data() + (j * (decomp_modulus_size_ + 1) + i) * coeff_count_;
+    }
+
+    const seal::SEALContext& context_;
+    seal::Evaluator evaluator_;
+    seal::Ciphertext encrypted_;
+    seal::MemoryPoolHandle pool_;
+    std::shared_ptr<const seal::SEALContext::ContextData> context_data_;
+    size_t coeff_count_ = 0;
+    size_t decomp_modulus_size_ = 0;
+    size_t key_modulus_size_ = 0;
+    std::vector<uint64_t> digits_;
+};
+
+// Computes encrypted + sum over steps of rotate_rows(encrypted, step), with all
+// rotations hoisted. With steps 1..k-1 this sums k consecutive packed slots.
+inline void hoisted_rotate_sum(const seal::SEALContext& context, const seal::Evaluator& evaluator,
+                               const seal::Ciphertext& encrypted, const std::vector<int>& steps,
+                               const seal::GaloisKeys& galois_keys, seal::Ciphertext& destination,
+                               seal::MemoryPoolHandle pool = seal::MemoryManager::GetPool()) {
+    HoistedRotator rotator(context, encrypted, pool);
+    destination = encrypted;
+    seal::Ciphertext rotated(pool);
+    for (int step : steps) {
+        rotator.rotate_rows(step, galois_keys, rotated);
+        evaluator.add_inplace(destination, rotated);
+    }
+}
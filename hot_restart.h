@@ -0,0 +1,265 @@
+#pragma once
+
+#include "seal/seal.h"
+#include "key_registry.h"
+#include "session_memory.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// --- Hot Restart ---
+// A new server build takes over from a running one without dropping the port or
+// the loaded keys:
+//   1. the old process listens on a Unix socket (--handoff-socket PATH);
+//   2. the new one, started with --take-over PATH, warms up and then connects;
+//   3. the old process writes its live key groups to a snapshot file and passes
+//      its listening socket and the snapshot's path back (SCM_RIGHTS);
+//   4. the new process maps the snapshot, loads the key groups and starts
+//      accepting; the old one stops accepting, ends each session once the
+//      requests it has read are answered, and exits.
+// Clients reconnect with a resume hello (see protocol.h), find their keys
+// already loaded in the new process, and send again every request the old one
+// left unanswered, including those it never read; the new process evaluates
+// them.
+
+namespace hot_restart_detail {
+    constexpr uint32_t SNAPSHOT_MAGIC = 0x4B454846; // "FHEK"
+    constexpr uint16_t SNAPSHOT_VERSION = 2;
+
+    template <class T>
+    void put(std::ostream& out, T value) {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <class T>
+    T get(const char* data, size_t size, size_t& pos) {
+        if (size < sizeof(T) || pos > size - sizeof(T)) throw std::invalid_argument("key group: truncated");
+        T value;
+        std::memcpy(&value, data + pos, sizeof(T));
+        pos += sizeof(T);
+        return value;
+    }
+
+    inline void put_bytes(std::ostream& out, const std::string& bytes) {
+        put<uint64_t>(out, bytes.size());
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    }
+
+    // Objects are stored uncompressed: loading them is then a copy out of the
+    // mapped file rather than a decompression
+    template <class T>
+    void put_object(std::ostream& out, const T& object) {
+        std::stringstream saved;
+        object.save(saved, seal::compr_mode_type::none);
+        put_bytes(out, saved.str());
+    }
+
+    struct MappedFile {
+        void* data = MAP_FAILED;
+        size_t size = 0;
+        ~MappedFile() {
+            if (data != MAP_FAILED) munmap(data, size);
+        }
+    };
+
+    // The next object's bytes, as (pointer into the mapping, size)
+    inline std::pair<const seal::seal_byte*, size_t> get_object(const char* data, size_t size, size_t& pos) {
+        uint64_t length = get<uint64_t>(data, size, pos);
+        if (length > size - pos) throw std::invalid_argument("key group: truncated");
+        const seal::seal_byte* object = reinterpret_cast<const seal::seal_byte*>(data + pos);
+        pos += length;
+        return { object, static_cast<size_t>(length) };
+    }
+}
+
+// --- Key Group Serialization ---
+// A group is its fingerprint (u32 length and bytes) followed by the
+// parameters, public key, relinearization keys and Galois keys (each u64
+// length and bytes). The parameters and public key are the bytes the client
+// uploaded, so the reader can recompute the fingerprint over them. Also used
+// to migrate sessions (session_migration.h).
+inline void write_key_group(std::ostream& out, KeyGroup& group) {
+    using namespace hot_restart_detail;
+    KeyGroup::KeysInUse keys(group);
+    put<uint32_t>(out, static_cast<uint32_t>(group.fingerprint.size()));
+    out.write(group.fingerprint.data(), static_cast<std::streamsize>(group.fingerprint.size()));
+    put_bytes(out, group.parms_bytes);
+    put_bytes(out, group.public_key_bytes);
+    put_object(out, group.relin_keys);
+    put_object(out, group.galois_keys);
+}
+
+// Reads the group at pos in data, with a context from contexts where the
+// parameters were warmed up.
+inline std::shared_ptr<KeyGroup> read_key_group(const char* data, size_t size, size_t& pos, const ContextCache& contexts) {
+    using namespace hot_restart_detail;
+    uint32_t fingerprint_size = get<uint32_t>(data, size, pos);
+    if (fingerprint_size > size - pos) throw std::invalid_argument("key group: truncated");
+    std::string fingerprint(data + pos, fingerprint_size);
+    pos += fingerprint_size;
+
+    auto parms_object = get_object(data, size, pos);
+    auto public_key = get_object(data, size, pos);
+    std::string parms_bytes(reinterpret_cast<const char*>(parms_object.first), parms_object.second);
+    std::string public_key_bytes(reinterpret_cast<const char*>(public_key.first), public_key.second);
+    if (key_fingerprint(parms_bytes, public_key_bytes) != fingerprint) {
+        throw std::invalid_argument("key group: fingerprint does not match its parameters and public key");
+    }
+
+    seal::EncryptionParameters parms;
+    parms.load(parms_object.first, parms_object.second);
+    auto group = std::make_shared<KeyGroup>(contexts.context_for(parms), fingerprint);
+    if (!group->context.parameters_set()) throw std::invalid_argument("key group: invalid parameters");
+    group->public_key.load(group->context, public_key.first, public_key.second);
+    group->parms_bytes = std::move(parms_bytes);
+    group->public_key_bytes = std::move(public_key_bytes);
+    auto relin_keys = get_object(data, size, pos);
+    group->relin_keys.load(group->context, relin_keys.first, relin_keys.second);
+    auto galois_keys = get_object(data, size, pos);
+    group->galois_keys.load(group->context, galois_keys.first, galois_keys.second);
+    group->move_keys_to_pool();
+    group->key_bytes = object_bytes(group->public_key) + object_bytes(group->relin_keys) + object_bytes(group->galois_keys);
+    return group;
+}
+
+// --- Key Snapshot ---
+// Layout: magic u32, version u16, group count u32, then the groups.
+inline void write_key_snapshot(const std::string& path, const std::vector<std::shared_ptr<KeyGroup>>& groups) {
+    using namespace hot_restart_detail;
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) throw std::runtime_error("key snapshot: cannot create " + path);
+    put<uint32_t>(out, SNAPSHOT_MAGIC);
+    put<uint16_t>(out, SNAPSHOT_VERSION);
+    put<uint32_t>(out, static_cast<uint32_t>(groups.size()));
+    for (const auto& group : groups) write_key_group(out, *group);
+    if (!out.flush()) throw std::runtime_error("key snapshot: cannot write " + path);
+}
+
+// Maps the snapshot at path and loads its key groups.
+inline std::vector<std::shared_ptr<KeyGroup>> read_key_snapshot(const std::string& path, const ContextCache& contexts) {
+    using namespace hot_restart_detail;
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("key snapshot: cannot open " + path);
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        throw std::runtime_error("key snapshot: cannot read " + path);
+    }
+    MappedFile mapping;
+    mapping.size = static_cast<size_t>(info.st_size);
+    mapping.data = mmap(nullptr, mapping.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping.data == MAP_FAILED) throw std::runtime_error("key snapshot: cannot map " + path);
+    madvise(mapping.data, mapping.size, MADV_SEQUENTIAL);
+    const char* data = static_cast<const char*>(mapping.data);
+    const size_t size = mapping.size;
+
+    size_t pos = 0;
+    if (get<uint32_t>(data, size, pos) != SNAPSHOT_MAGIC) throw std::invalid_argument("key snapshot: bad magic");
+    if (get<uint16_t>(data, size, pos) != SNAPSHOT_VERSION) throw std::invalid_argument("key snapshot: unsupported version");
+    uint32_t count = get<uint32_t>(data, size, pos);
+    std::vector<std::shared_ptr<KeyGroup>> groups;
+    for (uint32_t i = 0; i < count; i++) groups.push_back(read_key_group(data, size, pos, contexts));
+    return groups;
+}
+
+// --- Socket Handoff ---
+// The handoff message carries the listening socket as ancillary data and the
+// snapshot path as its payload.
+inline bool send_listen_socket(int channel, int listen_fd, const std::string& snapshot_path) {
+    std::string payload = snapshot_path.empty() ? std::string(1, '\0') : snapshot_path;
+    struct iovec iov;
+    iov.iov_base = const_cast<char*>(payload.data());
+    iov.iov_len = payload.size();
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    struct msghdr message = {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(header), &listen_fd, sizeof(int));
+    ssize_t sent;
+    while ((sent = sendmsg(channel, &message, 0)) < 0 && errno == EINTR) {}
+    return sent == static_cast<ssize_t>(payload.size());
+}
+
+// Returns the received socket, or -1; snapshot_path is empty if the old
+// process had no snapshot to pass on.
+inline int receive_listen_socket(int channel, std::string& snapshot_path) {
+    std::vector<char> payload(4096);
+    struct iovec iov;
+    iov.iov_base = payload.data();
+    iov.iov_len = payload.size();
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    struct msghdr message = {};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    ssize_t received;
+    while ((received = recvmsg(channel, &message, 0)) < 0 && errno == EINTR) {}
+    if (received <= 0) return -1;
+    struct cmsghdr* header = CMSG_FIRSTHDR(&message);
+    if (!header || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) return -1;
+    int listen_fd;
+    std::memcpy(&listen_fd, CMSG_DATA(header), sizeof(int));
+    snapshot_path.assign(payload.data(), static_cast<size_t>(received));
+    if (snapshot_path == std::string(1, '\0')) snapshot_path.clear();
+    return listen_fd;
+}
+
+inline bool unix_socket_address(const std::string& path, struct sockaddr_un& address) {
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) return false;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+// Listening Unix socket at path (replacing a stale one), or -1.
+inline int listen_for_handoff(const std::string& path) {
+    struct sockaddr_un address;
+    if (!unix_socket_address(path, address)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    unlink(path.c_str());
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0 || listen(fd, 1) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Connects to a running server's handoff socket and takes its listening
+// socket. Returns -1 on failure.
+inline int take_over_listen_socket(const std::string& path, std::string& snapshot_path) {
+    struct sockaddr_un address;
+    if (!unix_socket_address(path, address)) return -1;
+    int channel = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (channel < 0) return -1;
+    if (connect(channel, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0) {
+        close(channel);
+        return -1;
+    }
+    int listen_fd = receive_listen_socket(channel, snapshot_path);
+    close(channel);
+    return listen_fd;
+}
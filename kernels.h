@@ -0,0 +1,72 @@
+#pragma once
+
+#include "seal/seal.h"
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+// --- Arithmetic Kernel Report ---
+// SEAL decides at compile time whether its NTT and modular arithmetic go through
+// Intel HEXL (SEAL_USE_INTEL_HEXL). HEXL then picks AVX512-IFMA, AVX512-DQ or its
+// portable code at runtime from the CPU it finds. This header reproduces that
+// choice so server_app, client_app and benchmark can print which kernels are live.
+
+struct KernelReport {
+    bool seal_built_with_hexl = false;
+    bool cpu_avx2 = false;
+    bool cpu_avx512f = false;
+    bool cpu_avx512dq = false;
+    bool cpu_avx512ifma = false;
+    std::string ntt_kernel;
+    std::string modmul_kernel;
+};
+
+// HEXL only uses the 52-bit IFMA path when every modulus fits in 50 bits.
+const int HEXL_IFMA_MAX_MODULUS_BITS = 50;
+
+inline int max_coeff_modulus_bits(const seal::EncryptionParameters& parms) {
+    int max_bits = 0;
+    for (const auto& modulus : parms.coeff_modulus()) {
+        max_bits = std::max(max_bits, modulus.bit_count());
+    }
+    return max_bits;
+}
+
+inline KernelReport detect_kernels(int max_modulus_bits) {
+    KernelReport report;
+#ifdef SEAL_USE_INTEL_HEXL
+    report.seal_built_with_hexl = true;
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    report.cpu_avx2 = __builtin_cpu_supports("avx2");
+    report.cpu_avx512f = __builtin_cpu_supports("avx512f");
+    report.cpu_avx512dq = __builtin_cpu_supports("avx512dq");
+    report.cpu_avx512ifma = __builtin_cpu_supports("avx512ifma");
+#endif
+
+    if (!report.seal_built_with_hexl) {
+        report.ntt_kernel = "SEAL portable (Harvey NTT, scalar)";
+        report.modmul_kernel = "SEAL portable (Barrett, scalar)";
+    } else if (report.cpu_avx512ifma && max_modulus_bits <= HEXL_IFMA_MAX_MODULUS_BITS) {
+        report.ntt_kernel = "Intel HEXL AVX512-IFMA";
+        report.modmul_kernel = "Intel HEXL AVX512-IFMA";
+    } else if (report.cpu_avx512dq) {
+        report.ntt_kernel = "Intel HEXL AVX512-DQ";
+        report.modmul_kernel = "Intel HEXL AVX512-DQ";
+    } else {
+        // HEXL falls back to its own native code when AVX-512 is missing.
+        report.ntt_kernel = "Intel HEXL native (no AVX-512 on this CPU)";
+        report.modmul_kernel = "Intel HEXL native (no AVX-512 on this CPU)";
+    }
+    return report;
+}
+
+inline void print_kernel_report(std::ostream& out, const KernelReport& report) {
+    out << "Arithmetic kernels:" << std::endl;
+    out << "  SEAL " << SEAL_VERSION << " built with Intel HEXL: " << (report.seal_built_with_hexl ? "yes" : "no") << std::endl;
+    out << "  CPU features: AVX2=" << report.cpu_avx2 << " AVX512F=" << report.cpu_avx512f
+        << " AVX512DQ=" << report.cpu_avx512dq << " AVX512IFMA=" << report.cpu_avx512ifma << std::endl;
+    out << "  NTT: " << report.ntt_kernel << std::endl;
+    out << "  Modular multiply: " << report.modmul_kernel << std::endl;
+}
@@ -0,0 +1,389 @@
+#pragma once
+
+#include "seal/seal.h"
+#include "protocol.h"
+#include "response_pack.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// --- Key Registry ---
+// Every session uploads parameters and a public, relinearization and Galois key
+// set. Sessions that upload the same parameters and public key belong to the
+// same key holder, so they share one KeyGroup: one SEALContext, one copy of the
+// evaluation keys and one set of encoded response masks. This also lets their
+// requests be evaluated together. Groups are found by key_fingerprint (see
+// protocol.h). The registry only holds weak references, so a group is freed
+// when its last session ends; groups handed over by a hot restart are the
+// exception until their first session arrives.
+
+struct KeyGroup {
+    KeyGroup(const seal::EncryptionParameters& parms, std::string key_fingerprint)
+        : KeyGroup(seal::SEALContext(parms), std::move(key_fingerprint)) {}
+
+    // Shares the precomputation of an existing context (see ContextCache)
+    KeyGroup(seal::SEALContext shared_context, std::string key_fingerprint)
+        : fingerprint(std::move(key_fingerprint)), context(std::move(shared_context)), evaluator(context),
+          batch_encoder(context) {}
+
+    ~KeyGroup() {
+        if (!hibernation_file_.empty()) std::remove(hibernation_file_.c_str());
+    }
+
+    KeyGroup(const KeyGroup&) = delete;
+    KeyGroup& operator=(const KeyGroup&) = delete;
+
+    // --- Hibernation ---
+    // The evaluation keys of a key holder that has sent nothing for a while
+    // are serialized (compressed with zstd where SEAL has it) into memory or a
+    // file and freed; the next evaluation loads them back. The keys live in a
+    // SEAL pool of their own (mm_force_new), which is dropped with them, so
+    // their memory goes back to the allocator rather than staying in the
+    // global pool, which never shrinks. The process then holds keys for the
+    // groups in use rather than for every connected session. Evaluations hold
+    // a KeysInUse while they need the keys; its constructor throws
+    // std::runtime_error if they cannot be restored.
+    class KeysInUse {
+    public:
+        explicit KeysInUse(KeyGroup& group) : group_(group) {
+            std::lock_guard<std::mutex> lock(group_.keys_mutex_);
+            if (group_.hibernated_) group_.restore_keys();
+            group_.keys_in_use_++;
+        }
+
+        ~KeysInUse() {
+            std::lock_guard<std::mutex> lock(group_.keys_mutex_);
+            group_.keys_in_use_--;
+            group_.last_used_ = std::chrono::steady_clock::now();
+        }
+
+        KeysInUse(const KeysInUse&) = delete;
+        KeysInUse& operator=(const KeysInUse&) = delete;
+
+    private:
+        KeyGroup& group_;
+    };
+
+    // Stores and frees the keys if they have not been used for idle. With a
+    // directory they go to a file there, otherwise they stay in memory
+    // compressed. Returns the bytes stored, or 0 if the group was not idle.
+    size_t hibernate(std::chrono::steady_clock::duration idle, const std::string& directory = "") {
+        std::lock_guard<std::mutex> lock(keys_mutex_);
+        if (hibernated_ || keys_in_use_ > 0 || std::chrono::steady_clock::now() - last_used_ < idle) return 0;
+        // Saved one ciphertext at a time, so that a restore can load each one
+        // straight into the new pool
+        std::stringstream stored;
+        public_key.data().save(stored, seal::Serialization::compr_mode_default);
+        save_keys(stored, relin_keys);
+        save_keys(stored, galois_keys);
+        std::string bytes = stored.str();
+        if (directory.empty()) {
+            hibernated_keys_ = std::move(bytes);
+        } else {
+            std::string path = directory + "/" + fingerprint + ".keys";
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            if (!out.write(bytes.data(), static_cast<std::streamsize>(bytes.size())) || !out.flush()) return 0;
+            hibernation_file_ = path;
+        }
+        public_key = seal::PublicKey();
+        relin_keys = seal::RelinKeys();
+        galois_keys = seal::GaloisKeys();
+        keys_pool_ = seal::MemoryPoolHandle(); // the last handle: frees the pool
+        pooled_key_bytes_ = 0;
+        hibernated_ = true;
+        return bytes.size();
+    }
+
+    bool hibernated() const { return hibernated_; }
+
+    // Copies freshly loaded keys into a pool of their own. Keys are parsed in
+    // the global pool (SEAL's key loaders take no pool), which keeps room for
+    // the largest set being loaded at once but no more. Called before the
+    // group is shared.
+    void move_keys_to_pool() {
+        keys_pool_ = seal::MemoryManager::GetPool(seal::mm_prof_opt::mm_force_new);
+        move_to_pool(public_key.data());
+        for (auto& key_set : relin_keys.data()) {
+            for (auto& key : key_set) move_to_pool(key.data());
+        }
+        for (auto& key_set : galois_keys.data()) {
+            for (auto& key : key_set) move_to_pool(key.data());
+        }
+        pooled_key_bytes_ = keys_pool_.alloc_byte_count();
+    }
+
+    // Bytes the group's key pool holds; 0 while hibernated
+    size_t key_pool_bytes() const { return pooled_key_bytes_; }
+
+    // Response packer for count results, built on first use.
+    const ResponsePacker& packer(size_t count) {
+        std::lock_guard<std::mutex> lock(packers_mutex_);
+        auto& packer = packers_[count];
+        if (!packer) packer = std::make_unique<ResponsePacker>(context, batch_encoder, count);
+        return *packer;
+    }
+
+    const std::string fingerprint;
+    // The parameters and public key as the client serialized them. The
+    // fingerprint is taken over these bytes, so snapshots and migrations carry
+    // them as they are and the receiver checks them against it.
+    std::string parms_bytes;
+    std::string public_key_bytes;
+    size_t key_bytes = 0; // deserialized public, relinearization and Galois keys
+    seal::SEALContext context;
+    seal::PublicKey public_key;
+    seal::RelinKeys relin_keys;
+    seal::GaloisKeys galois_keys;
+    seal::Evaluator evaluator;
+    seal::BatchEncoder batch_encoder;
+
+private:
+    // Called with keys_mutex_ held. The stored copy is only dropped once every
+    // key has loaded, so a failed restore leaves the group hibernated and the
+    // next evaluation tries again.
+    void restore_keys() {
+        std::string source = hibernation_file_.empty() ? "memory" : hibernation_file_;
+        seal::MemoryPoolHandle pool = seal::MemoryManager::GetPool(seal::mm_prof_opt::mm_force_new);
+        seal::PublicKey restored_public_key;
+        seal::RelinKeys restored_relin_keys;
+        seal::GaloisKeys restored_galois_keys;
+        try {
+            std::stringstream stored;
+            if (hibernation_file_.empty()) {
+                stored.str(hibernated_keys_);
+            } else {
+                std::ifstream in(hibernation_file_, std::ios::binary);
+                if (!in) throw std::runtime_error("cannot open the file");
+                stored << in.rdbuf();
+            }
+            restored_public_key = load_key(stored, pool);
+            load_keys(stored, restored_relin_keys, pool);
+            load_keys(stored, restored_galois_keys, pool);
+        } catch (const std::exception& e) {
+            throw std::runtime_error("key group " + fingerprint.substr(0, 16) + ": cannot restore hibernated keys from " +
+                                     source + ": " + e.what());
+        }
+        public_key = std::move(restored_public_key);
+        relin_keys = std::move(restored_relin_keys);
+        galois_keys = std::move(restored_galois_keys);
+        keys_pool_ = std::move(pool);
+        pooled_key_bytes_ = keys_pool_.alloc_byte_count();
+        if (hibernation_file_.empty()) {
+            hibernated_keys_.clear();
+            hibernated_keys_.shrink_to_fit();
+        } else {
+            std::remove(hibernation_file_.c_str());
+            hibernation_file_.clear();
+        }
+        hibernated_ = false;
+    }
+
+    // Copy-assignment allocates from the destination's pool; the move then
+    // hands that pool to the key
+    void move_to_pool(seal::Ciphertext& key) const {
+        seal::Ciphertext pooled(keys_pool_);
+        pooled = key;
+        key = std::move(pooled);
+    }
+
+    // Keys sit at the key level, which Ciphertext::load refuses; each is
+    // checked as a public key instead
+    seal::PublicKey load_key(std::istream& in, const seal::MemoryPoolHandle& pool) const {
+        seal::Ciphertext loaded(pool);
+        loaded.unsafe_load(context, in);
+        seal::PublicKey key;
+        key.data() = std::move(loaded);
+        if (!seal::is_valid_for(key, context)) throw std::runtime_error("invalid key");
+        return key;
+    }
+
+    // The shape of keys.data() (u64 counts), then each key's ciphertext
+    static void save_keys(std::ostream& out, const seal::KSwitchKeys& keys) {
+        uint64_t sets = keys.data().size();
+        out.write(reinterpret_cast<const char*>(&sets), sizeof(sets));
+        for (const auto& key_set : keys.data()) {
+            uint64_t count = key_set.size();
+            out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+            for (const auto& key : key_set) key.data().save(out, seal::Serialization::compr_mode_default);
+        }
+    }
+
+    void load_keys(std::istream& in, seal::KSwitchKeys& keys, const seal::MemoryPoolHandle& pool) const {
+        uint64_t sets = 0;
+        if (!in.read(reinterpret_cast<char*>(&sets), sizeof(sets))) throw std::runtime_error("truncated");
+        keys.data().resize(static_cast<size_t>(sets));
+        for (auto& key_set : keys.data()) {
+            uint64_t count = 0;
+            if (!in.read(reinterpret_cast<char*>(&count), sizeof(count))) throw std::runtime_error("truncated");
+            key_set.resize(static_cast<size_t>(count));
+            for (auto& key : key_set) key = load_key(in, pool);
+        }
+        keys.parms_id() = context.key_parms_id();
+    }
+
+    std::mutex packers_mutex_;
+    std::map<size_t, std::unique_ptr<ResponsePacker>> packers_;
+    std::mutex keys_mutex_;
+    size_t keys_in_use_ = 0;
+    std::chrono::steady_clock::time_point last_used_ = std::chrono::steady_clock::now();
+    seal::MemoryPoolHandle keys_pool_;
+    std::atomic<size_t> pooled_key_bytes_{ 0 };
+    std::atomic<bool> hibernated_{ false };
+    std::string hibernated_keys_;
+    std::string hibernation_file_;
+};
+
+// Contexts built ahead of time (see warmup.h), by parameter set. A SEALContext
+// copy shares its precomputed tables, so a group created with matching
+// parameters starts with warm NTT tables instead of building its own. Filled
+// before sessions start and only read afterwards; other parameter sets get a
+// fresh context each time.
+class ContextCache {
+public:
+    void insert(const seal::EncryptionParameters& parms, const seal::SEALContext& context) {
+        contexts_.emplace(parameters_key(parms), context);
+    }
+
+    seal::SEALContext context_for(const seal::EncryptionParameters& parms) const {
+        auto found = contexts_.find(parameters_key(parms));
+        return found == contexts_.end() ? seal::SEALContext(parms) : found->second;
+    }
+
+    size_t size() const { return contexts_.size(); }
+
+private:
+    // Uncompressed, so equal parameters always give equal keys
+    static std::string parameters_key(const seal::EncryptionParameters& parms) {
+        std::stringstream out;
+        parms.save(out, seal::compr_mode_type::none);
+        return out.str();
+    }
+
+    std::map<std::string, seal::SEALContext> contexts_;
+};
+
+// Lookups are the sessions that asked for a key group; hits found its keys
+// already loaded, so the session did not have to load them.
+struct KeyRegistryStats {
+    size_t lookups = 0;
+    size_t hits = 0;
+    size_t live = 0;
+    size_t adopted = 0; // loaded, but no session holds them yet
+    size_t moved = 0;   // migrated to another server
+    size_t hibernated = 0;
+    size_t key_pool_bytes = 0; // summed over the live groups' key pools
+};
+
+class KeyRegistry {
+public:
+    // The live group with this fingerprint, or nullptr.
+    std::shared_ptr<KeyGroup> find(const std::string& fingerprint) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        lookups_++;
+        auto found = groups_.find(fingerprint);
+        if (found == groups_.end()) return nullptr;
+        std::shared_ptr<KeyGroup> group = found->second.lock();
+        adopted_.erase(fingerprint); // the caller's reference keeps it alive now
+        if (group) hits_++;
+        return group;
+    }
+
+    // Registers a fully loaded group. If another session registered the same
+    // fingerprint in the meantime, that group is returned instead.
+    std::shared_ptr<KeyGroup> insert(std::shared_ptr<KeyGroup> group) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = groups_.begin(); it != groups_.end();) {
+            it = it->second.expired() ? groups_.erase(it) : std::next(it);
+        }
+        auto& slot = groups_[group->fingerprint];
+        if (auto existing = slot.lock()) return existing;
+        slot = group;
+        return group;
+    }
+
+    // Registers a group no session holds yet (loaded from a snapshot, see
+    // hot_restart.h). It stays loaded until a session finds it.
+    void adopt(std::shared_ptr<KeyGroup> group) {
+        std::shared_ptr<KeyGroup> registered = insert(group);
+        std::lock_guard<std::mutex> lock(mutex_);
+        adopted_[registered->fingerprint] = registered;
+    }
+
+    // Records that the keys under fingerprint now live at address (another
+    // server, see session_migration.h); an empty address clears it.
+    void set_moved(const std::string& fingerprint, const std::string& address) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (address.empty()) {
+            moved_.erase(fingerprint);
+        } else {
+            moved_[fingerprint] = address;
+        }
+    }
+
+    // Stops holding a group adopted by adopt(), e.g. once it has moved away.
+    void release_adopted(const std::string& fingerprint) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        adopted_.erase(fingerprint);
+    }
+
+    // Where the keys under fingerprint moved to, or an empty string.
+    std::string moved_to(const std::string& fingerprint) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = moved_.find(fingerprint);
+        return found == moved_.end() ? "" : found->second;
+    }
+
+    // The groups currently loaded
+    std::vector<std::shared_ptr<KeyGroup>> live() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<std::shared_ptr<KeyGroup>> groups;
+        for (const auto& entry : groups_) {
+            if (auto group = entry.second.lock()) groups.push_back(group);
+        }
+        return groups;
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t live = 0;
+        for (const auto& entry : groups_) live += entry.second.expired() ? 0 : 1;
+        return live;
+    }
+
+    KeyRegistryStats stats() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        KeyRegistryStats stats;
+        stats.lookups = lookups_;
+        stats.hits = hits_;
+        for (const auto& entry : groups_) {
+            std::shared_ptr<KeyGroup> group = entry.second.lock();
+            if (!group) continue;
+            stats.live++;
+            stats.hibernated += group->hibernated() ? 1 : 0;
+            stats.key_pool_bytes += group->key_pool_bytes();
+        }
+        stats.adopted = adopted_.size();
+        stats.moved = moved_.size();
+        return stats;
+    }
+
+    ContextCache& contexts() { return contexts_; }
+
+private:
+    std::mutex mutex_;
+    std::map<std::string, std::weak_ptr<KeyGroup>> groups_;
+    std::map<std::string, std::shared_ptr<KeyGroup>> adopted_;
+    std::map<std::string, std::string> moved_;
+    size_t lookups_ = 0;
+    size_t hits_ = 0;
+    ContextCache contexts_;
+};
@@ -0,0 +1,238 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <sys/time.h>
+
+// --- Sampling Profiler ---
+// Attaching perf to a production server is not always allowed, so the server
+// can sample itself. While running, ITIMER_PROF raises SIGPROF every 1/hz
+// seconds of process CPU time, in whichever thread is using it; the handler
+// records that thread's stack and its current request phase (load, evaluate,
+// save, or other) into a fixed ring of samples. Nothing in the handler
+// allocates or locks. Samples are aggregated when the profile is dumped, as
+// collapsed stacks ("phase;outer;...;inner count") for flamegraph.pl or
+// speedscope, one root per phase.
+//
+// The server starts, stops and dumps the profiler through its admin socket.
+
+enum class ProfilePhase : uint8_t { other = 0, load = 1, evaluate = 2, save = 3 };
+
+inline const char* profile_phase_name(ProfilePhase phase) {
+    switch (phase) {
+    case ProfilePhase::load: return "load";
+    case ProfilePhase::evaluate: return "evaluate";
+    case ProfilePhase::save: return "save";
+    default: return "other";
+    }
+}
+
+namespace profiler_detail {
+    // Read by the signal handler; initial-exec TLS, so reading it is safe there
+    inline thread_local ProfilePhase current_phase = ProfilePhase::other;
+}
+
+// Marks the calling thread as being in phase until the scope ends.
+class ProfilePhaseScope {
+public:
+    // The fences keep the compiler from eliding or moving the stores the
+    // signal handler reads
+    explicit ProfilePhaseScope(ProfilePhase phase) : previous_(profiler_detail::current_phase) {
+        profiler_detail::current_phase = phase;
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+    }
+    ~ProfilePhaseScope() {
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        profiler_detail::current_phase = previous_;
+    }
+
+    ProfilePhaseScope(const ProfilePhaseScope&) = delete;
+    ProfilePhaseScope& operator=(const ProfilePhaseScope&) = delete;
+
+private:
+    ProfilePhase previous_;
+};
+
+struct ProfileSample {
+    std::atomic<bool> ready{ false };
+    ProfilePhase phase = ProfilePhase::other;
+    int depth = 0;
+    void* frames[48];
+};
+
+class SamplingProfiler {
+public:
+    static constexpr size_t CAPACITY = 1 << 15; // samples kept between dumps
+
+    // One per process: SIGPROF and ITIMER_PROF are process-wide.
+    static SamplingProfiler& instance() {
+        static SamplingProfiler profiler;
+        return profiler;
+    }
+
+    // Starts sampling at hz samples per CPU second. Throws std::runtime_error
+    // if it is already running or the timer cannot be set.
+    void start(int hz) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (running_) throw std::runtime_error("profiler: already running");
+        if (hz < 1 || hz > 10000) throw std::invalid_argument("profiler: hz must be between 1 and 10000");
+        if (!samples_) samples_.reset(new ProfileSample[CAPACITY]);
+        // backtrace() loads libgcc on first use, which allocates: not in the handler
+        void* warm[4];
+        backtrace(warm, 4);
+
+        struct sigaction action = {};
+        action.sa_handler = &SamplingProfiler::on_signal;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        if (sigaction(SIGPROF, &action, nullptr) != 0) throw std::runtime_error("profiler: cannot install SIGPROF handler");
+        active_.store(true);
+        struct itimerval timer = {};
+        // tv_usec must stay below one second
+        timer.it_interval.tv_sec = 1 / hz;
+        timer.it_interval.tv_usec = (1000000 / hz) % 1000000;
+        timer.it_value = timer.it_interval;
+        if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+            active_.store(false);
+            throw std::runtime_error("profiler: cannot set ITIMER_PROF");
+        }
+        hz_ = hz;
+        running_ = true;
+    }
+
+    // Stops sampling; the samples stay until the next dump.
+    void stop() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) return;
+        struct itimerval timer = {};
+        setitimer(ITIMER_PROF, &timer, nullptr);
+        active_.store(false);
+        running_ = false;
+    }
+
+    bool running() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return running_;
+    }
+
+    // Collapsed stacks of the samples taken since the last dump (which are then
+    // discarded), most frequent first within each phase.
+    std::string dump_collapsed() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        drain();
+        std::ostringstream out;
+        for (const auto& stack : stacks_) out << stack.first << " " << stack.second << "\n";
+        stacks_.clear();
+        return out.str();
+    }
+
+    // One line: state, rate, samples taken and dropped so far.
+    std::string status() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        drain();
+        std::ostringstream out;
+        out << (running_ ? "running" : "stopped") << " at " << hz_ << " Hz, " << sampled_ << " samples, "
+            << dropped_.load() << " dropped, " << stacks_.size() << " distinct stacks";
+        return out.str();
+    }
+
+private:
+    SamplingProfiler() = default;
+
+    __attribute__((noinline)) static void on_signal(int) {
+        int saved_errno = errno;
+        instance().record();
+        errno = saved_errno;
+    }
+
+    // Async-signal-safe: claims a free slot with a CAS, fills it, publishes it
+    __attribute__((noinline)) void record() {
+        if (!active_.load(std::memory_order_relaxed)) return;
+        uint64_t slot = written_.load(std::memory_order_relaxed);
+        do {
+            if (slot - read_.load(std::memory_order_acquire) >= CAPACITY) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        } while (!written_.compare_exchange_weak(slot, slot + 1, std::memory_order_acq_rel));
+        ProfileSample& sample = samples_[slot % CAPACITY];
+        sample.phase = profiler_detail::current_phase;
+        sample.depth = backtrace(sample.frames, 48);
+        sample.ready.store(true, std::memory_order_release);
+    }
+
+    // Called with mutex_ held: folds the published samples into stacks_
+    void drain() {
+        if (!samples_) return;
+        uint64_t read = read_.load(std::memory_order_relaxed);
+        while (true) {
+            ProfileSample& sample = samples_[read % CAPACITY];
+            if (!sample.ready.load(std::memory_order_acquire)) break;
+            std::string stack = profile_phase_name(sample.phase);
+            // Frames 0 and 1 are record() and on_signal(), then the signal trampoline
+            for (int f = sample.depth - 1; f >= 3; f--) stack += ";" + symbol_name(sample.frames[f]);
+            stacks_[stack]++;
+            sampled_++;
+            sample.ready.store(false, std::memory_order_relaxed);
+            read_.store(++read, std::memory_order_release);
+        }
+    }
+
+    std::string symbol_name(void* address) {
+        auto cached = symbols_.find(address);
+        if (cached != symbols_.end()) return cached->second;
+        std::string name;
+        Dl_info info = {};
+        bool found = dladdr(address, &info) != 0;
+        if (found && info.dli_sname) {
+            int status = 0;
+            char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+            name = status == 0 && demangled ? demangled : info.dli_sname;
+            std::free(demangled);
+        } else {
+            // Static functions have no dynamic symbol: module and address
+            std::ostringstream hex;
+            if (found && info.dli_fname) {
+                const char* base = std::strrchr(info.dli_fname, '/');
+                hex << (base ? base + 1 : info.dli_fname) << "+0x" << std::hex
+                    << (static_cast<char*>(address) - static_cast<char*>(info.dli_fbase));
+            } else {
+                hex << address;
+            }
+            name = hex.str();
+        }
+        // ';' separates frames and ' ' the count in the collapsed format
+        for (char& c : name) {
+            if (c == ';') c = ':';
+        }
+        symbols_[address] = name;
+        return name;
+    }
+
+    std::mutex mutex_;
+    bool running_ = false;
+    int hz_ = 0;
+    std::atomic<bool> active_{ false };
+    std::unique_ptr<ProfileSample[]> samples_;
+    std::atomic<uint64_t> written_{ 0 };
+    std::atomic<uint64_t> read_{ 0 };
+    std::atomic<uint64_t> dropped_{ 0 };
+    uint64_t sampled_ = 0;
+    std::map<std::string, uint64_t> stacks_;
+    std::map<void*, std::string> symbols_;
+};
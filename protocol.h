@@ -0,0 +1,221 @@
+#pragma once
+
+#include "batch_frame.h"
+#include "seal/util/blake2.h"
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+// --- Session Hello ---
+// Every session starts with a hello frame. A new session leaves the fingerprint
+// empty and uploads parameters and keys next (parms, pk, rlk, glk). A client
+// that reconnects after losing a connection sends the fingerprint of the keys it
+// uploaded before, skips the upload and gets a reply saying whether the server
+// still holds those keys. Without them it can only fetch finished results by
+// request id; the results are encrypted, so the fingerprint needs no secrecy.
+// If the keys have been moved to another server (see session_migration.h), the
+// reply names that server instead, as "host:port", and the client resumes
+// there.
+
+const uint32_t SESSION_MAGIC = 0x53454846;  // "FHES"
+
+// BLAKE2b-256 over the serialized parameters and public key, in hex.
+inline std::string key_fingerprint(const std::string& parms_bytes, const std::string& public_key_bytes) {
+    std::string input = parms_bytes + public_key_bytes;
+    unsigned char digest[32];
+    blake2b(digest, sizeof(digest), input.data(), input.size(), nullptr, 0);
+    static const char hex[] = "0123456789abcdef";
+    std::string fingerprint;
+    for (unsigned char byte : digest) {
+        fingerprint += hex[byte >> 4];
+        fingerprint += hex[byte & 0xF];
+    }
+    return fingerprint;
+}
+
+inline std::string encode_session_hello(const std::string& resume_fingerprint) {
+    std::string payload;
+    batch_frame_detail::put<uint32_t>(payload, SESSION_MAGIC);
+    batch_frame_detail::put<uint32_t>(payload, static_cast<uint32_t>(resume_fingerprint.size()));
+    return payload + resume_fingerprint;
+}
+
+// Returns the fingerprint to resume, or an empty string for a new session.
+inline std::string decode_session_hello(const std::string& payload) {
+    size_t pos = 0;
+    if (batch_frame_detail::get<uint32_t>(payload, pos) != SESSION_MAGIC) throw std::invalid_argument("hello: bad magic");
+    uint32_t size = batch_frame_detail::get<uint32_t>(payload, pos);
+    if (size > 64 || payload.size() - pos != size) throw std::invalid_argument("hello: bad fingerprint");
+    return payload.substr(pos);
+}
+
+struct SessionReply {
+    bool keys_loaded = false;
+    std::string moved_to; // set if the keys now live on another server
+};
+
+inline std::string encode_session_reply(bool keys_loaded) {
+    std::string payload;
+    batch_frame_detail::put<uint32_t>(payload, SESSION_MAGIC);
+    batch_frame_detail::put<uint32_t>(payload, keys_loaded ? 1 : 0);
+    return payload;
+}
+
+inline std::string encode_session_redirect(const std::string& address) {
+    std::string payload;
+    batch_frame_detail::put<uint32_t>(payload, SESSION_MAGIC);
+    batch_frame_detail::put<uint32_t>(payload, 2);
+    return payload + address;
+}
+
+inline SessionReply decode_session_reply(const std::string& payload) {
+    size_t pos = 0;
+    if (batch_frame_detail::get<uint32_t>(payload, pos) != SESSION_MAGIC) throw std::invalid_argument("session reply: bad magic");
+    SessionReply reply;
+    uint32_t state = batch_frame_detail::get<uint32_t>(payload, pos);
+    if (state == 2) {
+        reply.moved_to = payload.substr(pos);
+    } else {
+        reply.keys_loaded = state != 0;
+    }
+    return reply;
+}
+
+// Splits "host:port". Returns false if address is not of that form.
+inline bool split_address(const std::string& address, std::string& host, int& port) {
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos || colon == 0 || colon + 1 == address.size()) return false;
+    try {
+        size_t used = 0;
+        port = std::stoi(address.substr(colon + 1), &used);
+        if (used != address.size() - colon - 1 || port <= 0 || port > 65535) return false;
+    } catch (const std::exception&) {
+        return false;
+    }
+    host = address.substr(0, colon);
+    return true;
+}
+
+// --- Request and Response Headers ---
+// After the keys, a client sends any number of request frames and receives one
+// response frame per request, in the order it sent them. Each frame payload is
+// a fixed header followed by a batch frame (batch_frame.h).
+//
+// A request header declares which slots the request's amounts occupy:
+// slot_width slots starting at slot_offset, zero everywhere else. A replicated
+// request, with the amount in every slot, has slot_offset 0 and slot_width equal
+// to the slot count. Requests with narrow, disjoint layouts can share one
+// evaluation on the server (see coalescer.h).
+//
+// A nonzero request_id, chosen by the client (at random, unique per key),
+// makes the request idempotent: the server keeps finished results for a while,
+// keyed by key fingerprint and request id, and a request with an id it has seen
+// gets the stored result instead of a new evaluation. A fetch-only request
+// carries no inputs and only asks for such a stored result.
+//
+// A response header echoes the request id and tells the client where its
+// results are in the packed response ciphertext: result i is at slot
+// i * result_stride + slot_offset. A response with status moved carries the
+// address of the server that now holds the keys in place of the batch frame;
+// the client sends the request again there.
+
+const uint32_t REQUEST_MAGIC = 0x51454846;  // "FHEQ"
+const uint32_t RESPONSE_MAGIC = 0x50454846; // "FHEP"
+
+enum class ResponseStatus : uint32_t {
+    ok = 0,
+    invalid_request = 1,  // malformed frame, missing inputs or an unusable slot layout
+    server_error = 2,
+    not_found = 3,        // fetch-only request for an id the server has no result for
+    keys_required = 4,    // resumed session without loaded keys asked for an evaluation
+    too_costly = 5,       // estimated cost exceeds the server's per-request limit (parameters too large)
+    overloaded = 6,       // too much work queued; retry later
+    memory_limit = 7,     // the session has too much in flight; wait for responses first
+    moved = 8             // the keys moved to another server, named in the frame; resend there
+};
+
+inline const char* response_status_name(ResponseStatus status) {
+    switch (status) {
+    case ResponseStatus::ok: return "ok";
+    case ResponseStatus::invalid_request: return "invalid request";
+    case ResponseStatus::server_error: return "server error";
+    case ResponseStatus::not_found: return "not found";
+    case ResponseStatus::keys_required: return "keys required";
+    case ResponseStatus::too_costly: return "too costly";
+    case ResponseStatus::overloaded: return "server overloaded, retry later";
+    case ResponseStatus::memory_limit: return "session memory limit reached";
+    case ResponseStatus::moved: return "moved to another server";
+    }
+    return "unknown status";
+}
+
+const uint32_t REQUEST_FETCH_ONLY = 1;
+
+struct RequestHeader {
+    uint64_t request_id = 0; // 0: not idempotent, never stored
+    uint32_t flags = 0;
+    uint32_t slot_offset = 0;
+    uint32_t slot_width = 0;
+};
+
+struct ResponseHeader {
+    uint64_t request_id = 0;
+    ResponseStatus status = ResponseStatus::ok;
+    uint32_t result_count = 0;
+    uint32_t result_stride = 0;
+    uint32_t slot_offset = 0;
+};
+
+inline std::string encode_request(const RequestHeader& header, const std::string& batch_frame) {
+    std::string payload;
+    batch_frame_detail::put<uint32_t>(payload, REQUEST_MAGIC);
+    batch_frame_detail::put<uint64_t>(payload, header.request_id);
+    batch_frame_detail::put<uint32_t>(payload, header.flags);
+    batch_frame_detail::put<uint32_t>(payload, header.slot_offset);
+    batch_frame_detail::put<uint32_t>(payload, header.slot_width);
+    return payload + batch_frame;
+}
+
+// Magic, request id, flags, slot offset and slot width
+const size_t REQUEST_HEADER_BYTES = 2 * sizeof(uint32_t) + sizeof(uint64_t) + 2 * sizeof(uint32_t);
+
+// Splits a request payload into its header and batch frame. The payload's
+// buffer becomes the batch frame, so a moved-in payload is not copied. Throws
+// std::invalid_argument if the header is malformed.
+inline RequestHeader decode_request(std::string payload, std::string& batch_frame) {
+    size_t pos = 0;
+    if (batch_frame_detail::get<uint32_t>(payload, pos) != REQUEST_MAGIC) throw std::invalid_argument("request: bad magic");
+    RequestHeader header;
+    header.request_id = batch_frame_detail::get<uint64_t>(payload, pos);
+    header.flags = batch_frame_detail::get<uint32_t>(payload, pos);
+    header.slot_offset = batch_frame_detail::get<uint32_t>(payload, pos);
+    header.slot_width = batch_frame_detail::get<uint32_t>(payload, pos);
+    payload.erase(0, pos);
+    batch_frame = std::move(payload);
+    return header;
+}
+
+inline std::string encode_response(const ResponseHeader& header, const std::string& batch_frame) {
+    std::string payload;
+    batch_frame_detail::put<uint32_t>(payload, RESPONSE_MAGIC);
+    batch_frame_detail::put<uint64_t>(payload, header.request_id);
+    batch_frame_detail::put<uint32_t>(payload, static_cast<uint32_t>(header.status));
+    batch_frame_detail::put<uint32_t>(payload, header.result_count);
+    batch_frame_detail::put<uint32_t>(payload, header.result_stride);
+    batch_frame_detail::put<uint32_t>(payload, header.slot_offset);
+    return payload + batch_frame;
+}
+
+inline ResponseHeader decode_response(const std::string& payload, std::string& batch_frame) {
+    size_t pos = 0;
+    if (batch_frame_detail::get<uint32_t>(payload, pos) != RESPONSE_MAGIC) throw std::invalid_argument("response: bad magic");
+    ResponseHeader header;
+    header.request_id = batch_frame_detail::get<uint64_t>(payload, pos);
+    header.status = static_cast<ResponseStatus>(batch_frame_detail::get<uint32_t>(payload, pos));
+    header.result_count = batch_frame_detail::get<uint32_t>(payload, pos);
+    header.result_stride = batch_frame_detail::get<uint32_t>(payload, pos);
+    header.slot_offset = batch_frame_detail::get<uint32_t>(payload, pos);
+    batch_frame = payload.substr(pos);
+    return header;
+}
@@ -0,0 +1,373 @@
+#include "capture.h"
+#include "frame_stream.h"
+#include "protocol.h"
+#include "deterministic_rng.h"
+#include "soak.h"
+#include <iostream>
+#include <vector>
+#include <map>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+
+// Headers for socket programming
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+using namespace std;
+
+// --- Capture Replay ---
+// Sends the traffic recorded by server_app --capture to a server again. Every
+// captured connection is opened and its frames are sent at the times they
+// originally arrived, divided by --speed (0 sends everything as fast as
+// possible). Request ids are remapped per run, so a server that is still up
+// evaluates the requests again instead of answering from its result cache;
+// --keep-ids sends them unchanged. Responses are matched to requests in order
+// (the server answers each connection's requests in order) for the latency
+// figures. With --soak-minutes the capture is replayed in rounds, each with
+// fresh request ids, and the server is sampled as it runs (see soak.h).
+
+// --- Networking Helper Functions ---
+bool send_data(int sock, const string& data) {
+    size_t data_size = data.size();
+    return send_exact(sock, &data_size, sizeof(data_size)) && send_exact(sock, data.data(), data_size);
+}
+
+// Returns an empty string once the server has closed the connection
+string receive_data(int sock) {
+    size_t data_size;
+    if (!recv_exact(sock, &data_size, sizeof(data_size))) return "";
+    string data(data_size, '\0');
+    if (data_size > 0 && !recv_exact(sock, &data[0], data_size)) return "";
+    return data;
+}
+
+int connect_to(const string& ip, int port) {
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) return -1;
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip.c_str(), &address.sin_addr) <= 0 ||
+        connect(sock, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+uint32_t frame_magic(const string& payload) {
+    uint32_t magic = 0;
+    if (payload.size() >= sizeof(magic)) memcpy(&magic, payload.data(), sizeof(magic));
+    return magic;
+}
+
+// Request ids sit right after the request magic; 0 (not idempotent) stays 0
+void remap_request_id(string& payload, uint64_t salt) {
+    const size_t offset = sizeof(uint32_t);
+    uint64_t id = 0;
+    if (payload.size() < offset + sizeof(id)) return;
+    memcpy(&id, payload.data() + offset, sizeof(id));
+    if (id == 0) return;
+    uint64_t remapped = id ^ salt;
+    if (remapped == 0) remapped = id;
+    memcpy(&payload[offset], &remapped, sizeof(remapped));
+}
+
+struct ReplayStats {
+    size_t connections = 0;
+    size_t failed_connections = 0;
+    size_t frames = 0;
+    size_t requests = 0;
+    size_t responses = 0;
+    size_t ok = 0;
+    vector<double> latencies_ms;
+    vector<double> window_ms; // since the last soak sample
+};
+
+double percentile(vector<double> values, double fraction) {
+    if (values.empty()) return 0;
+    sort(values.begin(), values.end());
+    size_t index = static_cast<size_t>(fraction * static_cast<double>(values.size() - 1) + 0.5);
+    return values[min(index, values.size() - 1)];
+}
+
+// Replays one connection's records. Times are relative to start.
+void replay_connection(const vector<const CaptureRecord*>& records, chrono::steady_clock::time_point start, double speed,
+                       const string& ip, int port, bool keep_ids, uint64_t salt, ReplayStats& stats, mutex& stats_mutex) {
+    auto wait_for = [&](uint64_t microseconds) {
+        if (speed > 0) this_thread::sleep_until(start + chrono::microseconds(static_cast<int64_t>(microseconds / speed)));
+    };
+    wait_for(records.front()->microseconds);
+    int sock = connect_to(ip, port);
+    if (sock < 0) {
+        lock_guard<mutex> lock(stats_mutex);
+        stats.failed_connections++;
+        return;
+    }
+
+    mutex sent_mutex;
+    deque<chrono::steady_clock::time_point> sent; // requests awaiting a response
+    thread reader([&]() {
+        while (true) {
+            string payload = receive_data(sock);
+            if (payload.empty()) break;
+            if (frame_magic(payload) != RESPONSE_MAGIC) continue; // hello replies
+            auto now = chrono::steady_clock::now();
+            bool ok = false;
+            try {
+                string frame;
+                ok = decode_response(payload, frame).status == ResponseStatus::ok;
+            } catch (const exception&) {
+            }
+            double latency_ms = -1;
+            {
+                lock_guard<mutex> lock(sent_mutex);
+                if (!sent.empty()) {
+                    latency_ms = chrono::duration<double, milli>(now - sent.front()).count();
+                    sent.pop_front();
+                }
+            }
+            lock_guard<mutex> lock(stats_mutex);
+            stats.responses++;
+            stats.ok += ok ? 1 : 0;
+            if (latency_ms >= 0) {
+                stats.latencies_ms.push_back(latency_ms);
+                stats.window_ms.push_back(latency_ms);
+            }
+        }
+    });
+
+    size_t frames = 0, requests = 0;
+    for (const CaptureRecord* record : records) {
+        if (record->kind != CaptureKind::frame) continue;
+        wait_for(record->microseconds);
+        string payload = record->payload;
+        bool request = frame_magic(payload) == REQUEST_MAGIC;
+        if (request && !keep_ids) remap_request_id(payload, salt);
+        if (request) {
+            lock_guard<mutex> lock(sent_mutex);
+            sent.push_back(chrono::steady_clock::now());
+        }
+        if (!send_data(sock, payload)) break;
+        frames++;
+        requests += request ? 1 : 0;
+    }
+    // The captured close, then whatever responses are still coming
+    if (records.back()->kind == CaptureKind::close) wait_for(records.back()->microseconds);
+    shutdown(sock, SHUT_WR);
+    reader.join();
+    close(sock);
+
+    lock_guard<mutex> lock(stats_mutex);
+    stats.connections++;
+    stats.frames += frames;
+    stats.requests += requests;
+}
+
+// Prints one soak sample line and returns the sample.
+SoakSample take_soak_sample(double elapsed_s, const string& metrics_path, ReplayStats& stats, mutex& stats_mutex) {
+    SoakSample sample;
+    sample.elapsed_s = elapsed_s;
+    if (!metrics_path.empty()) sample.memory = read_memory_metrics(metrics_path);
+    vector<double> window;
+    {
+        lock_guard<mutex> lock(stats_mutex);
+        window.swap(stats.window_ms);
+    }
+    sample.responses = window.size();
+    sample.p50_ms = percentile(window, 0.5);
+    sample.p95_ms = percentile(window, 0.95);
+    sample.p99_ms = percentile(window, 0.99);
+
+    const size_t MiB = 1024 * 1024;
+    cout << "[soak " << static_cast<long>(elapsed_s) << " s] " << sample.responses << " responses, p50/p95/p99 "
+         << sample.p50_ms << "/" << sample.p95_ms << "/" << sample.p99_ms << " ms";
+    if (sample.memory.valid) {
+        cout << "; RSS " << sample.memory.resident_bytes / MiB << " MiB, global pool "
+             << sample.memory.global_pool_bytes / MiB << " MiB, session pools " << sample.memory.session_pool_bytes / MiB
+             << " MiB (" << sample.memory.sessions << " sessions), key pools " << sample.memory.key_pool_bytes / MiB
+             << " MiB (" << sample.memory.hibernated_key_groups << " groups hibernated), unaccounted "
+             << sample.memory.unaccounted_bytes() / MiB << " MiB";
+    }
+    cout << endl;
+    return sample;
+}
+
+// Flags memory series growing faster than limit MiB per hour, and a p99 that
+// keeps climbing. Returns true if anything was flagged.
+bool report_soak_trends(const vector<SoakSample>& samples, double limit_mib_per_hour) {
+    const double MiB = 1024.0 * 1024.0;
+    const pair<const char*, double> trends[] = {
+        { "RSS", growth_per_hour(samples, [](const SoakSample& s) { return s.memory.resident_bytes; }) / MiB },
+        { "global pool", growth_per_hour(samples, [](const SoakSample& s) { return s.memory.global_pool_bytes; }) / MiB },
+        { "session pools", growth_per_hour(samples, [](const SoakSample& s) { return s.memory.session_pool_bytes; }) / MiB },
+        { "key pools", growth_per_hour(samples, [](const SoakSample& s) { return s.memory.key_pool_bytes; }) / MiB },
+        { "unaccounted heap", growth_per_hour(samples, [](const SoakSample& s) { return s.memory.unaccounted_bytes(); }) / MiB },
+    };
+    bool flagged = false;
+    cout << "Soak trends over the second half of the run:" << endl;
+    for (const auto& trend : trends) {
+        bool growing = trend.second > limit_mib_per_hour;
+        flagged |= growing;
+        cout << "  " << trend.first << string(18 - min<size_t>(18, strlen(trend.first)), ' ') << trend.second << " MiB/hour"
+             << (growing ? "  <-- GROWING" : "") << endl;
+    }
+    // A p99 rising by more than half its mean per hour
+    double latency_trend = latency_growth_per_hour(samples);
+    double mean_p99 = 0;
+    size_t answered = 0;
+    for (const SoakSample& s : samples) {
+        if (s.responses == 0) continue;
+        mean_p99 += s.p99_ms;
+        answered++;
+    }
+    if (answered > 0) mean_p99 /= static_cast<double>(answered);
+    bool slowing = mean_p99 > 0 && latency_trend > mean_p99 / 2;
+    flagged |= slowing;
+    cout << "  p99 latency       " << latency_trend << " ms/hour" << (slowing ? "  <-- GROWING" : "") << endl;
+
+    // What hibernation gave back: the peak against the last sample
+    const SoakSample* peak = nullptr;
+    const SoakSample* last = nullptr;
+    for (const SoakSample& s : samples) {
+        if (!s.memory.valid) continue;
+        if (!peak || s.memory.resident_bytes > peak->memory.resident_bytes) peak = &s;
+        last = &s;
+    }
+    if (last && last->memory.hibernated_key_groups > 0) {
+        cout << "Key hibernation: " << last->memory.hibernated_key_groups << " groups hibernated; RSS "
+             << peak->memory.resident_bytes / MiB << " MiB at its peak, " << last->memory.resident_bytes / MiB
+             << " MiB now; key pools " << peak->memory.key_pool_bytes / MiB << " -> " << last->memory.key_pool_bytes / MiB
+             << " MiB" << endl;
+    }
+    return flagged;
+}
+
+int main(int argc, char* argv[]) {
+    // --- Options ---
+    // replay_app CAPTURE [--speed X] [--server IP:PORT] [--keep-ids]
+    //            [--soak-minutes M [--sample-s S] [--metrics-file PATH] [--growth-limit-mb-per-hour MB]]
+    // --speed X: X times the captured pace (default 1; 0: no pauses).
+    // --soak-minutes M: replay in rounds for M minutes, sampling every S
+    // seconds (default 60) the server's --metrics-file PATH (same machine) and
+    // the latency percentiles; fails if memory grows faster than MB per hour
+    // (default 16) over the second half of the run.
+    string capture_path;
+    double speed = 1.0;
+    string ip = "127.0.0.1";
+    int port = 8080;
+    bool keep_ids = false;
+    double soak_minutes = 0;
+    long sample_s = 60;
+    string metrics_path;
+    double growth_limit = 16;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--speed" && i + 1 < argc) {
+            speed = atof(argv[++i]);
+        } else if (arg == "--server" && i + 1 < argc && split_address(argv[i + 1], ip, port)) {
+            i++;
+        } else if (arg == "--keep-ids") {
+            keep_ids = true;
+        } else if (arg == "--soak-minutes" && i + 1 < argc) {
+            soak_minutes = atof(argv[++i]);
+        } else if (arg == "--sample-s" && i + 1 < argc) {
+            sample_s = atol(argv[++i]);
+        } else if (arg == "--metrics-file" && i + 1 < argc) {
+            metrics_path = argv[++i];
+        } else if (arg == "--growth-limit-mb-per-hour" && i + 1 < argc) {
+            growth_limit = atof(argv[++i]);
+        } else if (capture_path.empty() && arg.rfind("--", 0) != 0) {
+            capture_path = arg;
+        } else {
+            capture_path.clear();
+            break;
+        }
+    }
+    if (capture_path.empty() || speed < 0 || soak_minutes < 0 || sample_s <= 0) {
+        cerr << "Usage: " << argv[0] << " CAPTURE [--speed X] [--server IP:PORT] [--keep-ids]"
+             << " [--soak-minutes M [--sample-s S] [--metrics-file PATH] [--growth-limit-mb-per-hour MB]]" << endl;
+        return 1;
+    }
+
+    vector<CaptureRecord> records;
+    try {
+        records = read_capture(capture_path);
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+    map<uint64_t, vector<const CaptureRecord*>> connections;
+    for (const auto& record : records) connections[record.connection].push_back(&record);
+    cout << "Replaying " << records.size() << " records on " << connections.size() << " connections to " << ip << ":" << port
+         << (speed > 0 ? " at " + to_string(speed) + "x speed." : " without pauses.") << endl;
+    uint64_t first = records.empty() ? 0 : records.front().microseconds;
+    for (auto& record : records) record.microseconds -= first;
+
+    // --- Soak Sampling ---
+    ReplayStats stats;
+    mutex stats_mutex;
+    auto soak_start = chrono::steady_clock::now();
+    auto soak_end = soak_start + chrono::milliseconds(static_cast<int64_t>(soak_minutes * 60000));
+    vector<SoakSample> samples;
+    mutex sampler_mutex;
+    condition_variable sampler_cv;
+    bool replay_done = false;
+    thread sampler;
+    if (soak_minutes > 0) {
+        if (metrics_path.empty()) cout << "No --metrics-file: sampling latency only." << endl;
+        sampler = thread([&]() {
+            unique_lock<mutex> lock(sampler_mutex);
+            while (!sampler_cv.wait_for(lock, chrono::seconds(sample_s), [&]() { return replay_done; })) {
+                double elapsed = chrono::duration<double>(chrono::steady_clock::now() - soak_start).count();
+                samples.push_back(take_soak_sample(elapsed, metrics_path, stats, stats_mutex));
+            }
+        });
+    }
+
+    // --- Replay ---
+    // One round is the whole capture; a soak runs rounds until its time is up
+    random_device device;
+    size_t rounds = 0;
+    do {
+        uint64_t salt = (static_cast<uint64_t>(device()) << 32) | device();
+        auto start = chrono::steady_clock::now();
+        vector<thread> replayers;
+        for (const auto& connection : connections) {
+            replayers.emplace_back([&, connection]() {
+                replay_connection(connection.second, start, speed, ip, port, keep_ids, salt, stats, stats_mutex);
+            });
+        }
+        for (auto& replayer : replayers) replayer.join();
+        rounds++;
+    } while (soak_minutes > 0 && chrono::steady_clock::now() < soak_end && stats.failed_connections == 0);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - soak_start).count();
+    if (sampler.joinable()) {
+        {
+            lock_guard<mutex> lock(sampler_mutex);
+            replay_done = true;
+        }
+        sampler_cv.notify_all();
+        sampler.join();
+    }
+
+    cout << "Replayed " << stats.connections << " connections (" << stats.failed_connections << " could not connect), "
+         << stats.frames << " frames, " << stats.requests << " requests in " << seconds << " s";
+    if (rounds > 1) cout << " (" << rounds << " rounds)";
+    cout << "." << endl;
+    cout << stats.responses << " responses, " << stats.ok << " ok. Latency: p50 " << percentile(stats.latencies_ms, 0.5)
+         << " ms, p95 " << percentile(stats.latencies_ms, 0.95) << " ms, p99 " << percentile(stats.latencies_ms, 0.99)
+         << " ms." << endl;
+    bool growing = soak_minutes > 0 && report_soak_trends(samples, growth_limit);
+    return stats.failed_connections == 0 && stats.responses == stats.requests && !growing ? 0 : 1;
+}
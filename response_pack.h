@@ -0,0 +1,155 @@
+#pragma once
+
+#include "seal/seal.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// --- Response Packing ---
+// Each budget result is one amount replicated across every slot, yet it used to
+// travel as its own full ciphertext. ResponsePacker gives result i its own slot
+// range, multiplies it by a 0/1 plaintext mask for that range and sums the
+// masked results, so the whole response is a single ciphertext. Results that
+// hold their data in slots [0, width) instead of replicated are first rotated
+// into place. The packed ciphertext is then mod-switched down as far as the
+// estimated noise budget allows.
+
+// Where each packed result lives: result i occupies slots
+// [offset(i), offset(i) + width) of the first batching row.
+struct ResponseLayout {
+    size_t count = 0;
+    size_t width = 0;
+    size_t offset(size_t index) const { return index * width; }
+};
+
+// Widest power-of-two ranges that fit count results in one row. Client and
+// server derive the same layout from the slot count and number of results.
+inline ResponseLayout make_response_layout(size_t slot_count, size_t count) {
+    size_t row_size = slot_count / 2;
+    if (count == 0 || count > row_size) throw std::invalid_argument("make_response_layout: invalid result count");
+    size_t ranges = 1;
+    while (ranges < count) ranges <<= 1;
+    return ResponseLayout{ count, row_size / ranges };
+}
+
+// --- Noise Budget Estimates ---
+// The server cannot measure the noise budget (that needs the secret key), so it
+// uses a conservative model of BFV invariant noise, in bits. Fresh ciphertexts
+// have about log2(q) - log2(t) - log2(N) - 5 bits (this matches SEAL's measured
+// budgets for the default parameters). Additions cost at most one bit, a plain
+// multiplication by an arbitrary plaintext at most log2(t) + log2(N) bits.
+// Switching down to modulus q' keeps the budget but caps it at the rounding
+// noise floor, log2(q') - log2(t) - log2(N) - 2.
+inline int fresh_noise_budget_estimate(const seal::SEALContext& context) {
+    auto context_data = context.first_context_data();
+    const auto& parms = context_data->parms();
+    int log_n = static_cast<int>(std::log2(static_cast<double>(parms.poly_modulus_degree())));
+    return context_data->total_coeff_modulus_bit_count() - parms.plain_modulus().bit_count() - log_n - 5;
+}
+
+inline int multiply_plain_noise_cost(const seal::SEALContext& context) {
+    const auto& parms = context.first_context_data()->parms();
+    int log_n = static_cast<int>(std::log2(static_cast<double>(parms.poly_modulus_degree())));
+    return parms.plain_modulus().bit_count() + log_n;
+}
+
+inline int mod_switch_noise_floor(const seal::SEALContext::ContextData& context_data) {
+    const auto& parms = context_data.parms();
+    int log_n = static_cast<int>(std::log2(static_cast<double>(parms.poly_modulus_degree())));
+    return context_data.total_coeff_modulus_bit_count() - parms.plain_modulus().bit_count() - log_n - 2;
+}
+
+// Switches encrypted down the modulus chain while the estimated budget stays at
+// or above min_budget bits. Returns the estimated budget at the final level.
+inline int mod_switch_within_budget(const seal::SEALContext& context, const seal::Evaluator& evaluator,
+                                    seal::Ciphertext& encrypted, int estimated_budget, int min_budget,
+                                    seal::MemoryPoolHandle pool = seal::MemoryManager::GetPool()) {
+    auto context_data = context.get_context_data(encrypted.parms_id());
+    if (!context_data) throw std::invalid_argument("mod_switch_within_budget: ciphertext is not valid for the context");
+    while (auto next = context_data->next_context_data()) {
+        int next_budget = std::min(estimated_budget, mod_switch_noise_floor(*next));
+        if (next_budget < min_budget) break;
+        evaluator.mod_switch_to_next_inplace(encrypted, pool);
+        estimated_budget = next_budget;
+        context_data = next;
+    }
+    return estimated_budget;
+}
+
+class ResponsePacker {
+public:
+    ResponsePacker(const seal::SEALContext& context, const seal::BatchEncoder& batch_encoder, size_t count)
+        : context_(context), layout_(make_response_layout(batch_encoder.slot_count(), count)) {
+        size_t slot_count = batch_encoder.slot_count();
+        masks_.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            std::vector<uint64_t> mask(slot_count, 0);
+            for (size_t s = layout_.offset(i); s < layout_.offset(i) + layout_.width; s++) mask[s] = 1;
+            batch_encoder.encode(mask, masks_[i]);
+        }
+    }
+
+    const ResponseLayout& layout() const { return layout_; }
+
+    // Packs results (all at the same level) into destination. With replicated
+    // false each result's data is taken from slots [0, width) and rotated into
+    // its range, which needs Galois keys. Returns the estimated noise budget of
+    // the packed ciphertext given the smallest estimated budget of the inputs.
+    int pack(const seal::Evaluator& evaluator, const std::vector<const seal::Ciphertext*>& results, int input_budget,
+             seal::Ciphertext& destination, bool replicated = true, const seal::GaloisKeys* galois_keys = nullptr,
+             seal::MemoryPoolHandle pool = seal::MemoryManager::GetPool()) const {
+        if (results.size() != layout_.count) throw std::invalid_argument("ResponsePacker: wrong number of results");
+        if (!replicated && !galois_keys) throw std::invalid_argument("ResponsePacker: rotating results needs Galois keys");
+        seal::Ciphertext masked(pool);
+        seal::Ciphertext rotated(pool);
+        for (size_t i = 0; i < results.size(); i++) {
+            const seal::Ciphertext* source = results[i];
+            if (!replicated && layout_.offset(i) != 0) {
+                evaluator.rotate_rows(*source, -static_cast<int>(layout_.offset(i)), *galois_keys, rotated, pool);
+                source = &rotated;
+            }
+            if (i == 0) {
+                evaluator.multiply_plain(*source, masks_[i], destination, pool);
+            } else {
+                evaluator.multiply_plain(*source, masks_[i], masked, pool);
+                evaluator.add_inplace(destination, masked);
+            }
+        }
+        // Key switching adds a small additive term; one bit covers it
+        int additions = static_cast<int>(std::ceil(std::log2(static_cast<double>(results.size()))));
+        return input_budget - multiply_plain_noise_cost(context_) - additions - (replicated ? 0 : 1);
+    }
+
+private:
+    const seal::SEALContext& context_;
+    ResponseLayout layout_;
+    std::vector<seal::Plaintext> masks_;
+};
+
+// --- Bit Dropping ---
+// Low bits of c0 and c1 that a size-2 ciphertext at context_data can lose (see
+// BatchFrameWriter::add_bit_dropped) while keeping at least min_budget bits of
+// noise budget. Dropping d bits perturbs a coefficient by at most 2^d; in
+// c0 + c1 * s the c1 error is multiplied by the ternary secret, i.e. by up to N.
+// With the existing noise within budget (estimated_budget > min_budget), each
+// error term gets a quarter of the remaining 2^-(min_budget + 1), so
+//   drop_c0 = log2(q) - log2(t) - min_budget - 3,  drop_c1 = drop_c0 - log2(N).
+struct BitDrop {
+    int c0 = 0;
+    int c1 = 0;
+};
+
+inline BitDrop bit_drop_for_budget(const seal::SEALContext::ContextData& context_data, int estimated_budget,
+                                   int min_budget) {
+    BitDrop drop;
+    if (estimated_budget <= min_budget) return drop;
+    const auto& parms = context_data.parms();
+    int log_q = context_data.total_coeff_modulus_bit_count() - 1;
+    int log_n = static_cast<int>(std::log2(static_cast<double>(parms.poly_modulus_degree())));
+    int c0 = log_q - parms.plain_modulus().bit_count() - min_budget - 3;
+    drop.c0 = std::max(c0, 0);
+    drop.c1 = std::max(c0 - log_n, 0);
+    return drop;
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "coalescer.h"
+#include "protocol.h"
+#include <cstdint>
+#include <future>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// --- Result Cache ---
+// Responses to idempotent requests (nonzero request id), keyed by key
+// fingerprint and request id. A request is registered when it is submitted, so
+// a retry that arrives while the first attempt is still being evaluated waits
+// for that evaluation instead of starting another. Once a response is ready it
+// is kept if its status is ok and forgotten otherwise, so a failed request can
+// be retried for real. Finished responses are evicted least recently used first
+// once their frames exceed max_bytes. Coalesced requests share one frame, which
+// is counted once.
+
+struct ResultCacheStats {
+    size_t entries = 0;   // finished responses held
+    size_t pending = 0;   // evaluations in progress
+    size_t bytes = 0;     // distinct response frames held
+    size_t hits = 0;
+    size_t evictions = 0;
+};
+
+class ResultCache {
+public:
+    explicit ResultCache(size_t max_bytes) : max_bytes_(max_bytes) {}
+
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    // The stored or in-progress response for this request, if there is one.
+    bool find(const std::string& fingerprint, uint64_t request_id, std::shared_future<PlanResponse>& response) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = entries_.find({ fingerprint, request_id });
+        if (found == entries_.end()) return false;
+        if (found->second.finished) lru_.splice(lru_.end(), lru_, found->second.position);
+        hits_++;
+        response = found->second.response;
+        return true;
+    }
+
+    // Registers an evaluation in progress. If the same request was registered
+    // in the meantime, that evaluation is returned instead.
+    std::shared_future<PlanResponse> track(const std::string& fingerprint, uint64_t request_id,
+                                           std::shared_future<PlanResponse> response) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto inserted = entries_.emplace(Key{ fingerprint, request_id }, Entry{ response, false, {} });
+        return inserted.first->second.response;
+    }
+
+    // Called with each response once it is ready. Keeps ok responses, forgets
+    // the rest; responses already stored are left alone.
+    void complete(const std::string& fingerprint, uint64_t request_id, const PlanResponse& response) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = entries_.find({ fingerprint, request_id });
+        if (found == entries_.end() || found->second.finished) return;
+        if (response.header.status != ResponseStatus::ok) {
+            entries_.erase(found);
+            return;
+        }
+        found->second.finished = true;
+        found->second.position = lru_.insert(lru_.end(), found->first);
+        if (frame_refs_[response.frame.get()]++ == 0) bytes_ += response.frame->size();
+        while (bytes_ > max_bytes_ && !lru_.empty()) {
+            evict(lru_.front());
+        }
+    }
+
+    // Stores a finished response received from another server (see
+    // session_migration.h).
+    void store(const std::string& fingerprint, uint64_t request_id, const PlanResponse& response) {
+        std::promise<PlanResponse> ready;
+        ready.set_value(response);
+        track(fingerprint, request_id, ready.get_future().share());
+        complete(fingerprint, request_id, response);
+    }
+
+    // Finished responses under fingerprint, by request id.
+    std::vector<std::pair<uint64_t, PlanResponse>> finished(const std::string& fingerprint) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<std::pair<uint64_t, PlanResponse>> responses;
+        for (auto it = entries_.lower_bound({ fingerprint, 0 }); it != entries_.end() && it->first.first == fingerprint; ++it) {
+            if (it->second.finished) responses.emplace_back(it->first.second, it->second.response.get());
+        }
+        return responses;
+    }
+
+    // Evaluations in progress under fingerprint.
+    size_t pending(const std::string& fingerprint) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t count = 0;
+        for (auto it = entries_.lower_bound({ fingerprint, 0 }); it != entries_.end() && it->first.first == fingerprint; ++it) {
+            count += it->second.finished ? 0 : 1;
+        }
+        return count;
+    }
+
+    ResultCacheStats stats() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ResultCacheStats stats;
+        stats.entries = lru_.size();
+        stats.pending = entries_.size() - lru_.size();
+        stats.bytes = bytes_;
+        stats.hits = hits_;
+        stats.evictions = evictions_;
+        return stats;
+    }
+
+private:
+    using Key = std::pair<std::string, uint64_t>;
+
+    struct Entry {
+        std::shared_future<PlanResponse> response;
+        bool finished;
+        std::list<Key>::iterator position; // in lru_, once finished
+    };
+
+    void evict(Key key) {
+        auto found = entries_.find(key);
+        const std::string* frame = found->second.response.get().frame.get();
+        auto refs = frame_refs_.find(frame);
+        if (--refs->second == 0) {
+            bytes_ -= frame->size();
+            frame_refs_.erase(refs);
+        }
+        lru_.erase(found->second.position);
+        entries_.erase(found);
+        evictions_++;
+    }
+
+    const size_t max_bytes_;
+    std::mutex mutex_;
+    std::map<Key, Entry> entries_;
+    std::list<Key> lru_;                           // finished entries, least recently used first
+    std::map<const std::string*, size_t> frame_refs_;
+    size_t bytes_ = 0;
+    size_t hits_ = 0;
+    size_t evictions_ = 0;
+};
@@ -0,0 +1,21 @@
+#!/bin/sh
+# Runs the benchmark suite from the portable and HEXL builds and prints the
+# per-operation speedup. Build both presets first:
+#   cmake --preset portable && cmake --build --preset portable
+#   cmake --preset hexl && cmake --build --preset hexl
+set -e
+
+DEGREE=${1:-8192}
+ITERATIONS=${2:-20}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+
+"$ROOT/build/portable/benchmark" --degree "$DEGREE" --iterations "$ITERATIONS" --csv > /tmp/fhe_bench_portable.csv
+"$ROOT/build/hexl/benchmark" --degree "$DEGREE" --iterations "$ITERATIONS" --csv > /tmp/fhe_bench_hexl.csv
+
+"$ROOT/build/hexl/benchmark" --degree "$DEGREE" --iterations 1 | sed -n '1,5p'
+echo
+awk -F, '
+    FNR == 1 { next }
+    NR == FNR { portable[$1] = $4; next }
+    { printf "%-18s portable %10.1f us   hexl %10.1f us   speedup %5.2fx\n", $1, portable[$1], $4, portable[$1] / $4 }
+' /tmp/fhe_bench_portable.csv /tmp/fhe_bench_hexl.csv
@@ -0,0 +1,35 @@
+#!/bin/sh
+# Moves a live batch session between two local servers. Server A (port 8080)
+# migrates its key groups to server B (port 8081) on SIGUSR1 while the client
+# is still sending; the client follows the redirect and finishes on B without
+# uploading its keys again. Usage: scripts/migration_demo.sh BIN_DIR [RECORDS]
+set -e
+
+BIN=${1:?usage: migration_demo.sh BIN_DIR [RECORDS]}
+RECORDS=${2:-2000}
+WORK_DIR=$(mktemp -d)
+trap 'kill "$A_PID" "$B_PID" 2> /dev/null; rm -rf "$WORK_DIR"' EXIT
+
+BATCH_CSV="$WORK_DIR/batch.csv"
+j=0
+while [ "$j" -lt "$RECORDS" ]; do
+    echo "$((2000 + j % 500)).50,$((900 + j % 300)),$((150 + j % 100)).25,$((200 + j % 50))" >> "$BATCH_CSV"
+    j=$((j + 1))
+done
+
+"$BIN/server_app" --port 8081 --accept-migrations > "$WORK_DIR/b.log" &
+B_PID=$!
+"$BIN/server_app" --port 8080 --migrate-to 127.0.0.1:8081 > "$WORK_DIR/a.log" &
+A_PID=$!
+sleep 3
+
+"$BIN/client_app" --server 127.0.0.1:8080 --batch "$BATCH_CSV" > "$WORK_DIR/results.csv" &
+CLIENT_PID=$!
+# Once the keys are uploaded and requests are flowing
+sleep 5
+kill -USR1 "$A_PID"
+wait "$CLIENT_PID"
+
+echo "Server A:"; grep -E "Migrated|moved" "$WORK_DIR/a.log" || true
+echo "Server B:"; grep -E "migrated here|Resumed" "$WORK_DIR/b.log" || true
+echo "$(($(wc -l < "$WORK_DIR/results.csv") - 1)) of $RECORDS records evaluated."
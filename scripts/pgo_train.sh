@@ -0,0 +1,52 @@
+#!/bin/sh
+# Collects profile-guided optimization data from a build configured with
+# -DFHE_PGO=GENERATE. Usage: scripts/pgo_train.sh BIN_DIR [SESSIONS]
+set -e
+
+BIN=${1:?usage: pgo_train.sh BIN_DIR [SESSIONS]}
+SESSIONS=${2:-8}
+PGO_DIR=${FHE_PGO_DIR:-$BIN/pgo-profiles}
+mkdir -p "$PGO_DIR"
+
+# Operation microbenchmarks and the in-process budget workload
+"$BIN/benchmark" --iterations 50 > /dev/null
+"$BIN/benchmark" --workload 200 > /dev/null
+
+# Real client/server sessions over the loopback socket. The amounts cycle
+# through a few income/expense/goal shapes so branches see a realistic mix.
+i=0
+while [ "$i" -lt "$SESSIONS" ]; do
+    "$BIN/server_app" --sessions 1 > /dev/null &
+    SERVER_PID=$!
+    sleep 1
+    case $((i % 4)) in
+        0) INPUT='2500.00\n1200.50\ndone\n1400\n650.25\n500\n' ;;
+        1) INPUT='3100.10\ndone\n2200\n950.75\n100\n' ;;
+        2) INPUT='1800\n250.25\n75.5\ndone\n1500.40\n300\n400\n' ;;
+        *) INPUT='done\n0\n0\n0\n' ;;
+    esac
+    printf "$INPUT" | "$BIN/client_app" > /dev/null
+    wait "$SERVER_PID"
+    i=$((i + 1))
+done
+
+# One batch session, so the coalescing path is trained as well
+BATCH_CSV="$PGO_DIR/batch.csv"
+j=0
+: > "$BATCH_CSV"
+while [ "$j" -lt 64 ]; do
+    echo "$((2000 + j * 25)).50,$((900 + j * 7)),$((150 + j * 3)).25,$((200 + j * 5))" >> "$BATCH_CSV"
+    j=$((j + 1))
+done
+"$BIN/server_app" --sessions 1 > /dev/null &
+SERVER_PID=$!
+sleep 1
+"$BIN/client_app" --batch "$BATCH_CSV" > /dev/null
+wait "$SERVER_PID"
+rm -f "$BATCH_CSV"
+
+# Clang writes raw profiles that must be merged before -fprofile-use
+if ls "$PGO_DIR"/*.profraw > /dev/null 2>&1; then
+    llvm-profdata merge -output="$PGO_DIR/merged.profdata" "$PGO_DIR"/*.profraw
+fi
+echo "PGO profiles written to $PGO_DIR"
@@ -0,0 +1,21 @@
+#!/bin/sh
+# End-to-end test: one server_app session serving a client_app batch over the
+# loopback socket. Fails if any record fails. Usage: scripts/session_test.sh BIN_DIR [PORT]
+set -e
+
+BIN=${1:?usage: session_test.sh BIN_DIR [PORT]}
+PORT=${2:-18080}
+BATCH_CSV=$(mktemp)
+trap 'rm -f "$BATCH_CSV"; kill "$SERVER_PID" 2> /dev/null || true' EXIT
+
+j=0
+while [ "$j" -lt 16 ]; do
+    echo "$((2000 + j * 25)).50,$((900 + j * 7)),$((150 + j * 3)).25,$((200 + j * 5))" >> "$BATCH_CSV"
+    j=$((j + 1))
+done
+
+"$BIN/server_app" --port "$PORT" --sessions 1 --warmup none > /dev/null &
+SERVER_PID=$!
+sleep 1
+"$BIN/client_app" --batch "$BATCH_CSV" --server "127.0.0.1:$PORT"
+wait "$SERVER_PID"
@@ -1,15 +1,52 @@
 #include "seal/seal.h"
+#include "kernels.h"
+#include "budget_plan.h"
+#include "frame_stream.h"
+#include "batch_frame.h"
+#include "protocol.h"
+#include "key_registry.h"
+#include "coalescer.h"
+#include "result_cache.h"
+#include "cost_model.h"
+#include "session_memory.h"
+#include "warmup.h"
+#include "hot_restart.h"
+#include "session_migration.h"
+#include "capture.h"
+#include "deterministic_rng.h"
+#include "profiler.h"
+#include "admin.h"
+#include "admin_status.h"
 #include <iostream>
 #include <vector>
 #include <numeric>
 #include <cmath>
 #include <sstream> // For stringstream for network serialization
+#include <fstream> // Cost model calibration file
+#include <map>
+#include <string>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdlib> // For atoi
+#include <cstdio> // For rename
+#include <csignal>
+#include <cerrno>
+#include <set>
+#include <atomic>
 
 // Headers for socket programming
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <netdb.h>
 #include <unistd.h> // For close()
+#include <poll.h>
+#include <fcntl.h>
+#ifdef __GLIBC__
+#include <malloc.h> // malloc_trim
+#endif
 
 using namespace std;
 using namespace seal;
@@ -19,219 +56,1062 @@ using namespace seal;
 bool send_data(int sock, const string& data) {
     size_t data_size = data.size();
     // Send the size of the data first
-    if (send(sock, &data_size, sizeof(data_size), 0) == -1) {
+    if (!send_exact(sock, &data_size, sizeof(data_size))) {
         cerr << "Error sending data size." << endl;
         return false;
     }
     // Send the actual data
-    if (send(sock, data.c_str(), data_size, 0) == -1) {
+    if (!send_exact(sock, data.data(), data_size)) {
         cerr << "Error sending data." << endl;
         return false;
     }
     return true;
 }
 
-// Function to receive data over a socket with a size prefix
+// Set by --capture: every frame received from a client is recorded
+FrameCapture* frame_capture = nullptr;
+
+// Largest frame read whole, far above the migration frames and captured key
+// frames of the parameters the client uses. A larger size prefix would only
+// make the allocation below fail.
+const size_t MAX_FRAME_BYTES = size_t(1) << 30;
+
+// Reads a frame's size prefix. False once the client has closed the
+// connection, or if the size is over MAX_FRAME_BYTES; the session then ends.
+bool receive_frame_size(int sock, size_t& data_size) {
+    if (!recv_exact(sock, &data_size, sizeof(data_size))) return false;
+    if (data_size > MAX_FRAME_BYTES) {
+        cerr << "Error: frame of " << data_size << " bytes is over the " << MAX_FRAME_BYTES << "-byte limit." << endl;
+        return false;
+    }
+    return true;
+}
+
+// Reads a frame's body straight into data
+bool receive_frame_body(int sock, size_t data_size, string& data) {
+    data.resize(data_size);
+    if (!recv_exact(sock, &data[0], data_size)) {
+        cerr << "Error receiving data." << endl;
+        return false;
+    }
+    if (frame_capture) frame_capture->frame(sock, data);
+    return true;
+}
+
+// Function to receive data over a socket with a size prefix. Returns an empty
+// string once the client has closed the connection, or if the size prefix is
+// over MAX_FRAME_BYTES.
 string receive_data(int sock) {
     size_t data_size;
-    // Receive the size of the data first
-    if (recv(sock, &data_size, sizeof(data_size), MSG_WAITALL) == -1) {
-        cerr << "Error receiving data size." << endl;
-        return "";
+    string data;
+    if (!receive_frame_size(sock, data_size) || !receive_frame_body(sock, data_size, data)) return "";
+    return data;
+}
+
+// Reads past a request frame of data_size bytes whose size prefix has been
+// read, keeping only its header for the request id (0 if it has none). Such
+// frames are not captured.
+bool skip_request_frame(int sock, size_t data_size, uint64_t& request_id) {
+    string header(min(data_size, REQUEST_HEADER_BYTES), '\0');
+    if (!recv_exact(sock, &header[0], header.size())) return false;
+    request_id = 0;
+    try {
+        string unused;
+        request_id = decode_request(header, unused).request_id;
+    } catch (const exception&) {
     }
+    SocketFrameBuf rest(sock, data_size - header.size());
+    return rest.drain();
+}
 
-    // Allocate buffer for the actual data
-    vector<char> buffer(data_size);
-    // Receive the actual data
-    if (recv(sock, buffer.data(), data_size, MSG_WAITALL) == -1) {
-        cerr << "Error receiving data." << endl;
-        return "";
+// Keys are parsed straight off the socket, except while capturing: the frame
+// is then read whole so that it can be recorded
+template <class T>
+bool receive_key_frame(int sock, const SEALContext& context, T& keys, size_t& received_bytes) {
+    if (!frame_capture) return receive_object(sock, context, keys, &received_bytes);
+    string frame = receive_data(sock);
+    if (frame.empty()) return false;
+    received_bytes += sizeof(size_t) + frame.size();
+    try {
+        stringstream in(frame);
+        keys.load(context, in);
+    } catch (const exception&) {
+        return false;
+    }
+    return true;
+}
+
+bool skip_key_frame(int sock, size_t& received_bytes) {
+    if (!frame_capture) return receive_stream(sock, [](istream&) {}, &received_bytes);
+    string frame = receive_data(sock);
+    received_bytes += sizeof(size_t) + frame.size();
+    return !frame.empty();
+}
+
+// Connects to "host:port" (another server). Returns the socket, or -1.
+int connect_to_address(const string& address) {
+    string host;
+    int port = 0;
+    if (!split_address(address, host, port)) return -1;
+    struct addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* found = nullptr;
+    if (getaddrinfo(host.c_str(), to_string(port).c_str(), &hints, &found) != 0) return -1;
+    int sock = socket(found->ai_family, found->ai_socktype, found->ai_protocol);
+    if (sock >= 0 && connect(sock, found->ai_addr, found->ai_addrlen) < 0) {
+        close(sock);
+        sock = -1;
+    }
+    freeaddrinfo(found);
+    return sock;
+}
+
+// Sessions run concurrently; whole lines keep their logs readable
+mutex log_mutex;
+void log_line(uint64_t session_id, const string& message) {
+    lock_guard<mutex> lock(log_mutex);
+    cout << "[session " << session_id << "] " << message << endl;
+}
+
+// --- Session Setup ---
+// Receives parameters and keys. A session whose parameters and public key match
+// a live key group joins that group; its relinearization and Galois key frames
+// are then read past without being parsed. created tells whether this session
+// loaded the group's keys. The bytes read are added to received_bytes.
+shared_ptr<KeyGroup> receive_key_group(int sock, uint64_t session_id, KeyRegistry& registry, bool& created,
+                                       size_t& received_bytes) {
+    created = false;
+    string parms_str = receive_data(sock);
+    string public_key_str = receive_data(sock);
+    received_bytes += 2 * sizeof(size_t) + parms_str.size() + public_key_str.size();
+    if (parms_str.empty() || public_key_str.empty()) {
+        log_line(session_id, "Error: Failed to receive parameters and public key.");
+        return nullptr;
+    }
+    string fingerprint = key_fingerprint(parms_str, public_key_str);
+
+    if (shared_ptr<KeyGroup> group = registry.find(fingerprint)) {
+        if (!skip_key_frame(sock, received_bytes) || !skip_key_frame(sock, received_bytes)) {
+            log_line(session_id, "Error: Failed to receive evaluation keys.");
+            return nullptr;
+        }
+        log_line(session_id, "Joined key group " + fingerprint.substr(0, 16) + " (evaluation keys already loaded).");
+        return group;
+    }
+
+    shared_ptr<KeyGroup> group;
+    try {
+        stringstream parms_ss(parms_str);
+        EncryptionParameters parms;
+        parms.load(parms_ss);
+        group = make_shared<KeyGroup>(registry.contexts().context_for(parms), fingerprint);
+        if (!group->context.parameters_set()) throw invalid_argument("invalid encryption parameters");
+        stringstream public_key_ss(public_key_str);
+        group->public_key.load(group->context, public_key_ss);
+        group->parms_bytes = move(parms_str);
+        group->public_key_bytes = move(public_key_str);
+    } catch (const exception& e) {
+        log_line(session_id, string("Error: Invalid parameters or public key: ") + e.what());
+        return nullptr;
+    }
+
+    // Keys are parsed straight off the socket instead of being buffered first
+    // (see receive_key_frame)
+    if (!receive_key_frame(sock, group->context, group->relin_keys, received_bytes)) {
+        log_line(session_id, "Error: Failed to receive relinearization keys.");
+        return nullptr;
+    }
+    if (!receive_key_frame(sock, group->context, group->galois_keys, received_bytes)) {
+        log_line(session_id, "Error: Failed to receive Galois keys.");
+        return nullptr;
+    }
+
+    group->move_keys_to_pool();
+    group->key_bytes = object_bytes(group->public_key) + object_bytes(group->relin_keys) + object_bytes(group->galois_keys);
+    const EncryptionParameters& parms = group->context.first_context_data()->parms();
+    stringstream summary;
+    summary << "New key group " << fingerprint.substr(0, 16) << ": BFV, poly modulus degree " << parms.poly_modulus_degree()
+            << ", " << group->context.first_context_data()->total_coeff_modulus_bit_count() << "-bit coefficient modulus, plain modulus "
+            << parms.plain_modulus().value() << ", " << group->batch_encoder.slot_count() << " slots, "
+            << group->key_bytes / 1024 << " KiB of keys.";
+    log_line(session_id, summary.str());
+    {
+        lock_guard<mutex> lock(log_mutex);
+        print_kernel_report(cout, detect_kernels(max_coeff_modulus_bits(parms)));
+    }
+    shared_ptr<KeyGroup> registered = registry.insert(group);
+    created = registered == group;
+    return registered;
+}
+
+// --- Migration ---
+// Moves a key group and its finished results to the server at address (see
+// session_migration.h). Requests under the group are redirected from the
+// moment it is marked moved; if the transfer fails, the mark is lifted.
+bool migrate_key_group(shared_ptr<KeyGroup> group, const string& address, KeyRegistry& registry, ResultCache& results) {
+    const string fingerprint = group->fingerprint;
+    registry.set_moved(fingerprint, address);
+    for (int waited = 0; results.pending(fingerprint) > 0 && waited < 300; waited++) {
+        this_thread::sleep_for(chrono::milliseconds(100));
+    }
+    bool moved = false;
+    int sock = connect_to_address(address);
+    if (sock >= 0) {
+        try {
+            moved = send_data(sock, encode_migration(*group, results.finished(fingerprint))) &&
+                    decode_session_reply(receive_data(sock)).keys_loaded;
+        } catch (const exception&) {
+            moved = false;
+        }
+        close(sock);
+    }
+    if (moved) {
+        registry.release_adopted(fingerprint);
+    } else {
+        registry.set_moved(fingerprint, "");
+    }
+    return moved;
+}
+
+// Adopts a key group sent by another server
+void import_key_group(int sock, uint64_t session_id, const string& payload, KeyRegistry& registry, ResultCache& results) {
+    vector<pair<uint64_t, PlanResponse>> finished;
+    shared_ptr<KeyGroup> group;
+    try {
+        ProfilePhaseScope phase(ProfilePhase::load);
+        group = decode_migration(payload, registry.contexts(), finished);
+    } catch (const exception& e) {
+        log_line(session_id, string("Error: Invalid migration: ") + e.what());
+        send_data(sock, encode_session_reply(false));
+        return;
+    }
+    registry.adopt(group);
+    registry.set_moved(group->fingerprint, ""); // in case it is moving back
+    for (const auto& result : finished) results.store(group->fingerprint, result.first, result.second);
+    send_data(sock, encode_session_reply(true));
+    log_line(session_id, "Key group " + group->fingerprint.substr(0, 16) + " migrated here with " + to_string(finished.size()) +
+                             " finished results.");
+}
+
+// --- Session ---
+// A session starts with a hello: either a key upload follows, or the client
+// resumes under keys it uploaded earlier (see protocol.h). Requests are then
+// read and submitted as fast as the client sends them; a writer thread returns
+// the responses in request order as their batches finish. Idempotent requests
+// go through the result cache, so a retry after a lost connection gets the
+// stored response. Inputs and evaluations use the session's memory pool. Until
+// its response is sent, a replicated request reserves its estimated peak
+// memory; a narrow one reserves its inputs only, since it shares the
+// intermediates of its batch.
+void run_session(int sock, uint64_t session_id, KeyRegistry& registry, RequestCoalescer& coalescer, ResultCache& results,
+                 SessionMemory& memory, double admission_limit_us, bool accept_migrations) {
+    string resume_fingerprint;
+    try {
+        string hello = receive_data(sock);
+        memory.add_received(sizeof(size_t) + hello.size());
+        if (is_migration(hello)) {
+            if (accept_migrations) {
+                import_key_group(sock, session_id, hello, registry, results);
+            } else {
+                log_line(session_id, "Error: Refused a migration (start with --accept-migrations to allow them).");
+                send_data(sock, encode_session_reply(false));
+            }
+            return;
+        }
+        resume_fingerprint = decode_session_hello(hello);
+    } catch (const exception& e) {
+        log_line(session_id, string("Error: Invalid session hello: ") + e.what());
+        return;
+    }
+    shared_ptr<KeyGroup> group;
+    string fingerprint = resume_fingerprint;
+    if (fingerprint.empty()) {
+        bool created = false;
+        size_t key_frame_bytes = 0;
+        {
+            ProfilePhaseScope phase(ProfilePhase::load);
+            group = receive_key_group(sock, session_id, registry, created, key_frame_bytes);
+        }
+        memory.add_received(key_frame_bytes);
+        if (!group) return;
+        fingerprint = group->fingerprint;
+        memory.set_key_bytes(group->key_bytes, created);
+        if (!memory.keys_within_limit()) {
+            log_line(session_id, "Error: The uploaded keys exceed the session memory limit.");
+            return;
+        }
+
+        // Priced before any request arrives, so oversized parameters show up here
+        CostEstimate request_cost = coalescer.estimate_cost(*group, 1, true, false);
+        stringstream cost;
+        cost << "Estimated cost per request: " << request_cost.microseconds / 1000.0 << " ms, "
+             << request_cost.peak_bytes / 1024 << " KiB peak"
+             << (request_cost.microseconds > admission_limit_us ? " (over the limit; requests will be rejected)." : ".");
+        log_line(session_id, cost.str());
+    } else {
+        string moved_to = registry.moved_to(fingerprint);
+        if (!moved_to.empty()) {
+            string redirect = encode_session_redirect(moved_to);
+            memory.add_sent(sizeof(size_t) + redirect.size());
+            send_data(sock, redirect);
+            log_line(session_id, "Redirected to " + moved_to + ", where key group " + fingerprint.substr(0, 16) + " moved.");
+            return;
+        }
+        group = registry.find(fingerprint);
+        string reply = encode_session_reply(group != nullptr);
+        memory.add_sent(sizeof(size_t) + reply.size());
+        if (!send_data(sock, reply)) return;
+        log_line(session_id, "Resumed key group " + fingerprint.substr(0, 16) + (group ? "." : " (keys no longer loaded; fetch only)."));
+        if (group) memory.set_key_bytes(group->key_bytes, false);
+    }
+    if (group) {
+        auto key_data = group->context.key_context_data();
+        memory.set_key_group(fingerprint, key_data->parms().poly_modulus_degree(), key_data->total_coeff_modulus_bit_count());
+    } else {
+        memory.set_key_group(fingerprint, 0, 0);
+    }
+    const size_t replicated_request_bytes = group ? coalescer.estimate_cost(*group, 1, true, false).peak_bytes : 0;
+    const size_t narrow_request_bytes = group ? coalescer.estimate_cost(*group, 1, false, false).input_bytes : 0;
+
+    struct InFlight {
+        shared_future<PlanResponse> response;
+        uint64_t request_id;
+        size_t reserved_bytes;
+    };
+    mutex queue_mutex;
+    condition_variable queue_cv;
+    deque<InFlight> in_flight;
+    bool reading_done = false;
+
+    // Responses are stored before they are sent, so one that is lost with the
+    // connection can still be fetched
+    thread writer([&]() {
+        bool connected = true;
+        size_t sent = 0;
+        while (true) {
+            InFlight next;
+            {
+                unique_lock<mutex> lock(queue_mutex);
+                queue_cv.wait(lock, [&]() { return reading_done || !in_flight.empty(); });
+                if (in_flight.empty()) break;
+                next = move(in_flight.front());
+                in_flight.pop_front();
+            }
+            PlanResponse response;
+            try {
+                response = next.response.get();
+            } catch (const exception& e) {
+                log_line(session_id, string("Error: Evaluation failed: ") + e.what());
+                response = error_response(ResponseStatus::server_error);
+            }
+            memory.release(next.reserved_bytes);
+            response.header.request_id = next.request_id;
+            if (next.request_id != 0) results.complete(fingerprint, next.request_id, response);
+            string encoded;
+            {
+                ProfilePhaseScope phase(ProfilePhase::save);
+                encoded = encode_response(response.header, *response.frame);
+            }
+            if (connected && !send_data(sock, encoded)) {
+                log_line(session_id, "Error: Failed to send a response; dropping the rest.");
+                connected = false;
+            }
+            if (connected) {
+                sent++;
+                memory.add_sent(sizeof(size_t) + encoded.size());
+                memory.response_sent();
+            }
+        }
+        log_line(session_id, to_string(sent) + " responses sent.");
+    });
+
+    auto enqueue = [&](shared_future<PlanResponse> response, uint64_t request_id, size_t reserved_bytes = 0) {
+        {
+            lock_guard<mutex> lock(queue_mutex);
+            in_flight.push_back({ move(response), request_id, reserved_bytes });
+        }
+        queue_cv.notify_one();
+    };
+    auto reject = [&](ResponseStatus status, uint64_t request_id) {
+        promise<PlanResponse> rejected;
+        rejected.set_value(error_response(status));
+        enqueue(rejected.get_future().share(), request_id);
+    };
+
+    // Whatever ends the reading, the writer still answers the requests read so far
+    try {
+        while (true) {
+            size_t frame_size;
+            if (!receive_frame_size(sock, frame_size) || frame_size == 0) break; // client is done
+            memory.add_received(sizeof(size_t) + frame_size);
+            memory.request_received();
+
+            // A frame the session's budget cannot hold is read past, not into memory
+            if (!memory.frame_fits(frame_size)) {
+                uint64_t request_id = 0;
+                if (!skip_request_frame(sock, frame_size, request_id)) break;
+                reject(ResponseStatus::memory_limit, request_id);
+                continue;
+            }
+            string payload;
+            if (!receive_frame_body(sock, frame_size, payload)) break;
+
+            PlanRequest request;
+            request.session_id = session_id;
+            request.pool = memory.pool();
+            string inputs_str;
+            try {
+                request.layout = decode_request(move(payload), inputs_str);
+            } catch (const exception& e) {
+                log_line(session_id, string("Error: Invalid request: ") + e.what());
+                reject(ResponseStatus::invalid_request, 0);
+                continue;
+            }
+            uint64_t request_id = request.layout.request_id;
+
+            // Once the keys have moved, every request is sent on to their new server
+            string moved_to = registry.moved_to(fingerprint);
+            if (!moved_to.empty()) {
+                promise<PlanResponse> moved;
+                PlanResponse redirect = error_response(ResponseStatus::moved);
+                redirect.frame = make_shared<const string>(moved_to);
+                moved.set_value(move(redirect));
+                enqueue(moved.get_future().share(), request_id);
+                continue;
+            }
+
+            // A request seen before gets the stored (or still running) evaluation
+            shared_future<PlanResponse> stored;
+            if (request_id != 0 && results.find(fingerprint, request_id, stored)) {
+                enqueue(stored, request_id);
+                continue;
+            }
+            if (request.layout.flags & REQUEST_FETCH_ONLY) {
+                reject(ResponseStatus::not_found, request_id);
+                continue;
+            }
+            if (!group) {
+                reject(ResponseStatus::keys_required, request_id);
+                continue;
+            }
+
+            const size_t request_bytes = request.layout.slot_width == group->batch_encoder.slot_count() ? replicated_request_bytes
+                                                                                                       : narrow_request_bytes;
+            if (!memory.admit(request_bytes)) {
+                reject(ResponseStatus::memory_limit, request_id);
+                continue;
+            }
+
+            // The inputs arrive in one batch frame. Its four objects are small enough
+            // that unpacking them here beats starting threads for them.
+            try {
+                BatchFrameReader inputs(group->context, move(inputs_str));
+                if (inputs.size() != 4) throw invalid_argument("expected 4 objects");
+                Ciphertext& total_income = request.ciphertexts.emplace("total_income", Ciphertext(request.pool)).first->second;
+                Plaintext& monthly_savings_goal = request.plaintexts.emplace("monthly_savings_goal", Plaintext(request.pool)).first->second;
+                Ciphertext& essential_expenses = request.ciphertexts.emplace("essential_expenses", Ciphertext(request.pool)).first->second;
+                Ciphertext& non_essential_expenses = request.ciphertexts.emplace("non_essential_expenses", Ciphertext(request.pool)).first->second;
+                {
+                    ProfilePhaseScope phase(ProfilePhase::load);
+                    inputs.load(0, total_income);
+                    inputs.load(1, monthly_savings_goal);
+                    inputs.load(2, essential_expenses);
+                    inputs.load(3, non_essential_expenses);
+                }
+                memory.add_input_bytes(object_bytes(total_income) + object_bytes(monthly_savings_goal) +
+                                       object_bytes(essential_expenses) + object_bytes(non_essential_expenses));
+            } catch (const exception& e) {
+                log_line(session_id, string("Error: Invalid request: ") + e.what());
+                memory.release(request_bytes);
+                reject(ResponseStatus::invalid_request, request_id);
+                continue;
+            }
+            shared_future<PlanResponse> response = coalescer.submit(group, move(request)).share();
+            if (request_id != 0) response = results.track(fingerprint, request_id, response);
+            enqueue(response, request_id, request_bytes);
+        }
+    } catch (const exception& e) {
+        log_line(session_id, string("Error: Session failed: ") + e.what());
+    }
+
+    {
+        lock_guard<mutex> lock(queue_mutex);
+        reading_done = true;
+    }
+    queue_cv.notify_one();
+    writer.join();
+
+    SessionMemoryStats memory_stats = memory.stats();
+    stringstream summary;
+    summary << "Memory: " << memory_stats.pool_bytes / 1024 << " KiB session pool, " << memory_stats.key_bytes / 1024
+            << " KiB own keys, " << memory_stats.shared_key_bytes / 1024 << " KiB shared keys, " << memory_stats.input_bytes / 1024
+            << " KiB of inputs received, " << memory_stats.rejected << " requests over the limit.";
+    log_line(session_id, summary.str());
+}
+
+// SIGUSR1 wakes the migration thread through a pipe (the handler may only
+// make async-signal-safe calls)
+int migration_pipe[2] = { -1, -1 };
+void request_migration(int) {
+    char wake = 1;
+    ssize_t written = write(migration_pipe[1], &wake, 1);
+    (void)written;
+}
+
+// Ends a handed-over session without a connection reset, which could discard
+// responses the client has not read yet: the client reads every response sent
+// here, sees the end of the stream, sends its unanswered requests to the new
+// server and closes. Whatever it sent here meanwhile is read and dropped.
+void close_after_handoff(int sock) {
+    shutdown(sock, SHUT_WR);
+    struct timeval timeout = { 5, 0 };
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    char discard[4096];
+    ssize_t got;
+    while ((got = recv(sock, discard, sizeof(discard), 0)) > 0 || (got < 0 && errno == EINTR)) {}
+}
+
+// --- Admin Commands ---
+// profile start [HZ] | profile stop | profile status | profile dump
+// (collapsed stacks of the samples since the last dump; see profiler.h)
+string profile_command(const vector<string>& command) {
+    SamplingProfiler& profiler = SamplingProfiler::instance();
+    string action = command.size() > 1 ? command[1] : "status";
+    if (action == "start") {
+        int hz = command.size() > 2 ? stoi(command[2]) : 99;
+        profiler.start(hz);
+        return "profiling at " + to_string(hz) + " Hz\n";
+    }
+    if (action == "stop") {
+        profiler.stop();
+        return profiler.status() + "\n";
     }
-    return string(buffer.begin(), buffer.end());
+    if (action == "status") return profiler.status() + "\n";
+    if (action == "dump") return profiler.dump_collapsed();
+    throw invalid_argument("unknown profile command: " + action);
 }
 
+// status [sessions|caches|queues] (see admin_status.h)
+string status_command(const vector<string>& command, const SessionTable& sessions, KeyRegistry& registry,
+                      ResultCache& results, const RequestCoalescer& coalescer) {
+    AdminStatus status;
+    status.sessions = sessions.snapshot();
+    status.keys = registry.stats();
+    status.results = results.stats();
+    status.coalescer = coalescer.stats();
+    status.queues = coalescer.queues();
+    status.coalescing = coalescer.coalescing();
+    status.running = coalescer.running();
+    return format_admin_status(status, command.size() > 1 ? command[1] : "");
+}
+
+int main(int argc, char* argv[]) {
+    // --- Options ---
+    // --bit-drop-margin BITS: noise budget the client must still have after the
+    // low bits of the response are dropped (default 4); --no-bit-drop sends the
+    // response ciphertext whole.
+    // --coalesce-window-ms MS: how long a narrow request waits for others under
+    // the same key to share its evaluation (default 10; 0 disables coalescing).
+    // --sessions N: exit after serving N sessions (default 0, serve forever).
+    // --result-cache-mb MB: memory for finished responses that clients can
+    // fetch again by request id (default 64).
+    // --cost-model FILE.csv: operation costs measured by benchmark --csv
+    // (default: built-in estimates). --max-request-ms MS rejects requests whose
+    // estimated evaluation takes longer (default 2000); --max-queued-ms MS
+    // refuses new work once that much is waiting (default 30000).
+    // --session-memory-mb MB: per-session limit on uploaded keys plus the
+    // estimated memory of requests in flight (default 1024).
+    // --metrics-file PATH: memory metrics in the Prometheus text format,
+    // rewritten every 10 seconds.
+    // --warmup DEGREES: parameter profiles to warm up before accepting
+    // connections, as comma-separated poly modulus degrees (default 8192, the
+    // client's; "none" skips the warm-up). --warmup-pool-mb MB: global pool
+    // memory to pre-fault per profile (default 64).
+    // --handoff-socket PATH: Unix socket on which a new server build can take
+    // over this one; --take-over PATH: take over the server listening there
+    // (see hot_restart.h).
+    // --hibernate-after-s S: free the evaluation keys of key holders idle for
+    // S seconds, keeping them compressed until their next request (default 0,
+    // never); --hibernate-dir DIR stores them in files there instead of memory.
+    // --port P: port to listen on (default 8080).
+    // --migrate-to HOST:PORT: on SIGUSR1, move every loaded key group and its
+    // finished results to that server (see session_migration.h);
+    // --accept-migrations lets other servers move key groups here.
+    // --capture FILE: record every frame received, for replay_app.
+    // --admin-socket PATH: Unix socket for operator commands: the sampling
+    // profiler and the status of sessions, caches and queues (see admin.h).
+    EvaluationOptions evaluation_options;
+    AdmissionOptions admission;
+    string cost_model_path;
+    int coalesce_window_ms = 10;
+    long session_limit = 0;
+    long result_cache_mb = 64;
+    long session_memory_mb = 1024;
+    string metrics_path;
+    string warmup_list = "8192";
+    long warmup_pool_mb = 64;
+    string handoff_path;
+    string take_over_path;
+    long hibernate_after_s = 0;
+    string hibernate_dir;
+    int port = 8080;
+    string migrate_to;
+    bool accept_migrations = false;
+    string capture_path;
+    string admin_path;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--no-bit-drop") {
+            evaluation_options.bit_drop = false;
+        } else if (arg == "--bit-drop-margin" && i + 1 < argc) {
+            evaluation_options.bit_drop_margin = atoi(argv[++i]);
+        } else if (arg == "--coalesce-window-ms" && i + 1 < argc) {
+            coalesce_window_ms = atoi(argv[++i]);
+        } else if (arg == "--sessions" && i + 1 < argc) {
+            session_limit = atol(argv[++i]);
+        } else if (arg == "--result-cache-mb" && i + 1 < argc) {
+            result_cache_mb = atol(argv[++i]);
+        } else if (arg == "--session-memory-mb" && i + 1 < argc) {
+            session_memory_mb = atol(argv[++i]);
+        } else if (arg == "--metrics-file" && i + 1 < argc) {
+            metrics_path = argv[++i];
+        } else if (arg == "--warmup" && i + 1 < argc) {
+            warmup_list = argv[++i];
+        } else if (arg == "--warmup-pool-mb" && i + 1 < argc) {
+            warmup_pool_mb = atol(argv[++i]);
+        } else if (arg == "--handoff-socket" && i + 1 < argc) {
+            handoff_path = argv[++i];
+        } else if (arg == "--take-over" && i + 1 < argc) {
+            take_over_path = argv[++i];
+        } else if (arg == "--hibernate-after-s" && i + 1 < argc) {
+            hibernate_after_s = atol(argv[++i]);
+        } else if (arg == "--hibernate-dir" && i + 1 < argc) {
+            hibernate_dir = argv[++i];
+        } else if (arg == "--port" && i + 1 < argc) {
+            port = atoi(argv[++i]);
+        } else if (arg == "--migrate-to" && i + 1 < argc) {
+            migrate_to = argv[++i];
+        } else if (arg == "--accept-migrations") {
+            accept_migrations = true;
+        } else if (arg == "--capture" && i + 1 < argc) {
+            capture_path = argv[++i];
+        } else if (arg == "--admin-socket" && i + 1 < argc) {
+            admin_path = argv[++i];
+        } else if (arg == "--cost-model" && i + 1 < argc) {
+            cost_model_path = argv[++i];
+        } else if (arg == "--max-request-ms" && i + 1 < argc) {
+            admission.max_request_microseconds = atof(argv[++i]) * 1000.0;
+        } else if (arg == "--max-queued-ms" && i + 1 < argc) {
+            admission.max_queued_microseconds = atof(argv[++i]) * 1000.0;
+        } else {
+            cerr << "Usage: " << argv[0]
+                 << " [--bit-drop-margin BITS] [--no-bit-drop] [--coalesce-window-ms MS] [--sessions N] [--result-cache-mb MB]"
+                 << " [--cost-model FILE.csv] [--max-request-ms MS] [--max-queued-ms MS]"
+                 << " [--session-memory-mb MB] [--metrics-file PATH] [--warmup DEGREES|none] [--warmup-pool-mb MB]"
+                 << " [--handoff-socket PATH] [--take-over PATH] [--hibernate-after-s S] [--hibernate-dir DIR]"
+                 << " [--port P] [--migrate-to HOST:PORT] [--accept-migrations] [--capture FILE]"
+                 << " [--admin-socket PATH]" << endl;
+            return 1;
+        }
+    }
+    if (coalesce_window_ms < 0 || session_limit < 0 || result_cache_mb < 0 || warmup_pool_mb < 0 || hibernate_after_s < 0) {
+        cerr << "Error: --coalesce-window-ms, --sessions, --result-cache-mb, --warmup-pool-mb and --hibernate-after-s"
+             << " must not be negative." << endl;
+        return 1;
+    }
+    string migrate_host;
+    int migrate_port = 0;
+    if (port <= 0 || port > 65535 || (!migrate_to.empty() && !split_address(migrate_to, migrate_host, migrate_port))) {
+        cerr << "Error: --port must be a port number and --migrate-to of the form HOST:PORT." << endl;
+        return 1;
+    }
+    if (session_memory_mb <= 0) {
+        cerr << "Error: --session-memory-mb must be positive." << endl;
+        return 1;
+    }
+    if (admission.max_request_microseconds <= 0 || admission.max_queued_microseconds <= 0) {
+        cerr << "Error: --max-request-ms and --max-queued-ms must be positive." << endl;
+        return 1;
+    }
+    CostModel cost_model;
+    if (!cost_model_path.empty()) {
+        ifstream cost_model_file(cost_model_path);
+        try {
+            if (!cost_model_file) throw invalid_argument("cannot open " + cost_model_path);
+            cost_model = CostModel::from_benchmark_csv(cost_model_file);
+        } catch (const exception& e) {
+            cerr << "Error: --cost-model: " << e.what() << endl;
+            return 1;
+        }
+    }
+    unique_ptr<FrameCapture> capture;
+    if (!capture_path.empty()) {
+        try {
+            capture = make_unique<FrameCapture>(capture_path);
+        } catch (const exception& e) {
+            cerr << "Error: --capture: " << e.what() << endl;
+            return 1;
+        }
+        frame_capture = capture.get();
+        cout << "Capturing received frames to " << capture_path << "." << endl;
+    }
+    vector<ParameterProfile> warmup_profiles;
+    try {
+        warmup_profiles = parse_parameter_profiles(warmup_list);
+    } catch (const exception& e) {
+        cerr << "Error: --warmup: " << e.what() << endl;
+        return 1;
+    }
+
+    // A client that disconnects mid-response must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    // --- Evaluation (Server-side) ---
+    // The budget computation runs as an evaluation plan; the lazy relinearization
+    // pass keeps key switches to the minimum the plan needs. Results come back
+    // packed in this order: the calculated totals, then the individual category
+    // sums (for the client to show the breakdown).
+    EvalPlan budget_plan = lazy_relinearize(make_budget_plan());
+    vector<string> response_outputs = { "total_expenses", "net_income", "goal_difference",
+                                        "essential_expenses", "non_essential_expenses" };
+    KeyRegistry registry;
+    ResultCache results(static_cast<size_t>(result_cache_mb) << 20);
+    RequestCoalescer coalescer(budget_plan, response_outputs, evaluation_options, chrono::milliseconds(coalesce_window_ms),
+                               cost_model, admission);
+    cout << "Evaluation plan: " << budget_plan.nodes().size() << " nodes, " << budget_plan.key_switch_count() << " key switches. "
+         << "Coalescing window: " << coalesce_window_ms << " ms." << endl;
+
+    // --- Warm-up ---
+    // Runs before the socket is opened, so no client waits on a cold server
+    for (const ParameterProfile& profile : warmup_profiles) {
+        try {
+            WarmupReport warmup = warm_up_profile(profile, registry.contexts(), budget_plan, response_outputs,
+                                                  evaluation_options, static_cast<size_t>(warmup_pool_mb) << 20);
+            cout << "Warmed up N=" << warmup.poly_modulus_degree << ": context " << warmup.context_ms << " ms, keys "
+                 << warmup.keys_ms << " ms, " << warmup.evaluations << " evaluations " << warmup.evaluation_ms << " ms, "
+                 << warmup.prefaulted_bytes / (1024 * 1024) << " MiB of pool pre-faulted." << endl;
+        } catch (const exception& e) {
+            cerr << "Error: warm-up of N=" << profile.poly_modulus_degree << " failed: " << e.what() << endl;
+            return 1;
+        }
+    }
+
+    // --- Admin Socket ---
+    SessionTable session_table;
+    unique_ptr<AdminSocket> admin;
+    if (!admin_path.empty()) {
+        try {
+            admin = make_unique<AdminSocket>(admin_path, [&](const vector<string>& command) -> string {
+                if (!command.empty() && command[0] == "profile") return profile_command(command);
+                if (!command.empty() && command[0] == "status") {
+                    return status_command(command, session_table, registry, results, coalescer);
+                }
+                return "commands: profile start [HZ] | profile stop | profile status | profile dump | "
+                       "status [sessions|caches|queues]\n";
+            });
+        } catch (const exception& e) {
+            cerr << "Error: --admin-socket: " << e.what() << endl;
+            return 1;
+        }
+        cout << "Admin commands on " << admin_path << "." << endl;
+    }
 
-int main() {
     // --- Network Setup (Server) ---
-    int server_fd, new_socket;
+    int server_fd;
     struct sockaddr_in address;
     int opt = 1;
     int addrlen = sizeof(address);
-    const int PORT = 8080; // Choose an available port
-
-    // Create socket file descriptor
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
-        perror("socket failed");
-        exit(EXIT_FAILURE);
-    }
-
-    // Attaching socket to the port 8080
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt, sizeof(opt))) {
-        perror("setsockopt");
-        exit(EXIT_FAILURE);
-    }
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY; // Listen on all available interfaces
-    address.sin_port = htons(PORT);
-
-    // Bind the socket to the specified IP and port
-    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
-        perror("bind failed");
-        exit(EXIT_FAILURE);
-    }
-
-    // Listen for incoming connections
-    if (listen(server_fd, 3) < 0) { // 3 is the backlog queue size
-        perror("listen");
-        exit(EXIT_FAILURE);
-    }
-    cout << "Server listening on port " << PORT << endl;
-    cout << "Waiting for client connection..." << endl;
-
-    // Accept a client connection
-    if ((new_socket = accept(server_fd, (struct sockaddr *)&address, (socklen_t*)&addrlen)) < 0) {
-        perror("accept");
-        exit(EXIT_FAILURE);
-    }
-    cout << "Client connected!" << endl << endl;
-
-    // --- FHE Setup (Server) ---
-    // 1. Receive and Load Encryption Parameters
-    string parms_str = receive_data(new_socket);
-    if (parms_str.empty()) { cerr << "Error: Failed to receive parameters." << endl; return 1; }
-    stringstream parms_ss(parms_str);
-    EncryptionParameters parms;
-    parms.load(parms_ss);
-    cout << "Encryption parameters loaded from network." << endl;
-    cout << endl;
-
-    SEALContext context(parms);
-    cout << "SEALContext created on server with parameters:" << endl;
-    cout << "  Scheme: BFV" << endl;
-    cout << "  Poly Modulus Degree: " << parms.poly_modulus_degree() << endl;
-    cout << "  Coeff Modulus Size: " << context.first_context_data()->total_coeff_modulus_bit_count() << " bits" << endl;
-    cout << "  Plain Modulus: " << parms.plain_modulus().value() << endl;
-    cout << "  Parameters are " << (context.parameters_set() ? "valid" : "invalid") << endl;
-    cout << endl;
-
-    // 2. Receive and Load Public, Relinearization, and Galois Keys
-    PublicKey public_key;
-    string pk_str = receive_data(new_socket);
-    if (pk_str.empty()) { cerr << "Error: Failed to receive public key." << endl; return 1; }
-    stringstream pk_ss(pk_str);
-    public_key.load(context, pk_ss);
-    cout << "Public key loaded from network." << endl;
-
-    RelinKeys relin_keys;
-    string rlk_str = receive_data(new_socket);
-    if (rlk_str.empty()) { cerr << "Error: Failed to receive relinearization keys." << endl; return 1; }
-    stringstream rlk_ss(rlk_str);
-    relin_keys.load(context, rlk_ss);
-    cout << "Relinearization keys loaded from network." << endl;
-
-    GaloisKeys galois_keys;
-    string glk_str = receive_data(new_socket);
-    if (glk_str.empty()) { cerr << "Error: Failed to receive Galois keys." << endl; return 1; }
-    stringstream glk_ss(glk_str);
-    galois_keys.load(context, glk_ss);
-    cout << "Galois keys loaded from network." << endl;
-
-    Evaluator evaluator(context);
-    BatchEncoder batch_encoder(context);
-    Encryptor encryptor(context, public_key); 
-
-    size_t slot_count = batch_encoder.slot_count();
-    cout << "Number of slots for batching: " << slot_count << endl;
-
-    const double SCALE_FACTOR = 100.0;
-    cout << "Using fixed-point scaling factor: " << SCALE_FACTOR << endl;
-    cout << endl;
-
-    // --- 3. Receive Encrypted Data from Client ---
-    Ciphertext encrypted_total_income;
-    string enc_total_income_str = receive_data(new_socket);
-    if (enc_total_income_str.empty()) { cerr << "Error: Failed to receive encrypted total income." << endl; return 1; }
-    stringstream enc_total_income_ss(enc_total_income_str);
-    encrypted_total_income.load(context, enc_total_income_ss);
-    cout << "Encrypted Total Income loaded from network." << endl;
-    cout << endl;
-
-    Plaintext encoded_monthly_savings_goal;
-    string enc_monthly_savings_goal_str = receive_data(new_socket);
-    if (enc_monthly_savings_goal_str.empty()) { cerr << "Error: Failed to receive encoded monthly savings goal." << endl; return 1; }
-    stringstream enc_monthly_savings_goal_ss(enc_monthly_savings_goal_str);
-    encoded_monthly_savings_goal.load(context, enc_monthly_savings_goal_ss);
-    cout << "Encoded Monthly Savings Goal loaded from network." << endl;
-    cout << endl;
-
-    // Receive encrypted essential expenses sum
-    Ciphertext encrypted_essential_expenses_received;
-    string enc_essential_str = receive_data(new_socket);
-    if (enc_essential_str.empty()) { cerr << "Error: Failed to receive encrypted essential expenses." << endl; return 1; }
-    stringstream enc_essential_ss(enc_essential_str);
-    encrypted_essential_expenses_received.load(context, enc_essential_ss);
-    cout << "Encrypted Total ESSENTIAL Expenses loaded from network." << endl;
-
-    // Receive encrypted non-essential expenses sum
-    Ciphertext encrypted_non_essential_expenses_received;
-    string enc_non_essential_str = receive_data(new_socket);
-    if (enc_non_essential_str.empty()) { cerr << "Error: Failed to receive encrypted non-essential expenses." << endl; return 1; }
-    stringstream enc_non_essential_ss(enc_non_essential_str);
-    encrypted_non_essential_expenses_received.load(context, enc_non_essential_ss);
-    cout << "Encrypted Total NON-ESSENTIAL Expenses loaded from network." << endl;
-    cout << endl;
-
-    // --- 4. Perform Homomorphic Operations (Server-side) ---
-    // Homomorphic Sum of all Encrypted Category Expenses (Essentials + Non-Essentials)
-    Ciphertext encrypted_total_expenses;
-    evaluator.add(encrypted_essential_expenses_received, encrypted_non_essential_expenses_received, encrypted_total_expenses);
-    cout << "\nHomomorphic summation performed: Encrypted Total Expenses (Essentials + Non-Essentials) calculated." << endl;
-
-    // Homomorphic Net Income Calculation: Total Income - Total Expenses
-    Ciphertext encrypted_net_income;
-    evaluator.sub(encrypted_total_income, encrypted_total_expenses, encrypted_net_income);
-    cout << "Homomorphic subtraction performed: Encrypted Total Income - Encrypted Total Expenses." << endl;
-
-    // Homomorphic Difference from Monthly Savings Goal: Net Income - Savings Goal
-    Ciphertext encrypted_goal_difference;
-    evaluator.sub_plain(encrypted_net_income, encoded_monthly_savings_goal, encrypted_goal_difference);
-    cout << "Homomorphic subtraction performed: Encrypted Net Income - Encoded Monthly Savings Goal." << endl;
-    cout << endl;
-
-    // --- 5. Send Encrypted Results back to Client ---
-    // Send calculated encrypted totals
-    stringstream enc_total_expenses_ss;
-    encrypted_total_expenses.save(enc_total_expenses_ss);
-    if (!send_data(new_socket, enc_total_expenses_ss.str())) { cerr << "Error: Failed to send encrypted total expenses." << endl; return 1; }
-    cout << "Encrypted Total Expenses sent to client." << endl;
-
-    stringstream enc_net_income_ss;
-    encrypted_net_income.save(enc_net_income_ss);
-    if (!send_data(new_socket, enc_net_income_ss.str())) { cerr << "Error: Failed to send encrypted net income." << endl; return 1; }
-    cout << "Encrypted Net Income sent to client." << endl;
-
-    stringstream enc_goal_difference_ss;
-    encrypted_goal_difference.save(enc_goal_difference_ss);
-    if (!send_data(new_socket, enc_goal_difference_ss.str())) { cerr << "Error: Failed to send encrypted goal difference." << endl; return 1; }
-    cout << "Encrypted Difference from Savings Goal sent to client." << endl;
-    cout << endl;
-
-    // Send back the individual encrypted category sums (for client to decrypt and show breakdown)
-    stringstream enc_essential_recd_ss;
-    encrypted_essential_expenses_received.save(enc_essential_recd_ss);
-    if (!send_data(new_socket, enc_essential_recd_ss.str())) { cerr << "Error: Failed to send encrypted essential expenses back." << endl; return 1; }
-    cout << "Encrypted ESSENTIAL Expenses sum sent back to client." << endl;
-
-    stringstream enc_non_essential_recd_ss;
-    encrypted_non_essential_expenses_received.save(enc_non_essential_recd_ss);
-    if (!send_data(new_socket, enc_non_essential_recd_ss.str())) { cerr << "Error: Failed to send encrypted non-essential expenses back." << endl; return 1; }
-    cout << "Encrypted NON-ESSENTIAL Expenses sum sent back to client." << endl;
-
-    cout << "\nServer-side operations complete. Encrypted results sent to client." << endl;
+
+    if (!take_over_path.empty()) {
+        // The previous server keeps accepting until this point
+        string snapshot_path;
+        server_fd = take_over_listen_socket(take_over_path, snapshot_path);
+        if (server_fd < 0) {
+            cerr << "Error: --take-over: no server to take over at " << take_over_path << endl;
+            return 1;
+        }
+        cout << "Took over the listening socket from the previous server." << endl;
+        if (!snapshot_path.empty()) {
+            try {
+                vector<shared_ptr<KeyGroup>> groups = read_key_snapshot(snapshot_path, registry.contexts());
+                for (auto& group : groups) registry.adopt(group);
+                cout << "Loaded " << groups.size() << " key groups from the previous server." << endl;
+            } catch (const exception& e) {
+                cerr << "Warning: ignoring the key snapshot: " << e.what() << endl;
+            }
+            unlink(snapshot_path.c_str());
+        }
+    } else {
+        // Create socket file descriptor
+        if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
+            perror("socket failed");
+            exit(EXIT_FAILURE);
+        }
+
+        // Attaching socket to the port
+        if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt, sizeof(opt))) {
+            perror("setsockopt");
+            exit(EXIT_FAILURE);
+        }
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = INADDR_ANY; // Listen on all available interfaces
+        address.sin_port = htons(port);
+
+        // Bind the socket to the specified IP and port
+        if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+            perror("bind failed");
+            exit(EXIT_FAILURE);
+        }
+
+        // Listen for incoming connections
+        if (listen(server_fd, 16) < 0) { // backlog queue size
+            perror("listen");
+            exit(EXIT_FAILURE);
+        }
+        cout << "Server listening on port " << port << endl;
+    }
+    // Both processes poll the socket during a handoff; whichever loses the race
+    // for a connection must not block in accept
+    fcntl(server_fd, F_SETFL, fcntl(server_fd, F_GETFL) | O_NONBLOCK);
+
+    // --- Hot Restart ---
+    // On a handoff the accept loop is woken through a pipe
+    int handoff_pipe[2] = { -1, -1 };
+    int handoff_fd = -1;
+    thread handoff_listener;
+    bool handoff_accepted = false; // read after the listener is joined
+    if (!handoff_path.empty()) {
+        handoff_fd = listen_for_handoff(handoff_path);
+        if (handoff_fd < 0 || pipe(handoff_pipe) != 0) {
+            cerr << "Error: --handoff-socket: cannot listen on " << handoff_path << endl;
+            return 1;
+        }
+        handoff_listener = thread([&]() {
+            int channel = accept(handoff_fd, nullptr, nullptr);
+            if (channel < 0) return; // shut down at exit
+            handoff_accepted = true;
+            unlink(handoff_path.c_str()); // the new server binds the path next
+            string snapshot_path = handoff_path + ".keys";
+            try {
+                write_key_snapshot(snapshot_path, registry.live());
+            } catch (const exception& e) {
+                cerr << "Warning: handing over without a key snapshot: " << e.what() << endl;
+                snapshot_path.clear();
+            }
+            if (send_listen_socket(channel, server_fd, snapshot_path)) {
+                cout << "Handed the listening socket over to a new server." << endl;
+                char wake = 1;
+                if (write(handoff_pipe[1], &wake, 1) != 1) perror("write");
+            } else {
+                cerr << "Error: handoff to the new server failed; still serving." << endl;
+            }
+            close(channel);
+        });
+    }
+
+    // --- Metrics ---
+    // Written to a temporary file and renamed, so a scraper never reads half
+    mutex metrics_mutex;
+    condition_variable metrics_cv;
+    bool metrics_stopping = false;
+    auto write_metrics = [&]() {
+        string temporary = metrics_path + ".tmp";
+        {
+            ofstream out(temporary);
+            out << format_memory_metrics(session_table.snapshot(), registry.stats());
+        }
+        rename(temporary.c_str(), metrics_path.c_str());
+    };
+    thread metrics_writer;
+    if (!metrics_path.empty()) {
+        metrics_writer = thread([&]() {
+            unique_lock<mutex> lock(metrics_mutex);
+            while (!metrics_cv.wait_for(lock, chrono::seconds(10), [&]() { return metrics_stopping; })) {
+                write_metrics();
+            }
+        });
+    }
+
+    // --- Key Hibernation ---
+    // Idle groups are checked a few times per idle period
+    mutex hibernation_mutex;
+    condition_variable hibernation_cv;
+    bool hibernation_stopping = false;
+    size_t hibernations = 0;
+    thread hibernation_sweeper;
+    if (hibernate_after_s > 0) {
+        hibernation_sweeper = thread([&]() {
+            const chrono::seconds idle(hibernate_after_s);
+            const chrono::seconds interval(max<long>(1, hibernate_after_s / 4));
+            unique_lock<mutex> lock(hibernation_mutex);
+            while (!hibernation_cv.wait_for(lock, interval, [&]() { return hibernation_stopping; })) {
+                size_t resident_before = process_resident_bytes();
+                size_t hibernated = 0;
+                for (const auto& group : registry.live()) {
+                    size_t stored = 0;
+                    try {
+                        stored = group->hibernate(idle, hibernate_dir);
+                    } catch (const exception& e) {
+                        lock_guard<mutex> log_lock(log_mutex);
+                        cerr << "Error: Failed to hibernate key group " << group->fingerprint.substr(0, 16) << ": " << e.what() << endl;
+                    }
+                    if (stored == 0) continue;
+                    hibernations++;
+                    hibernated++;
+                    lock_guard<mutex> log_lock(log_mutex);
+                    cout << "Hibernated key group " << group->fingerprint.substr(0, 16) << ": " << group->key_bytes / 1024
+                         << " KiB of keys stored in " << stored / 1024 << " KiB." << endl;
+                }
+                if (hibernated == 0) continue;
+#ifdef __GLIBC__
+                malloc_trim(0); // freed key pools may sit in the heap rather than in their own mappings
+#endif
+                lock_guard<mutex> log_lock(log_mutex);
+                cout << "Resident memory after hibernating " << hibernated << " key groups: " << resident_before / (1 << 20)
+                     << " MiB -> " << process_resident_bytes() / (1 << 20) << " MiB." << endl;
+            }
+        });
+    }
+
+    // --- Migration ---
+    // kill -USR1 moves every loaded key group to the --migrate-to server
+    thread migrator;
+    if (!migrate_to.empty()) {
+        if (pipe(migration_pipe) != 0) {
+            perror("pipe");
+            return 1;
+        }
+        migrator = thread([&]() {
+            char wake = 0;
+            while (read(migration_pipe[0], &wake, 1) == 1 && wake != 0) {
+                size_t moved = 0, failed = 0;
+                for (const auto& group : registry.live()) {
+                    if (!registry.moved_to(group->fingerprint).empty()) continue; // sessions still hold it
+                    (migrate_key_group(group, migrate_to, registry, results) ? moved : failed)++;
+                }
+                lock_guard<mutex> log_lock(log_mutex);
+                cout << "Migrated " << moved << " key groups to " << migrate_to << (failed ? ", " + to_string(failed) + " failed" : "")
+                     << "." << endl;
+            }
+        });
+        signal(SIGUSR1, request_migration);
+    }
+    cout << "Waiting for client connections..." << endl;
+
+    // --- Accept Loop ---
+    // One thread per session. Sessions under the same key share a key group, and
+    // their narrow requests can share an evaluation.
+    mutex sessions_mutex;
+    condition_variable sessions_cv;
+    size_t active_sessions = 0;
+    set<int> session_sockets;
+    atomic<bool> handed_over{ false };
+    uint64_t session_id = 0;
+    while (session_limit == 0 || session_id < static_cast<uint64_t>(session_limit)) {
+        struct pollfd waiting[2] = { { server_fd, POLLIN, 0 }, { handoff_pipe[0], POLLIN, 0 } };
+        int ready;
+        while ((ready = poll(waiting, handoff_pipe[0] < 0 ? 1 : 2, -1)) < 0 && errno == EINTR) {}
+        if (ready < 0) {
+            perror("poll");
+            break;
+        }
+        if (handoff_pipe[0] >= 0 && (waiting[1].revents & POLLIN)) {
+            handed_over = true;
+            break;
+        }
+        int new_socket = accept(server_fd, (struct sockaddr *)&address, (socklen_t*)&addrlen);
+        if (new_socket < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED || errno == EINTR) continue;
+            perror("accept");
+            break;
+        }
+        session_id++;
+        log_line(session_id, "Client connected.");
+        {
+            lock_guard<mutex> lock(sessions_mutex);
+            active_sessions++;
+            session_sockets.insert(new_socket);
+        }
+        if (frame_capture) frame_capture->open(new_socket, session_id);
+        thread([&, new_socket, session_id]() {
+            auto memory = make_shared<SessionMemory>(session_id, static_cast<size_t>(session_memory_mb) << 20);
+            session_table.add(memory, session_id);
+            try {
+                run_session(new_socket, session_id, registry, coalescer, results, *memory,
+                            admission.max_request_microseconds, accept_migrations);
+            } catch (const exception& e) {
+                log_line(session_id, string("Error: Session failed: ") + e.what());
+            }
+            session_table.remove(session_id);
+            if (handed_over) close_after_handoff(new_socket);
+            log_line(session_id, "Client disconnected.");
+            if (frame_capture) frame_capture->close(new_socket);
+            {
+                lock_guard<mutex> lock(sessions_mutex);
+                session_sockets.erase(new_socket);
+                close(new_socket);
+                active_sessions--;
+                sessions_cv.notify_all(); // under the lock: main may return as soon as it is released
+            }
+        }).detach();
+    }
+
+    // After a handoff each session stops reading and answers the requests it
+    // has already read. Its client then resumes on the new server and sends the
+    // requests left unanswered again; this process never read those (or lost
+    // their responses), so the new one evaluates them.
+    if (handed_over) {
+        close(server_fd);
+        server_fd = -1;
+        lock_guard<mutex> lock(sessions_mutex);
+        for (int sock : session_sockets) shutdown(sock, SHUT_RD);
+        cout << "Finishing " << session_sockets.size() << " sessions before exiting." << endl;
+    }
+    if (handoff_listener.joinable()) {
+        shutdown(handoff_fd, SHUT_RDWR);
+        handoff_listener.join();
+        close(handoff_fd);
+        if (!handoff_accepted) unlink(handoff_path.c_str());
+    }
+
+    // Let the remaining sessions finish before the coalescer goes away
+    unique_lock<mutex> lock(sessions_mutex);
+    sessions_cv.wait(lock, [&]() { return active_sessions == 0; });
+    if (migrator.joinable()) {
+        signal(SIGUSR1, SIG_IGN);
+        char stop = 0;
+        if (write(migration_pipe[1], &stop, 1) != 1) perror("write");
+        migrator.join();
+    }
+    if (hibernation_sweeper.joinable()) {
+        {
+            lock_guard<mutex> hibernation_lock(hibernation_mutex);
+            hibernation_stopping = true;
+        }
+        hibernation_cv.notify_all();
+        hibernation_sweeper.join();
+    }
+    if (metrics_writer.joinable()) {
+        {
+            lock_guard<mutex> metrics_lock(metrics_mutex);
+            metrics_stopping = true;
+        }
+        metrics_cv.notify_all();
+        metrics_writer.join();
+        write_metrics();
+    }
+    admin.reset();
+    SamplingProfiler::instance().stop();
+    CoalescerStats stats = coalescer.stats();
+    ResultCacheStats cache_stats = results.stats();
+    cout << "\nServer done: " << stats.requests << " requests in " << stats.batches << " evaluations, "
+         << cache_stats.hits << " answered from the result cache, " << stats.rejected << " rejected, "
+         << hibernations << " key group hibernations." << endl;
+    if (capture) cout << capture->records() << " capture records written to " << capture_path << "." << endl;
 
     // Close sockets
-    close(new_socket);
-    close(server_fd);
+    if (server_fd >= 0) close(server_fd);
 
     return 0;
 }
@@ -0,0 +1,233 @@
+#pragma once
+
+#include "seal/seal.h"
+#include "key_registry.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+// --- Session Memory Accounting ---
+// Every session gets its own SEAL memory pool (mm_force_new). Its inputs are
+// deserialized into that pool and the evaluations it leads run in it, so
+// alloc_byte_count() is what the session has made the process hold. The pool
+// is freed when the session ends, instead of growing the global pool forever.
+//
+// Limits are enforced on live usage, since a pool never shrinks: the keys the
+// session uploaded plus, for each request in flight, its estimated peak
+// (inputs and intermediates, from the cost model). A request that would push
+// the session over its limit is rejected before its inputs are loaded.
+//
+// The same object carries what the admin socket shows about a live session:
+// its key group and parameters, bytes transferred and requests answered.
+
+inline size_t object_bytes(const seal::Ciphertext& encrypted) {
+    return encrypted.size() * encrypted.poly_modulus_degree() * encrypted.coeff_modulus_size() * sizeof(uint64_t);
+}
+
+inline size_t object_bytes(const seal::Plaintext& plain) {
+    return plain.coeff_count() * sizeof(uint64_t);
+}
+
+inline size_t object_bytes(const seal::PublicKey& key) {
+    return object_bytes(key.data());
+}
+
+inline size_t object_bytes(const seal::KSwitchKeys& keys) {
+    size_t bytes = 0;
+    for (const auto& key_set : keys.data()) {
+        for (const auto& key : key_set) bytes += object_bytes(key);
+    }
+    return bytes;
+}
+
+struct SessionMemoryStats {
+    uint64_t session_id = 0;
+    size_t pool_bytes = 0;          // alloc_byte_count() of the session's pool
+    size_t key_bytes = 0;           // deserialized keys this session uploaded
+    size_t shared_key_bytes = 0;    // keys of a group another session uploaded
+    size_t in_flight_bytes = 0;     // estimated peak of the requests in flight
+    size_t input_bytes = 0;         // deserialized inputs, all requests so far
+    size_t limit = 0;
+    size_t rejected = 0;
+    std::string fingerprint;        // key group, once known
+    size_t poly_modulus_degree = 0;
+    int coeff_modulus_bits = 0;
+    size_t bytes_received = 0;      // frames, including their size prefixes
+    size_t bytes_sent = 0;
+    size_t requests = 0;
+    size_t responses = 0;
+    double connected_seconds = 0;
+};
+
+class SessionMemory {
+public:
+    SessionMemory(uint64_t session_id, size_t limit)
+        : session_id_(session_id), limit_(limit), pool_(seal::MemoryManager::GetPool(seal::mm_prof_opt::mm_force_new)),
+          connected_(std::chrono::steady_clock::now()) {}
+
+    SessionMemory(const SessionMemory&) = delete;
+    SessionMemory& operator=(const SessionMemory&) = delete;
+
+    seal::MemoryPoolHandle pool() const { return pool_; }
+
+    // owned: this session uploaded the keys (as opposed to joining a group)
+    void set_key_bytes(size_t bytes, bool owned) {
+        (owned ? key_bytes_ : shared_key_bytes_) = bytes;
+    }
+
+    bool keys_within_limit() const { return key_bytes_.load() <= limit_; }
+
+    // Reserves a request's estimated peak. False (and nothing reserved) if the
+    // session would go over its limit.
+    bool admit(size_t estimated_bytes) {
+        size_t in_flight = in_flight_bytes_.load();
+        do {
+            if (key_bytes_.load() + in_flight + estimated_bytes > limit_) {
+                rejected_++;
+                return false;
+            }
+        } while (!in_flight_bytes_.compare_exchange_weak(in_flight, in_flight + estimated_bytes));
+        return true;
+    }
+
+    void release(size_t estimated_bytes) { in_flight_bytes_ -= estimated_bytes; }
+
+    // Whether a request frame of frame_bytes fits in what the session has not
+    // reserved, checked from its size prefix before it is read. The frame is
+    // only held until admit(), so nothing is reserved for it. Counts a
+    // rejection if it does not fit.
+    bool frame_fits(size_t frame_bytes) {
+        if (key_bytes_.load() + in_flight_bytes_.load() + frame_bytes <= limit_) return true;
+        rejected_++;
+        return false;
+    }
+
+    void add_input_bytes(size_t bytes) { input_bytes_ += bytes; }
+
+    // --- Activity ---
+    void set_key_group(const std::string& fingerprint, size_t poly_modulus_degree, int coeff_modulus_bits) {
+        std::lock_guard<std::mutex> lock(info_mutex_);
+        fingerprint_ = fingerprint;
+        poly_modulus_degree_ = poly_modulus_degree;
+        coeff_modulus_bits_ = coeff_modulus_bits;
+    }
+
+    void add_received(size_t bytes) { bytes_received_ += bytes; }
+    void add_sent(size_t bytes) { bytes_sent_ += bytes; }
+    void request_received() { requests_++; }
+    void response_sent() { responses_++; }
+
+    SessionMemoryStats stats() const {
+        SessionMemoryStats stats;
+        stats.session_id = session_id_;
+        stats.pool_bytes = pool_.alloc_byte_count();
+        stats.key_bytes = key_bytes_.load();
+        stats.shared_key_bytes = shared_key_bytes_.load();
+        stats.in_flight_bytes = in_flight_bytes_.load();
+        stats.input_bytes = input_bytes_.load();
+        stats.limit = limit_;
+        stats.rejected = rejected_.load();
+        {
+            std::lock_guard<std::mutex> lock(info_mutex_);
+            stats.fingerprint = fingerprint_;
+            stats.poly_modulus_degree = poly_modulus_degree_;
+            stats.coeff_modulus_bits = coeff_modulus_bits_;
+        }
+        stats.bytes_received = bytes_received_.load();
+        stats.bytes_sent = bytes_sent_.load();
+        stats.requests = requests_.load();
+        stats.responses = responses_.load();
+        stats.connected_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - connected_).count();
+        return stats;
+    }
+
+private:
+    const uint64_t session_id_;
+    const size_t limit_;
+    seal::MemoryPoolHandle pool_;
+    std::atomic<size_t> key_bytes_{ 0 };
+    std::atomic<size_t> shared_key_bytes_{ 0 };
+    std::atomic<size_t> in_flight_bytes_{ 0 };
+    std::atomic<size_t> input_bytes_{ 0 };
+    std::atomic<size_t> rejected_{ 0 };
+    const std::chrono::steady_clock::time_point connected_;
+    mutable std::mutex info_mutex_;
+    std::string fingerprint_;
+    size_t poly_modulus_degree_ = 0;
+    int coeff_modulus_bits_ = 0;
+    std::atomic<size_t> bytes_received_{ 0 };
+    std::atomic<size_t> bytes_sent_{ 0 };
+    std::atomic<size_t> requests_{ 0 };
+    std::atomic<size_t> responses_{ 0 };
+};
+
+// Live sessions, for metrics. Sessions remove themselves when they end.
+class SessionTable {
+public:
+    void add(std::shared_ptr<SessionMemory> session, uint64_t session_id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sessions_[session_id] = std::move(session);
+    }
+
+    void remove(uint64_t session_id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sessions_.erase(session_id);
+    }
+
+    std::vector<SessionMemoryStats> snapshot() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<SessionMemoryStats> stats;
+        for (const auto& entry : sessions_) stats.push_back(entry.second->stats());
+        return stats;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::map<uint64_t, std::shared_ptr<SessionMemory>> sessions_;
+};
+
+// Resident set size of this process (from /proc/self/statm), or 0 where that
+// is not available. SEAL pools never hand memory back, and freed heap memory
+// may not be either, so this is what a long-running server really holds.
+inline size_t process_resident_bytes() {
+    std::ifstream statm("/proc/self/statm");
+    size_t total_pages = 0, resident_pages = 0;
+    if (!(statm >> total_pages >> resident_pages)) return 0;
+    return resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// Metrics in the Prometheus text format, one series per session plus the
+// global SEAL pool (response masks live there, and keys while they are
+// parsed), the key groups' own pools (see KeyGroup) and the process's
+// resident memory.
+inline std::string format_memory_metrics(const std::vector<SessionMemoryStats>& sessions, const KeyRegistryStats& keys) {
+    std::ostringstream out;
+    out << "fhe_process_resident_bytes " << process_resident_bytes() << "\n";
+    out << "fhe_global_pool_bytes " << seal::MemoryManager::GetPool().alloc_byte_count() << "\n";
+    out << "fhe_key_pool_bytes " << keys.key_pool_bytes << "\n";
+    out << "fhe_key_groups " << keys.live << "\n";
+    out << "fhe_hibernated_key_groups " << keys.hibernated << "\n";
+    out << "fhe_sessions " << sessions.size() << "\n";
+    for (const auto& s : sessions) {
+        std::string label = "{session=\"" + std::to_string(s.session_id) + "\"}";
+        out << "fhe_session_pool_bytes" << label << " " << s.pool_bytes << "\n";
+        out << "fhe_session_key_bytes" << label << " " << s.key_bytes << "\n";
+        out << "fhe_session_shared_key_bytes" << label << " " << s.shared_key_bytes << "\n";
+        out << "fhe_session_in_flight_bytes" << label << " " << s.in_flight_bytes << "\n";
+        out << "fhe_session_input_bytes_total" << label << " " << s.input_bytes << "\n";
+        out << "fhe_session_memory_limit_bytes" << label << " " << s.limit << "\n";
+        out << "fhe_session_memory_rejections_total" << label << " " << s.rejected << "\n";
+        out << "fhe_session_received_bytes_total" << label << " " << s.bytes_received << "\n";
+        out << "fhe_session_sent_bytes_total" << label << " " << s.bytes_sent << "\n";
+    }
+    return out.str();
+}
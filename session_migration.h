@@ -0,0 +1,101 @@
+#pragma once
+
+#include "coalescer.h"
+#include "hot_restart.h"
+#include "key_registry.h"
+#include "protocol.h"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// --- Session Migration ---
+// Moves a key holder to another server without a new key upload, to rebalance
+// load between nodes. The source server marks the fingerprint as moved, so
+// further requests are answered with status moved and the target's address,
+// and hello replies redirect resuming clients there (see protocol.h). Once the
+// evaluations already in progress have finished, it opens a connection to the
+// target and sends a migration frame in place of a session hello: the key
+// group (see write_key_group) and its finished results, which clients can
+// still fetch by request id. The target adopts the group and replies with a
+// session reply saying the keys are loaded.
+//
+// Layout after the magic: the key group, then the distinct response frames
+// (u32 count, each u64 length and bytes; coalesced requests share one) and
+// the results (u32 count, each request id u64, frame index u32 and the
+// encoded response header).
+
+const uint32_t MIGRATION_MAGIC = 0x4D454846; // "FHEM"
+
+inline bool is_migration(const std::string& payload) {
+    size_t pos = 0;
+    return payload.size() >= sizeof(uint32_t) && batch_frame_detail::get<uint32_t>(payload, pos) == MIGRATION_MAGIC;
+}
+
+inline std::string encode_migration(KeyGroup& group, const std::vector<std::pair<uint64_t, PlanResponse>>& results) {
+    using namespace hot_restart_detail;
+    std::stringstream out;
+    put<uint32_t>(out, MIGRATION_MAGIC);
+    write_key_group(out, group);
+
+    std::map<const std::string*, uint32_t> frame_index;
+    std::vector<const std::string*> frames;
+    for (const auto& result : results) {
+        if (frame_index.emplace(result.second.frame.get(), static_cast<uint32_t>(frames.size())).second) {
+            frames.push_back(result.second.frame.get());
+        }
+    }
+    put<uint32_t>(out, static_cast<uint32_t>(frames.size()));
+    for (const std::string* frame : frames) {
+        put<uint64_t>(out, frame->size());
+        out.write(frame->data(), static_cast<std::streamsize>(frame->size()));
+    }
+    put<uint32_t>(out, static_cast<uint32_t>(results.size()));
+    for (const auto& result : results) {
+        put<uint64_t>(out, result.first);
+        put<uint32_t>(out, frame_index.at(result.second.frame.get()));
+        std::string header = encode_response(result.second.header, "");
+        put<uint32_t>(out, static_cast<uint32_t>(header.size()));
+        out.write(header.data(), static_cast<std::streamsize>(header.size()));
+    }
+    return out.str();
+}
+
+// Loads the key group of a migration frame and returns its finished results.
+// Throws std::invalid_argument if the frame is malformed.
+inline std::shared_ptr<KeyGroup> decode_migration(const std::string& payload, const ContextCache& contexts,
+                                                  std::vector<std::pair<uint64_t, PlanResponse>>& results) {
+    using namespace hot_restart_detail;
+    const char* data = payload.data();
+    const size_t size = payload.size();
+    size_t pos = 0;
+    if (get<uint32_t>(data, size, pos) != MIGRATION_MAGIC) throw std::invalid_argument("migration: bad magic");
+    std::shared_ptr<KeyGroup> group = read_key_group(data, size, pos, contexts);
+
+    std::vector<std::shared_ptr<const std::string>> frames(get<uint32_t>(data, size, pos));
+    for (auto& frame : frames) {
+        uint64_t length = get<uint64_t>(data, size, pos);
+        if (length > size - pos) throw std::invalid_argument("migration: truncated");
+        frame = std::make_shared<const std::string>(data + pos, static_cast<size_t>(length));
+        pos += length;
+    }
+    uint32_t count = get<uint32_t>(data, size, pos);
+    results.clear();
+    for (uint32_t i = 0; i < count; i++) {
+        uint64_t request_id = get<uint64_t>(data, size, pos);
+        uint32_t frame = get<uint32_t>(data, size, pos);
+        uint32_t header_size = get<uint32_t>(data, size, pos);
+        if (frame >= frames.size() || header_size > size - pos) throw std::invalid_argument("migration: bad result");
+        std::string unused;
+        PlanResponse response;
+        response.header = decode_response(std::string(data + pos, header_size), unused);
+        pos += header_size;
+        response.frame = frames[frame];
+        results.emplace_back(request_id, std::move(response));
+    }
+    return group;
+}
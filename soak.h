@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// --- Soak Monitoring ---
+// replay_app --soak-minutes M replays its capture in rounds for M minutes and
+// samples the server at a fixed interval: its resident memory and SEAL pool
+// usage from the --metrics-file the server writes (see session_memory.h), and
+// the latency percentiles of the responses received since the last sample.
+//
+// A leak, or pools that keep growing, shows up as a steady upward trend rather
+// than in any one sample: pools fill up during the first rounds and then
+// should stay flat, since SEAL reuses pooled allocations of the same size. The
+// trend is the least-squares slope over the second half of the run, in MiB per
+// hour. Heap memory the pools do not account for (RSS minus pool bytes) is
+// tracked too, since its growth points at fragmentation rather than pools.
+// With key hibernation on (server --hibernate-after-s), the key pools and RSS
+// drop when idle groups hibernate, and the samples show by how much.
+
+struct MemorySample {
+    bool valid = false;
+    size_t resident_bytes = 0;
+    size_t global_pool_bytes = 0;
+    size_t session_pool_bytes = 0; // summed over live sessions
+    size_t key_pool_bytes = 0;     // summed over loaded key groups
+    size_t hibernated_key_groups = 0;
+    size_t sessions = 0;
+
+    size_t unaccounted_bytes() const {
+        size_t pools = global_pool_bytes + session_pool_bytes + key_pool_bytes;
+        return resident_bytes > pools ? resident_bytes - pools : 0;
+    }
+};
+
+// Reads the server's metrics file; valid is false if it cannot be read.
+inline MemorySample read_memory_metrics(const std::string& path) {
+    MemorySample sample;
+    std::ifstream in(path);
+    for (std::string line; std::getline(in, line);) {
+        std::istringstream fields(line);
+        std::string series;
+        double value = 0;
+        if (!(fields >> series >> value)) continue;
+        size_t bytes = static_cast<size_t>(value);
+        if (series == "fhe_process_resident_bytes") {
+            sample.resident_bytes = bytes;
+            sample.valid = true;
+        } else if (series == "fhe_global_pool_bytes") {
+            sample.global_pool_bytes = bytes;
+        } else if (series.rfind("fhe_session_pool_bytes{", 0) == 0) {
+            sample.session_pool_bytes += bytes;
+        } else if (series == "fhe_key_pool_bytes") {
+            sample.key_pool_bytes = bytes;
+        } else if (series == "fhe_hibernated_key_groups") {
+            sample.hibernated_key_groups = bytes;
+        } else if (series == "fhe_sessions") {
+            sample.sessions = bytes;
+        }
+    }
+    return sample;
+}
+
+struct SoakSample {
+    double elapsed_s = 0;
+    MemorySample memory;
+    size_t responses = 0; // in this interval
+    double p50_ms = 0;
+    double p95_ms = 0;
+    double p99_ms = 0;
+};
+
+// Least-squares slope of value(sample) against time over the second half of
+// samples, in units per hour; 0 with fewer than four samples in that half.
+template <class Value>
+double growth_per_hour(const std::vector<SoakSample>& samples, Value value) {
+    std::vector<const SoakSample*> tail;
+    for (size_t i = samples.size() / 2; i < samples.size(); i++) {
+        if (samples[i].memory.valid) tail.push_back(&samples[i]);
+    }
+    if (tail.size() < 4) return 0;
+    double n = static_cast<double>(tail.size());
+    double mean_t = 0, mean_v = 0;
+    for (const SoakSample* s : tail) {
+        mean_t += s->elapsed_s / n;
+        mean_v += static_cast<double>(value(*s)) / n;
+    }
+    double covariance = 0, variance = 0;
+    for (const SoakSample* s : tail) {
+        covariance += (s->elapsed_s - mean_t) * (static_cast<double>(value(*s)) - mean_v);
+        variance += (s->elapsed_s - mean_t) * (s->elapsed_s - mean_t);
+    }
+    return variance > 0 ? covariance / variance * 3600.0 : 0;
+}
+
+// Same for a latency percentile, in ms per hour
+inline double latency_growth_per_hour(const std::vector<SoakSample>& samples) {
+    std::vector<SoakSample> answered;
+    for (const SoakSample& s : samples) {
+        if (s.responses == 0) continue;
+        answered.push_back(s);
+        answered.back().memory.valid = true;
+    }
+    return growth_per_hour(answered, [](const SoakSample& s) { return s.p99_ms; });
+}
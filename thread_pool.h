@@ -0,0 +1,121 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// --- Thread Pool ---
+// A fixed set of worker threads draining a FIFO of tasks. submit() returns a
+// future for the task's result; exceptions thrown by a task surface from get().
+
+inline size_t default_thread_count() {
+    size_t hardware = std::thread::hardware_concurrency();
+    return hardware == 0 ? 1 : hardware;
+}
+
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t thread_count = 0) {
+        if (thread_count == 0) thread_count = default_thread_count();
+        for (size_t i = 0; i < thread_count; i++) {
+            workers_.emplace_back([this]() { worker_loop(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    template <class F>
+    std::future<std::invoke_result_t<F>> submit(F fn) {
+        using Result = std::invoke_result_t<F>;
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::move(fn));
+        std::future<Result> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.emplace_back([task]() { (*task)(); });
+        }
+        cv_.notify_one();
+        return result;
+    }
+
+    size_t size() const { return workers_.size(); }
+
+    // Tasks waiting for a worker (not counting the ones running).
+    size_t queued() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return tasks_.size();
+    }
+
+private:
+    void worker_loop() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cv_.wait(lock, [this]() { return stopping_ || !tasks_.empty(); });
+                if (stopping_ && tasks_.empty()) return;
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+};
+
+// Runs fn(i) for every i in [0, count) on up to thread_count threads (the caller
+// is one of them). Indices are handed out dynamically, so uneven work balances
+// itself. The first exception thrown by fn is rethrown after all threads finish.
+inline void parallel_for(size_t count, size_t thread_count, const std::function<void(size_t)>& fn) {
+    if (thread_count == 0) thread_count = default_thread_count();
+    thread_count = std::min(thread_count, count);
+    std::atomic<size_t> next{ 0 };
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto run = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            try {
+                fn(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error) error = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> helpers;
+    for (size_t t = 1; t < thread_count; t++) {
+        helpers.emplace_back(run);
+    }
+    run();
+    for (auto& helper : helpers) {
+        helper.join();
+    }
+    if (error) std::rethrow_exception(error);
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "seal/seal.h"
+#include "batch_frame.h"
+#include "coalescer.h"
+#include "eval_plan.h"
+#include "key_registry.h"
+#include "protocol.h"
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// --- Startup Warm-up ---
+// The first session used to pay for everything that is built lazily: the
+// context's NTT tables, the pages behind the global memory pool and the first
+// trip through the evaluation code. Before the server accepts connections it
+// now warms up each parameter profile it expects clients to use:
+//   1. builds the context and keeps it in the registry's ContextCache, so key
+//      groups with these parameters share its precomputation;
+//   2. generates throwaway keys, encrypts synthetic inputs and runs them through
+//      the request path (batch frame load, evaluate_requests for a replicated
+//      request, a coalesced narrow batch and a mixed-session one);
+//   3. pre-faults the global pool. SEAL pools keep freed allocations by size,
+//      and uploaded key components are size-2 ciphertexts at the key level, so
+//      touching that many bytes of them up front means the first key upload
+//      does not page-fault. Session pools are created per session and cannot be
+//      warmed this way.
+
+// A profile is named by its poly modulus degree and uses the parameters the
+// client does: CoeffModulus::BFVDefault(degree) and a batching plain modulus.
+struct ParameterProfile {
+    size_t poly_modulus_degree = 8192;
+    int plain_modulus_bits = 30;
+
+    seal::EncryptionParameters parameters() const {
+        seal::EncryptionParameters parms(seal::scheme_type::bfv);
+        parms.set_poly_modulus_degree(poly_modulus_degree);
+        parms.set_coeff_modulus(seal::CoeffModulus::BFVDefault(poly_modulus_degree));
+        parms.set_plain_modulus(seal::PlainModulus::Batching(poly_modulus_degree, plain_modulus_bits));
+        return parms;
+    }
+};
+
+// Parses a comma-separated list of degrees ("8192,16384"); "none" is empty.
+inline std::vector<ParameterProfile> parse_parameter_profiles(const std::string& list) {
+    std::vector<ParameterProfile> profiles;
+    if (list == "none") return profiles;
+    std::stringstream in(list);
+    for (std::string field; std::getline(in, field, ',');) {
+        ParameterProfile profile;
+        try {
+            profile.poly_modulus_degree = std::stoul(field);
+        } catch (const std::exception&) {
+            throw std::invalid_argument("warm-up: not a poly modulus degree: " + field);
+        }
+        if (profile.poly_modulus_degree < 1024 || profile.poly_modulus_degree > 32768 ||
+            (profile.poly_modulus_degree & (profile.poly_modulus_degree - 1)) != 0) {
+            throw std::invalid_argument("warm-up: unsupported poly modulus degree: " + field);
+        }
+        profiles.push_back(profile);
+    }
+    return profiles;
+}
+
+struct WarmupReport {
+    size_t poly_modulus_degree = 0;
+    double context_ms = 0;
+    double keys_ms = 0;
+    double evaluation_ms = 0;
+    size_t evaluations = 0;
+    size_t prefaulted_bytes = 0;
+};
+
+// Warms up one profile for plan (whose inputs are all encrypted or plaintext
+// amounts) and stores its context in contexts. Each evaluation shape runs
+// rounds times; pool_bytes of key-level ciphertexts are pre-faulted in the
+// global pool.
+inline WarmupReport warm_up_profile(const ParameterProfile& profile, ContextCache& contexts, const EvalPlan& plan,
+                                    const std::vector<std::string>& outputs, const EvaluationOptions& options,
+                                    size_t pool_bytes, size_t rounds = 2) {
+    using clock = std::chrono::steady_clock;
+    auto elapsed_ms = [](clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    };
+    WarmupReport report;
+    report.poly_modulus_degree = profile.poly_modulus_degree;
+
+    auto start = clock::now();
+    seal::EncryptionParameters parms = profile.parameters();
+    seal::SEALContext context(parms);
+    if (!context.parameters_set()) throw std::invalid_argument("warm-up: invalid parameters for this profile");
+    contexts.insert(parms, context);
+    report.context_ms = elapsed_ms(start);
+
+    // Only the rotations the narrow response packing uses
+    start = clock::now();
+    KeyGroup group(context, "warm-up");
+    seal::KeyGenerator keygen(context);
+    keygen.create_public_key(group.public_key);
+    keygen.create_relin_keys(group.relin_keys);
+    const ResponseLayout& layout = group.packer(outputs.size()).layout();
+    std::vector<int> steps;
+    for (size_t i = 1; i < layout.count; i++) steps.push_back(-static_cast<int>(layout.offset(i)));
+    if (!steps.empty()) keygen.create_galois_keys(steps, group.galois_keys);
+    report.keys_ms = elapsed_ms(start);
+
+    // Synthetic inputs go through a batch frame, as a client's would
+    start = clock::now();
+    seal::Encryptor encryptor(context, group.public_key);
+    std::vector<uint64_t> amounts(group.batch_encoder.slot_count(), 1);
+    seal::Plaintext encoded;
+    group.batch_encoder.encode(amounts, encoded);
+    seal::Ciphertext encrypted;
+    encryptor.encrypt(encoded, encrypted);
+    BatchFrameWriter writer(context, encrypted.parms_id());
+    for (const auto& node : plan.nodes()) {
+        if (node.op == PlanOp::input) writer.add(encrypted);
+        if (node.op == PlanOp::plain_input) writer.add(encoded);
+    }
+    BatchFrameReader reader(context, writer.finish());
+    PlanRequest synthetic;
+    size_t index = 0;
+    for (const auto& node : plan.nodes()) {
+        if (node.op == PlanOp::input) reader.load(index++, synthetic.ciphertexts[node.name]);
+        if (node.op == PlanOp::plain_input) reader.load(index++, synthetic.plaintexts[node.name]);
+    }
+
+    // A replicated request, two narrow ones from one session, and two from
+    // different sessions (which adds the range masking)
+    PlanRequest replicated = synthetic;
+    replicated.layout.slot_width = static_cast<uint32_t>(group.batch_encoder.slot_count());
+    std::vector<PlanRequest> narrow(3, synthetic);
+    for (size_t r = 0; r < narrow.size(); r++) {
+        narrow[r].layout.slot_offset = r == 0 ? 0 : 1;
+        narrow[r].layout.slot_width = 1;
+        narrow[r].session_id = r == 2 ? 1 : 0;
+    }
+    const std::vector<std::vector<const PlanRequest*>> shapes = {
+        { &replicated }, { &narrow[0], &narrow[1] }, { &narrow[0], &narrow[2] }
+    };
+    for (size_t round = 0; round < rounds; round++) {
+        for (const auto& requests : shapes) {
+            evaluate_requests(group, plan, outputs, requests, options);
+            report.evaluations++;
+        }
+    }
+    report.evaluation_ms = elapsed_ms(start);
+
+    // Allocated together so the pool cannot hand the same block out twice
+    auto key_level = context.key_context_data();
+    size_t key_component_bytes = ciphertext_bytes(2, profile.poly_modulus_degree, key_level->parms().coeff_modulus().size());
+    std::vector<seal::Ciphertext> prefault(pool_bytes / key_component_bytes);
+    for (auto& component : prefault) component.resize(context, key_level->parms_id(), 2);
+    report.prefaulted_bytes = prefault.size() * key_component_bytes;
+    return report;
+}